@@ -0,0 +1,331 @@
+/*
+ * File:   AsioAcceptor.h
+ * Author: mihiranad
+ *
+ * A listening socket run on one io_service of an IoServicePool. Every
+ * accepted connection is a socket handler of the server, created before the
+ * accept so the kernel hands the connection straight to its socket. With
+ * SO_REUSEPORT there is one acceptor per io_service, the kernel spreads the
+ * incoming connections over them and each connection stays on the thread
+ * that accepted it. Without it a single acceptor hands the connections out
+ * round robin over the pool. A Unix-domain socket always has a single
+ * acceptor.
+ *
+ * The Server is normally a ServerHandler, called on the acceptor's thread:
+ *
+ *   Connection* create_connection();
+ *   void connection_accepted(Connection* connection, size_t index);
+ *   void connection_abandoned(Connection* connection);
+ */
+
+#ifndef ASIOACCEPTOR_H
+#define	ASIOACCEPTOR_H
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include "IoServicePool.h"
+#include "SocketOptions.h"
+#include "SocketStats.h"
+
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+using boost::asio::deadline_timer;
+using boost::asio::ip::tcp;
+
+namespace modt_socket {
+
+    struct ServerSettings { // picked up by ServerHandler::Listen
+
+        // one SO_REUSEPORT listening socket per io_service of the pool, otherwise a single one.
+        // Falls back to a single listening socket where SO_REUSEPORT is not available, and is
+        // ignored for a Unix-domain socket
+        bool reuse_port;
+
+        // connections taken off the kernel's accept queue each time the listening socket wakes up
+        size_t accept_batch;
+
+        // connections accepted per second over all the listening sockets, 0 for no limit. Connections
+        // over the limit wait in the kernel's accept queue, which holds up to listen_backlog of them
+        double max_accept_rate;
+        int listen_backlog;
+
+        // set on every accepted socket, the buffer sizes are set on the listening sockets already
+        SocketOptions options;
+
+        ServerSettings()
+        : reuse_port(true),
+        accept_batch(16),
+        max_accept_rate(0),
+        listen_backlog(boost::asio::socket_base::max_connections) {
+        }
+
+    };
+
+    template <typename Server>
+    class AsioAcceptor : public boost::enable_shared_from_this<AsioAcceptor<Server> > {
+    public:
+
+        typedef typename Server::Connection Connection;
+
+        // index is the io_service of the pool the acceptor runs on
+        AsioAcceptor(IoServicePool& pool, size_t index, Server* server, const ServerSettings& settings, double accept_rate)
+        : stopped_(false),
+        pool_(pool),
+        index_(index),
+        next_index_(index),
+        server_(server),
+        settings_(settings),
+        acceptor_(pool.io_service(index)),
+        throttle_(pool.io_service(index)),
+        pending_(NULL),
+        pending_index_(index),
+        accept_rate_(accept_rate),
+        tokens_(0),
+        refilled_(0),
+        accepted_(0) {
+
+            MODT_SOCKET_LOG_INFO(g_Logger, "AsioAcceptor::AsioAcceptor()", "Created AsioAcceptor Object [" << this << "]");
+
+        }
+
+        virtual ~AsioAcceptor() {
+            MODT_SOCKET_LOG_INFO(g_Logger, "AsioAcceptor::~AsioAcceptor()", "Destruct AsioAcceptor Object [" << this << "]");
+        }
+
+        // opens, binds and listens on the caller's thread, before start
+        boost::system::error_code listen(const StreamEndpoint& ep);
+
+        // starts accepting, on the acceptor's io_service thread
+        void start();
+
+        // stops accepting and closes the listening socket, on the acceptor's io_service thread
+        void abort();
+
+        StreamEndpoint local_endpoint() const {
+            boost::system::error_code ignored;
+            return acceptor_.local_endpoint(ignored);
+        }
+
+        boost::uint64_t accepted() const {
+            return accepted_.load(boost::memory_order_relaxed);
+        }
+
+    private:
+
+        void start_accept();
+
+        void handle_accept(const boost::system::error_code& ec);
+
+        void accepted(Connection* connection);
+
+        void prepare();
+
+        // token bucket of the accept rate limit, false if the next accept has to wait
+        bool has_token();
+
+        void handle_throttle(const boost::system::error_code& ec);
+
+        bool stopped_;
+
+        IoServicePool& pool_;
+        size_t index_;
+        size_t next_index_; // round robin cursor of a single acceptor
+
+        Server* server_;
+        ServerSettings settings_;
+
+        StreamAcceptor acceptor_;
+        deadline_timer throttle_; // waits out the rate limit, or a failing accept
+
+        Connection* pending_; // created for the next accept, owned by the server
+        size_t pending_index_;
+
+        double accept_rate_; // this acceptor's share of max_accept_rate
+        double tokens_;
+        boost::uint64_t refilled_; // stats_now() of the last refill
+
+        boost::atomic<boost::uint64_t> accepted_;
+
+    };
+
+    template <typename Server>
+    boost::system::error_code AsioAcceptor<Server>::listen(const StreamEndpoint& ep) {
+
+        boost::system::error_code error;
+
+        acceptor_.open(ep.protocol(), error);
+        if (!error && !is_local(ep))
+            acceptor_.set_option(StreamAcceptor::reuse_address(true), error);
+        if (!error && !apply_listen_options(acceptor_, settings_.options, settings_.reuse_port))
+            error = boost::asio::error::operation_not_supported;
+        if (!error)
+            acceptor_.bind(ep, error);
+        if (!error)
+            acceptor_.listen(settings_.listen_backlog, error);
+        if (!error) // the batch is taken with accepts that return would_block once the queue is empty
+            acceptor_.non_blocking(true, error);
+
+        if (error) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioAcceptor::listen()", "Could not listen on " << endpoint_name(ep) << " : " << error.message());
+            boost::system::error_code ignored;
+            acceptor_.close(ignored);
+            return error;
+
+        }
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioAcceptor::listen()", "Listening on " << endpoint_name(local_endpoint()));
+        return error;
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::start() {
+
+        tokens_ = 1;
+        refilled_ = stats_now();
+        start_accept();
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::abort() {
+
+        stopped_ = true;
+        boost::system::error_code ignored;
+        acceptor_.close(ignored);
+        throttle_.cancel();
+
+        if (pending_) {
+            server_->connection_abandoned(pending_);
+            pending_ = NULL;
+        }
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioAcceptor::abort()", "Aborted the acceptor object");
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::prepare() {
+
+        if (pending_)
+            return; // the last accept came back empty, the connection is still unused
+
+        // with SO_REUSEPORT the connection stays on the thread that accepted it
+        pending_index_ = settings_.reuse_port ? index_ : next_index_++ % pool_.size();
+        pending_ = server_->create_connection();
+        pending_->PrepareAccept(pool_, pending_index_);
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::start_accept() {
+
+        if (stopped_)
+            return;
+
+        if (!has_token()) {
+
+            // the connections wait in the kernel's accept queue meanwhile
+            throttle_.expires_from_now(boost::posix_time::microseconds(static_cast<boost::int64_t> ((1 - tokens_) * 1e6 / accept_rate_) + 1));
+            throttle_.async_wait(boost::bind(&AsioAcceptor<Server>::handle_throttle, this->shared_from_this(), _1));
+            return;
+
+        }
+
+        prepare();
+        acceptor_.async_accept(pending_->PrepareAccept(pool_, pending_index_),
+                boost::bind(&AsioAcceptor<Server>::handle_accept, this->shared_from_this(), _1));
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::handle_accept(const boost::system::error_code& ec) {
+
+        if (stopped_)
+            return;
+
+        if (ec) {
+
+            // out of file descriptors and the like, retrying at once would only spin
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioAcceptor::handle_accept()", "Accept error : " << ec.message());
+            throttle_.expires_from_now(boost::posix_time::milliseconds(100));
+            throttle_.async_wait(boost::bind(&AsioAcceptor<Server>::handle_throttle, this->shared_from_this(), _1));
+            return;
+
+        }
+
+        accepted(pending_);
+
+        // whatever else is waiting in the accept queue is taken now, up to the batch size
+        for (size_t count = 1; count < settings_.accept_batch && !stopped_ && has_token(); ++count) {
+
+            prepare();
+
+            boost::system::error_code error;
+            acceptor_.accept(pending_->PrepareAccept(pool_, pending_index_), error);
+            if (error) {
+                if (error != boost::asio::error::would_block && error != boost::asio::error::try_again)
+                    MODT_SOCKET_LOG_ERROR(g_Logger, "AsioAcceptor::handle_accept()", "Accept error : " << error.message());
+                break; // the connection is kept for the next accept
+            }
+
+            accepted(pending_);
+
+        }
+
+        start_accept();
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::accepted(Connection* connection) {
+
+        pending_ = NULL;
+        if (accept_rate_ > 0)
+            tokens_ -= 1;
+        accepted_.fetch_add(1, boost::memory_order_relaxed);
+
+        server_->connection_accepted(connection, pending_index_);
+        connection->StartAccepted(settings_.options);
+
+    }
+
+    template <typename Server>
+    bool AsioAcceptor<Server>::has_token() {
+
+        if (accept_rate_ <= 0)
+            return true;
+
+        // a bucket of one batch, a burst never takes more than that at once
+        boost::uint64_t now = stats_now();
+        tokens_ += (now - refilled_) * accept_rate_ / 1e9;
+        refilled_ = now;
+        double burst = settings_.accept_batch > 1 ? static_cast<double> (settings_.accept_batch) : 1;
+        if (tokens_ > burst)
+            tokens_ = burst;
+
+        return tokens_ >= 1;
+
+    }
+
+    template <typename Server>
+    void AsioAcceptor<Server>::handle_throttle(const boost::system::error_code& ec) {
+
+        if (stopped_ || ec == boost::asio::error::operation_aborted)
+            return;
+
+        start_accept();
+
+    }
+
+}
+
+#endif	/* ASIOACCEPTOR_H */
@@ -0,0 +1,223 @@
+/*
+ * File:   AsioDatagram.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "AsioDatagram.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <net/if.h>
+#include <netinet/in.h>
+
+using namespace modt_socket;
+
+namespace {
+
+    // room for one timestamp control message per datagram
+    const size_t CONTROL_SIZE = CMSG_SPACE(sizeof (struct timespec));
+
+    boost::system::error_code set_option(int fd, int level, int name, int value) {
+
+        if (::setsockopt(fd, level, name, &value, sizeof (value)) != 0)
+            return boost::system::error_code(errno, boost::system::system_category());
+        return boost::system::error_code();
+
+    }
+
+}
+
+DatagramBatch::DatagramBatch(size_t count, size_t slot_size)
+: count_(count),
+slot_size_(slot_size),
+iovecs_(count),
+senders_(count),
+control_(count * CONTROL_SIZE),
+headers_(count) {
+#ifndef MODT_SOCKET_HAS_RECVMMSG
+    lengths_.resize(count);
+#endif
+}
+
+void DatagramBatch::prepare(size_t index, char* block) {
+
+    iovecs_[index].iov_base = block + index * slot_size_;
+    iovecs_[index].iov_len = slot_size_;
+
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+    struct msghdr& header = headers_[index].msg_hdr;
+#else
+    struct msghdr& header = headers_[index];
+#endif
+    std::memset(&header, 0, sizeof (header));
+    header.msg_name = &senders_[index];
+    header.msg_namelen = sizeof (senders_[index]);
+    header.msg_iov = &iovecs_[index];
+    header.msg_iovlen = 1;
+    header.msg_control = &control_[index * CONTROL_SIZE];
+    header.msg_controllen = CONTROL_SIZE;
+
+}
+
+int DatagramBatch::receive(int fd, char* block) {
+
+    // the kernel overwrites the name and control lengths, they are set again every time
+    for (size_t i = 0; i < count_; ++i)
+        prepare(i, block);
+
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+
+    return ::recvmmsg(fd, &headers_[0], static_cast<unsigned int> (count_), MSG_DONTWAIT, NULL);
+
+#else
+
+    size_t received = 0;
+    while (received < count_) {
+
+        ssize_t length = ::recvmsg(fd, &headers_[received], MSG_DONTWAIT);
+        if (length < 0)
+            return received ? static_cast<int> (received) : -1;
+        lengths_[received++] = static_cast<size_t> (length);
+
+    }
+    return static_cast<int> (received);
+
+#endif
+
+}
+
+size_t DatagramBatch::length(size_t index) const {
+
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+    return headers_[index].msg_len;
+#else
+    return lengths_[index];
+#endif
+
+}
+
+bool DatagramBatch::truncated(size_t index) const {
+
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+    return (headers_[index].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+#else
+    return (headers_[index].msg_flags & MSG_TRUNC) != 0;
+#endif
+
+}
+
+udp::endpoint DatagramBatch::sender(size_t index) const {
+
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+    const struct msghdr& header = headers_[index].msg_hdr;
+#else
+    const struct msghdr& header = headers_[index];
+#endif
+
+    udp::endpoint sender;
+    if (header.msg_namelen <= sender.capacity()) {
+        std::memcpy(sender.data(), &senders_[index], header.msg_namelen);
+        sender.resize(header.msg_namelen);
+    }
+    return sender;
+
+}
+
+boost::uint64_t DatagramBatch::kernel_time(size_t index) const {
+
+#ifdef SO_TIMESTAMPNS
+
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+    struct msghdr& header = const_cast<struct msghdr&> (headers_[index].msg_hdr);
+#else
+    struct msghdr& header = const_cast<struct msghdr&> (headers_[index]);
+#endif
+
+    for (struct cmsghdr* control = CMSG_FIRSTHDR(&header); control; control = CMSG_NXTHDR(&header, control)) {
+
+        if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec stamp;
+            std::memcpy(&stamp, CMSG_DATA(control), sizeof (stamp));
+            return static_cast<boost::uint64_t> (stamp.tv_sec) * 1000000000ULL + stamp.tv_nsec;
+        }
+
+    }
+
+#endif
+    return 0;
+
+}
+
+boost::system::error_code modt_socket::apply_datagram_options(udp::socket& socket, const DatagramSettings& settings) {
+
+    int fd = socket.native_handle();
+    boost::system::error_code error;
+
+    if (settings.reuse_address)
+        error = set_option(fd, SOL_SOCKET, SO_REUSEADDR, 1);
+    if (!error && settings.receive_buffer > 0)
+        error = set_option(fd, SOL_SOCKET, SO_RCVBUF, settings.receive_buffer);
+    if (!error && settings.send_buffer > 0)
+        error = set_option(fd, SOL_SOCKET, SO_SNDBUF, settings.send_buffer);
+
+    if (!error && settings.kernel_timestamps) {
+#ifdef SO_TIMESTAMPNS
+        error = set_option(fd, SOL_SOCKET, SO_TIMESTAMPNS, 1);
+#else
+        MODT_SOCKET_LOG_WARN(g_Logger, "apply_datagram_options()", "Kernel timestamps are not available on this platform");
+#endif
+    }
+
+    if (!error)
+        socket.set_option(boost::asio::ip::multicast::hops(settings.multicast_ttl), error);
+    if (!error)
+        socket.set_option(boost::asio::ip::multicast::enable_loopback(settings.multicast_loopback), error);
+    if (!error && !settings.multicast_interface.empty()) {
+        boost::asio::ip::address_v4 interface = boost::asio::ip::address_v4::from_string(settings.multicast_interface, error);
+        if (!error)
+            socket.set_option(boost::asio::ip::multicast::outbound_interface(interface), error);
+    }
+
+    if (error)
+        MODT_SOCKET_LOG_ERROR(g_Logger, "apply_datagram_options()", "Could not set the socket options : " << error.message());
+
+    return error;
+
+}
+
+boost::uint64_t modt_socket::wall_now() {
+
+    struct timespec now;
+    ::clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<boost::uint64_t> (now.tv_sec) * 1000000000ULL + now.tv_nsec;
+
+}
+
+boost::system::error_code modt_socket::multicast_interface_v4(const std::string& interface, boost::asio::ip::address_v4& address) {
+
+    boost::system::error_code error;
+    address = interface.empty() ? boost::asio::ip::address_v4::any() : boost::asio::ip::address_v4::from_string(interface, error);
+    return error;
+
+}
+
+boost::system::error_code modt_socket::multicast_interface_v6(const std::string& interface, unsigned long& index) {
+
+    index = 0;
+    if (interface.empty())
+        return boost::system::error_code();
+
+    if (interface.find_first_not_of("0123456789") == std::string::npos) {
+        index = std::strtoul(interface.c_str(), NULL, 10);
+        return boost::system::error_code();
+    }
+
+    index = ::if_nametoindex(interface.c_str());
+    if (index == 0)
+        return boost::system::errc::make_error_code(boost::system::errc::no_such_device);
+    return boost::system::error_code();
+
+}
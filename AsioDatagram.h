@@ -0,0 +1,517 @@
+/*
+ * File:   AsioDatagram.h
+ * Author: mihiranad
+ *
+ * The UDP counterpart of AsioSocket, for unicast and multicast feeds. The
+ * read actor waits for the socket to become readable and then drains it in
+ * batches, up to recv_batch datagrams per recvmmsg call, received into a
+ * single pooled block. Every datagram is handed to the handler as a view
+ * into that block, which it may keep past the callback. Sending is done on
+ * the caller's thread, a datagram goes out whole or not at all.
+ *
+ * The Handler, normally a BasicDatagramHandler, is called on the io_service thread:
+ *
+ *   void OnDatagram(const BufferView& data, const DatagramInfo& info);
+ *   void OnGap(boost::uint64_t expected, boost::uint64_t received);
+ *   void OnClose(const boost::system::error_code& ec);
+ *   bool ParseSequence(const char* data, size_t size, boost::uint64_t& sequence);
+ */
+
+#ifndef ASIODATAGRAM_H
+#define	ASIODATAGRAM_H
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/multicast.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "BufferPool.h"
+#include "IoRunner.h"
+#include "SocketStats.h"
+
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+using boost::asio::ip::udp;
+
+#if defined(__linux__) && !defined(MODT_SOCKET_NO_RECVMMSG)
+#define MODT_SOCKET_HAS_RECVMMSG // otherwise a batch is taken with one recvmsg per datagram
+#endif
+
+namespace modt_socket {
+
+    struct DatagramSettings { // picked up by BasicDatagramHandler::Open
+
+        // the largest datagram received, a longer one is discarded and counted as dropped
+        size_t max_datagram_size;
+
+        // datagrams taken per recvmmsg call. While the calls come back full the socket is drained
+        // with up to max_batches of them before other handlers of the io_service get a turn
+        size_t recv_batch;
+        size_t max_batches;
+
+        // SO_RCVBUF and SO_SNDBUF, 0 for the system default. A burst of the feed has to fit in the
+        // receive buffer, the kernel drops what does not
+        int receive_buffer;
+        int send_buffer;
+
+        // SO_REUSEADDR, lets several sockets and processes bind the port of a multicast group
+        bool reuse_address;
+
+        // for sending to a multicast group. The interface is the IPv4 address of the one to send
+        // from, empty for the routing table's choice
+        std::string multicast_interface;
+        int multicast_ttl;
+        bool multicast_loopback;
+
+        // SO_TIMESTAMPNS, the time the kernel received each datagram goes into DatagramInfo
+        bool kernel_timestamps;
+
+        // ParseSequence is called for every datagram and OnGap when sequence numbers are skipped.
+        // There is a single sequence per socket, i.e. per feed
+        bool detect_gaps;
+
+        // binary trace of the socket's events, see SocketLog.h
+        boost::shared_ptr<SocketEventLog> event_log;
+
+        // how the socket's own io thread runs, see IoRunner.h. A pooled socket runs as its pool does
+        RunSettings run;
+
+        DatagramSettings()
+        : max_datagram_size(2048),
+        recv_batch(32),
+        max_batches(8),
+        receive_buffer(0),
+        send_buffer(0),
+        reuse_address(true),
+        multicast_ttl(1),
+        multicast_loopback(true),
+        kernel_timestamps(false),
+        detect_gaps(false) {
+        }
+
+    };
+
+    struct DatagramInfo { // passed to OnDatagram along with the payload
+
+        udp::endpoint sender;
+        boost::uint64_t kernel_time; // ns since the epoch, when the kernel received it. 0 without kernel_timestamps
+        boost::uint64_t sequence; // as found by ParseSequence, 0 without detect_gaps or if it found none
+
+        DatagramInfo()
+        : kernel_time(0),
+        sequence(0) {
+        }
+
+    };
+
+    // the message headers of one batch receive, over a block split into max_datagram_size slots
+    class DatagramBatch : private boost::noncopyable {
+    public:
+
+        DatagramBatch(size_t count, size_t slot_size);
+
+        // receives up to count() datagrams without blocking into the block, which has to hold
+        // count() slots. The number received, 0 if there was nothing, -1 on an error in errno
+        int receive(int fd, char* block);
+
+        size_t count() const {
+            return count_;
+        }
+
+        size_t slot_size() const {
+            return slot_size_;
+        }
+
+        size_t length(size_t index) const;
+        bool truncated(size_t index) const;
+        udp::endpoint sender(size_t index) const;
+        boost::uint64_t kernel_time(size_t index) const; // 0 if the kernel gave none
+
+    private:
+
+        void prepare(size_t index, char* block);
+
+        size_t count_;
+        size_t slot_size_;
+        std::vector<struct iovec> iovecs_;
+        std::vector<struct sockaddr_storage> senders_;
+        std::vector<char> control_;
+#ifdef MODT_SOCKET_HAS_RECVMMSG
+        std::vector<struct mmsghdr> headers_;
+#else
+        std::vector<struct msghdr> headers_;
+        std::vector<size_t> lengths_;
+#endif
+
+    };
+
+    // sets the buffer sizes, SO_REUSEADDR, the timestamps and the multicast send options on an open socket
+    boost::system::error_code apply_datagram_options(udp::socket& socket, const DatagramSettings& settings);
+
+    // the realtime clock in ns since the epoch, the clock of the kernel timestamps
+    boost::uint64_t wall_now();
+
+    // the interface of a group membership, empty for the default one. An IPv4 address for an IPv4
+    // group, an interface index or name for an IPv6 one. invalid_argument or no_such_device otherwise
+    boost::system::error_code multicast_interface_v4(const std::string& interface, boost::asio::ip::address_v4& address);
+    boost::system::error_code multicast_interface_v6(const std::string& interface, unsigned long& index);
+
+    template <typename Handler>
+    class AsioDatagram : public boost::enable_shared_from_this<AsioDatagram<Handler> > {
+    public:
+
+        AsioDatagram(boost::asio::io_service& io_service, Handler* handler, SocketMetrics& stats, const DatagramSettings& settings)
+        : stopped_(false),
+        settings_(settings),
+        io_service_(io_service),
+        socket_(io_service),
+        handler_(handler),
+        stats_(stats),
+        event_log_(settings.event_log.get()),
+        connection_id_(reinterpret_cast<size_t> (handler)),
+        batch_(settings.recv_batch ? settings.recv_batch : 1, settings.max_datagram_size),
+        pool_(boost::make_shared<BufferPool>(batch_.count() * batch_.slot_size())),
+        expected_(0),
+        sequenced_(false) {
+
+            MODT_SOCKET_LOG_INFO(g_Logger, "AsioDatagram::AsioDatagram()", "Created AsioDatagram Object [" << this << "]");
+
+        }
+
+        virtual ~AsioDatagram() {
+            MODT_SOCKET_LOG_INFO(g_Logger, "AsioDatagram::~AsioDatagram()", "Destruct AsioDatagram Object [" << this << "]");
+        }
+
+        // opens and binds on the caller's thread, before start
+        boost::system::error_code open(const udp::endpoint& local);
+
+        // the interface is an IPv4 address for an IPv4 group, an interface index or name for an IPv6
+        // one, empty for the default. Safe from any thread, it only sets a socket option
+        boost::system::error_code join_group(const boost::asio::ip::address& group, const std::string& interface);
+        boost::system::error_code leave_group(const boost::asio::ip::address& group, const std::string& interface);
+
+        // starts the read actor, on the io_service thread
+        void start();
+
+        // stops reading and closes the socket, on the io_service thread or once it is stopped
+        void abort();
+
+        // Called from any thread, sends at once without blocking. False if the socket is not
+        // open or the kernel did not take the datagram, e.g. with the send buffer full
+        bool send_to(const char* data, size_t size, const udp::endpoint& destination);
+
+        udp::endpoint local_endpoint() const {
+            boost::system::error_code ignored;
+            return socket_.local_endpoint(ignored);
+        }
+
+    private:
+
+        void start_receive();
+
+        void handle_receive(const boost::system::error_code& ec);
+
+        // one recvmmsg, the number of datagrams received
+        size_t receive_batch();
+
+        void deliver(const BufferView& data, DatagramInfo& info);
+
+        bool stopped_;
+
+        DatagramSettings settings_;
+
+        boost::asio::io_service& io_service_;
+
+        udp::socket socket_;
+
+        Handler* handler_; // used to invoke callbacks....
+
+        SocketMetrics& stats_; // owned by the handler, kept across opens
+        SocketEventLog* event_log_; // kept alive by settings_
+        boost::uint64_t connection_id_;
+
+        DatagramBatch batch_;
+        boost::shared_ptr<BufferPool> pool_; // a block per batch
+        BufferBlockPtr block_; // reused as long as no view of the last batch is kept
+
+        boost::uint64_t expected_; // the next sequence number, once sequenced_
+        bool sequenced_;
+
+    };
+
+    template <typename Handler>
+    boost::system::error_code AsioDatagram<Handler>::open(const udp::endpoint& local) {
+
+        boost::system::error_code error;
+
+        socket_.open(local.protocol(), error);
+        if (!error)
+            error = apply_datagram_options(socket_, settings_);
+        if (!error)
+            socket_.bind(local, error);
+        if (!error) // the batch receive drains the socket until it would block
+            socket_.non_blocking(true, error);
+
+        if (error) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioDatagram::open()", "Could not bind to " << local.address().to_string() << ":" << local.port() << " : " << error.message());
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+            return error;
+
+        }
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioDatagram::open()", "Bound to " << local.address().to_string() << ":" << local_endpoint().port());
+        return error;
+
+    }
+
+    template <typename Handler>
+    boost::system::error_code AsioDatagram<Handler>::join_group(const boost::asio::ip::address& group, const std::string& interface) {
+
+        boost::system::error_code error;
+
+        // a bad interface is an error, not the default one
+        if (group.is_v4()) {
+
+            boost::asio::ip::address_v4 address;
+            error = multicast_interface_v4(interface, address);
+            if (!error)
+                socket_.set_option(boost::asio::ip::multicast::join_group(group.to_v4(), address), error);
+
+        } else {
+
+            unsigned long index = 0;
+            error = multicast_interface_v6(interface, index);
+            if (!error)
+                socket_.set_option(boost::asio::ip::multicast::join_group(group.to_v6(), index), error);
+
+        }
+
+        if (error)
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioDatagram::join_group()", "Could not join " << group.to_string() << (interface.empty() ? "" : " on ") << interface << " : " << error.message());
+        else
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioDatagram::join_group()", "Joined " << group.to_string() << (interface.empty() ? "" : " on ") << interface);
+
+        return error;
+
+    }
+
+    template <typename Handler>
+    boost::system::error_code AsioDatagram<Handler>::leave_group(const boost::asio::ip::address& group, const std::string& interface) {
+
+        boost::system::error_code error;
+
+        // a bad interface is an error, not the default one
+        if (group.is_v4()) {
+
+            boost::asio::ip::address_v4 address;
+            error = multicast_interface_v4(interface, address);
+            if (!error)
+                socket_.set_option(boost::asio::ip::multicast::leave_group(group.to_v4(), address), error);
+
+        } else {
+
+            unsigned long index = 0;
+            error = multicast_interface_v6(interface, index);
+            if (!error)
+                socket_.set_option(boost::asio::ip::multicast::leave_group(group.to_v6(), index), error);
+
+        }
+
+        if (error)
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioDatagram::leave_group()", "Could not leave " << group.to_string() << (interface.empty() ? "" : " on ") << interface << " : " << error.message());
+
+        return error;
+
+    }
+
+    template <typename Handler>
+    void AsioDatagram<Handler>::start() {
+
+        if (stopped_)
+            return;
+
+        start_receive();
+
+    }
+
+    template <typename Handler>
+    void AsioDatagram<Handler>::abort() {
+
+        stopped_ = true;
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioDatagram::abort()", "Aborted the datagram socket object");
+
+    }
+
+    template <typename Handler>
+    bool AsioDatagram<Handler>::send_to(const char* data, size_t size, const udp::endpoint& destination) {
+
+        if (!socket_.is_open())
+            return false;
+
+        int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+        flags |= MSG_NOSIGNAL;
+#endif
+        ssize_t sent = ::sendto(socket_.native_handle(), data, size, flags, destination.data(), destination.size());
+        stats_add(stats_.write_calls, 1);
+
+        if (sent < 0) {
+
+            stats_add(stats_.messages_dropped, 1);
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioDatagram::send_to()", "Send error : " << errno);
+            return false;
+
+        }
+
+        stats_add(stats_.bytes_out, sent);
+        stats_add(stats_.messages_out, 1);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_INLINE_WRITE, sent, data);
+        return true;
+
+    }
+
+    template <typename Handler>
+    void AsioDatagram<Handler>::start_receive() {
+
+        if (stopped_)
+            return;
+
+        // nothing is received by asio itself, the batches are taken with recvmmsg once readable
+        socket_.async_wait(udp::socket::wait_read,
+                boost::bind(&AsioDatagram<Handler>::handle_receive, this->shared_from_this(), _1));
+
+    }
+
+    template <typename Handler>
+    void AsioDatagram<Handler>::handle_receive(const boost::system::error_code& ec) {
+
+        if (stopped_)
+            return;
+
+        if (ec) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioDatagram::handle_receive()", "Receive Error : " << ec.message());
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DISCONNECT, 0, NULL);
+            abort();
+            handler_->OnClose(ec);
+            return;
+
+        }
+
+        // a full batch means there is more waiting, taken now up to max_batches
+        for (size_t batches = 0; batches < settings_.max_batches && !stopped_; ++batches) {
+            if (receive_batch() < batch_.count())
+                break;
+        }
+
+        start_receive();
+
+    }
+
+    template <typename Handler>
+    size_t AsioDatagram<Handler>::receive_batch() {
+
+        // the last block is taken again unless the handler kept a view into it
+        if (!block_ || !block_->unique())
+            block_ = pool_->acquire();
+
+        int received = batch_.receive(socket_.native_handle(), block_->data());
+        stats_add(stats_.read_calls, 1);
+
+        if (received < 0) {
+
+            // e.g. an ICMP error for an earlier send, the socket itself is fine
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioDatagram::receive_batch()", "Receive error : " << errno);
+            return 0;
+
+        }
+
+        boost::uint64_t now = settings_.kernel_timestamps ? wall_now() : 0;
+
+        for (int i = 0; i < received && !stopped_; ++i) {
+
+            size_t length = batch_.length(i);
+            const char* data = block_->data() + i * batch_.slot_size();
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_RECEIVE, length, data);
+
+            if (batch_.truncated(i)) {
+
+                stats_add(stats_.messages_dropped, 1);
+                MODT_SOCKET_LOG_ERROR(g_Logger, "AsioDatagram::receive_batch()", "Datagram exceeds max_datagram_size " << batch_.slot_size() << ", discarded...");
+                continue;
+
+            }
+
+            stats_add(stats_.bytes_in, length);
+
+            DatagramInfo info;
+            info.sender = batch_.sender(i);
+            info.kernel_time = batch_.kernel_time(i);
+            if (info.kernel_time && now > info.kernel_time) // kernel to callback, the time spent in the receive buffer
+                stats_.read_latency.record(now - info.kernel_time);
+
+            deliver(BufferView(block_, data, length), info);
+
+        }
+
+        return received;
+
+    }
+
+    template <typename Handler>
+    void AsioDatagram<Handler>::deliver(const BufferView& data, DatagramInfo& info) {
+
+        if (settings_.detect_gaps && handler_->ParseSequence(data.data(), data.size(), info.sequence)) {
+
+            if (!sequenced_ || info.sequence == expected_) {
+
+                expected_ = info.sequence + 1;
+                sequenced_ = true;
+
+            } else if (info.sequence > expected_) {
+
+                // the ones in between are missing, or are yet to come out of order
+                boost::uint64_t expected = expected_;
+                stats_add(stats_.sequence_gaps, info.sequence - expected);
+                expected_ = info.sequence + 1;
+                handler_->OnGap(expected, info.sequence);
+
+            } else {
+
+                stats_add(stats_.out_of_order, 1); // late or duplicated, delivered all the same
+
+            }
+
+        }
+
+        if (stopped_)
+            return;
+
+        stats_add(stats_.messages_in, 1);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DELIVER, data.size(), data.data());
+
+        handler_->OnDatagram(data, info);
+
+    }
+
+}
+
+#endif	/* ASIODATAGRAM_H */
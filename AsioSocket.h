@@ -8,13 +8,13 @@
 #ifndef ASIOSOCKET_H
 #define	ASIOSOCKET_H
 
-#define CONNECT_TIMEOUT 10 // seconds
-#define READ_TIMEOUT 10 // seconds
-#define READ_WAIT 5 // milliseconds
-#define WRITE_WAIT 5 // milliseconds
-#define BUFF_SIZE 65000 // read buffer size, max tcp messsage size allocated, suggested on stack overflow
-
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
 
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/io_service.hpp>
@@ -24,10 +24,27 @@
 #include <boost/asio/read.hpp>
 
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/make_shared.hpp>
 
-#include "SharedQueue.h"
+#include "LockFreeQueue.h"
+#include "BufferPool.h"
+#include "RingBuffer.h"
+#include "Framing.h"
+#include "HandlerAllocator.h"
+#include "SocketStats.h"
+#include "SharedMemoryStream.h"
+#include "SocketOptions.h"
+#include "SocketSettings.h"
+#include "StreamEndpoint.h"
+#include "TimerWheel.h"
+#include "UringStream.h"
+#include "IoRunner.h"
+#include "ReconnectState.h"
+#include "SessionCapture.h"
+#include "WriteBacklog.h"
 
-#include "ModtLogHandlers.h"
+#include "SocketLog.h"
 
 extern modt_log::LogSink g_Logger;
 
@@ -38,124 +55,1659 @@ using namespace modt_log;
 
 namespace modt_socket {
 
-    typedef boost::function< void() > callback;
-
-    struct WriteMsg { // this is used in the write queue for convenience 
-
-        std::string msg;
+    // The socket of a connection, run on its io_service thread. Events are passed straight to
+    // the Handler, normally a BasicSocketHandler<Derived>, so they are resolved at compile time:
+    //
+    //   void OnConnect(bool connected, const boost::system::error_code& ec);
+    //   void OnReceive(const BufferView& data, const boost::system::error_code& ec);
+    //   void OnReceiveBatch(const BufferView* messages, size_t count);
+    //   void OnWriteComplete(size_t bytes, const boost::system::error_code& ec);
+    //   void OnClose(const boost::system::error_code& ec);
+    //   void OnWritable();
+    //
+    // With a ReconnectPolicy, OnClose is called when an established connection drops and
+    // again when the policy gives up, OnConnect reports the outcome of every attempt.
+    //   FrameStatus ParseFrame(const char* data, size_t size, FrameInfo& frame);
+    //   void ResetFrames();
+    //
+    // The socket is a TCP or a Unix-domain stream socket. Over shared memory the reads and
+    // writes copy to and from the rings instead, and complete through a post, so the actors
+    // and the callbacks run exactly as they do over a socket. Over io_uring they are submitted
+    // to the ring and complete from its completion queue, again into handle_read and handle_write.
 
-    };
-
-    class SocketHandler; // forward declaration....
-
-    class AsioSocket : public boost::enable_shared_from_this<AsioSocket> {
+    template <typename Handler>
+    class AsioSocket : public boost::enable_shared_from_this<AsioSocket<Handler> > {
     public:
 
         AsioSocket(boost::asio::io_service& io_service,
-                SynchronisedQueue<size_t>* read_queue,
-                SynchronisedQueue<WriteMsg>* write_queue,
-                SocketHandler* handler)
+                BoundedQueue<size_t>* read_queue,
+                BoundedQueue<WriteMsg>* write_queue,
+                Handler* handler,
+                SocketMetrics& stats,
+                WriteBacklog& backlog,
+                const SocketSettings& settings = SocketSettings())
         : stopped_(false),
         connection_status_(false),
         connect_deadline_passed(false),
-        write_bytes_(0),
-        read_bytes_(0),
+        write_in_progress_(false),
+        read_in_progress_(false),
+        bytes_to_read(0),
+        settings_(settings),
+        io_service_(io_service),
         socket_(io_service),
-        deadline_(io_service),
-        read_timer_(io_service, boost::posix_time::seconds(1)),
-        write_timer_(io_service, boost::posix_time::seconds(1)),
+        wheel_(boost::asio::use_service<TimerWheel>(io_service)),
+        timeout_due_(NO_TIMEOUT),
+        retry_timer_(io_service),
+        reconnect_(stats_now() ^ reinterpret_cast<size_t> (handler)),
+        reconnect_waiting_(false),
         _read_queue(read_queue),
         _write_queue(write_queue),
-        _handler(handler) {
+        _handler(handler),
+        stats_(stats),
+        backlog_(backlog),
+        connect_started_(0),
+        read_stamp_(0),
+        write_started_(0),
+        write_stamp_(0),
+        event_log_(settings.event_log.get()),
+        capture_(settings.capture.get()),
+        connection_id_(reinterpret_cast<size_t> (handler)),
+        write_count_(0),
+        writer_busy_(false),
+        sendable_(false),
+        write_owned_(false),
+        inline_rest_pending_(false),
+        read_notified_(false),
+        write_notified_(false),
+        read_buffer_(settings.buffer_pool ? settings.buffer_pool : boost::make_shared<BufferPool>(settings.read_buffer_size)),
+        shm_waiting_(false),
+        shm_read_waiting_(false),
+        shm_write_waiting_(false),
+        shm_write_offset_(0),
+        shm_probe_(0),
+        uring_write_size_(0),
+        uring_written_(0) {
 
-            SetCallbacks();
-            MODT_LOG_INFO(g_Logger, "AsioSocket::AsioSocket()", "Created AsioSocket Object [" << this << "]");
+            MODT_SOCKET_LOG_INFO(g_Logger, "AsioSocket::AsioSocket()", "Created AsioSocket Object [" << this << "]");
 
         }
 
         virtual ~AsioSocket() {
-            MODT_LOG_INFO(g_Logger, "AsioSocket::~AsioSocket()", "Destruct AsioSocket Object [" << this << "]");
+            MODT_SOCKET_LOG_INFO(g_Logger, "AsioSocket::~AsioSocket()", "Destruct AsioSocket Object [" << this << "]");
         }
 
-        // synchronous write operation
-        size_t blocking_write(const std::string &msg);
-        void handle_blocking_connect(tcp::endpoint ep, boost::system::error_code& ec);
+        // Called from any thread, sends the message right away with a non blocking send if nothing
+        // is queued or being written. What the kernel does not take is written by the write actor
+        // ahead of anything queued later. False if the message has to go through the write queue
+        bool try_write(const char* data, size_t size);
+        void handle_blocking_connect(StreamEndpoint ep, const SocketOptions& options, boost::system::error_code& ec);
 
         // Called by the user of the AsioSocket class to initiate the connection process.
-        void start(tcp::endpoint ep);
-        void abort();
+        void start(StreamEndpoint ep, const SocketOptions& options);
 
-    private:
+        // the connection was accepted into socket() by an AsioAcceptor, starts the actors on it
+        void start_accepted(const SocketOptions& options);
 
-        // callable within the class, e.g. _onread()
-        callback _onread;
-        callback _onasyncwrite;
-        callback _onconnect;
-        callback _ondisconnect;
+        StreamSocket& socket() {
+            return socket_;
+        }
+        void abort();
 
-        void set_callback(callback onread,
-                callback onasyncwrite,
-                callback onconnect,
-                callback ondisconnect) {
+        // Called from any thread after a message is enqueued to the write queue,
+        // wakes up the write actor on the io_service thread if it is idle
+        void notify_write();
 
-            _onread = onread;
-            _onasyncwrite = onasyncwrite;
-            _onconnect = onconnect;
-            _ondisconnect = ondisconnect;
+        // the socket options as read back once connected, all -1 before that
+        const SocketOptions& applied_options() const {
+            return applied_options_;
         }
 
+        // Called from any thread after a read request is enqueued, serves it
+        // from the buffered data or resumes reading from the socket
+        void notify_read();
+
+    private:
+
         // called to explicitly close the socket and stop the thread, i.e the io_service....
-        void stop();
+        void stop(const boost::system::error_code& ec);
 
         // This function terminates all the actors to shut down the connection. It
         // may be called by the user of the AsioSocket class, or by the class itself in
         // response to graceful termination or an unrecoverable error.
 
-        void SetCallbacks();
+        void start_connect(StreamEndpoint ep);
+
+        void set_endpoints(const StreamEndpoint& ep);
+
+        // the established connection is gone, closes it keeping everything else for the reconnect
+        void drop();
 
-        void start_connect(tcp::endpoint ep);
+        // a drop retries the endpoint that was working, a failed attempt moves on to the next one
+        void schedule_reconnect(const boost::system::error_code& ec, bool next_endpoint);
+
+        void handle_reconnect(const boost::system::error_code& ec);
+
+        // an operation cancelled by a drop has completed, the last one starts a connect that is due
+        void resume_reconnect();
+
+        // the batch of a write that failed or was cancelled by a drop, written bytes is what the old socket took
+        void release_batch(size_t bytes_written);
+
+        void discard_unsent();
+
+        void open_socket(const StreamEndpoint& ep);
+
+        void read_back_options();
 
         void handle_connect(const boost::system::error_code& ec,
-                tcp::endpoint ep);
+                StreamEndpoint ep);
+
+        // the rest of start_accepted, once the shared memory has arrived if there is any
+        void accepted();
+
+        void start_actors();
+
+        // shared memory, the connecting side passes it right after the connect, the accepting
+        // side waits for it before the connection counts as made
+        boost::system::error_code create_shared_memory(const StreamEndpoint& ep);
+
+        void wait_shared_memory();
+
+        void handle_shared_memory(const boost::system::error_code& ec);
+
+        void read_shared_memory(char* dest, size_t size);
+
+        void write_shared_memory();
+
+        // one eventfd wait at a time serves a reader on an empty ring and a writer on a full one
+        void wait_peer();
+
+        void handle_peer_wake(boost::shared_ptr<SharedMemoryStream> shm, const boost::system::error_code& ec);
+
+        // the socket of a shared memory connection only ever reads the end of the connection
+        void watch_peer();
+
+        void handle_peer_closed(boost::shared_ptr<SharedMemoryStream> shm, const boost::system::error_code& ec);
+
+        void close_shared_memory();
+
+        // io_uring, picked up by the first start_actors with IO_BACKEND_URING and kept after that
+        void use_uring();
+
+        static void handle_uring_read(void* socket, int result);
+
+        void write_uring();
+
+        static void handle_uring_write(void* socket, int result);
+
+        // the rest of a batch the ring had no room for, written over the reactor
+        void handle_write_rest(const boost::system::error_code& ec, size_t bytes);
+
+        // the operations in flight complete with operation_aborted, as asio's do on a close
+        void cancel_uring();
+
+        void handle_notify_read();
 
         void start_read();
 
         void handle_read(const boost::system::error_code& ec, size_t bytes);
 
+        void received(size_t bytes);
+
+        void capture(CaptureKind kind, const char* data, size_t size) {
+            if (capture_)
+                capture_->record(connection_id_, kind, data, size);
+        }
+
+        // hands out what the buffered data completes, then the batch if reads are batched
+        void deliver_reads();
+
+        void serve_reads();
+
+        void deliver(const BufferView& data);
+
+        void deliver_batch();
+
+        void handle_notify_write();
+
         void start_write();
 
+        bool next_write(WriteMsg& message);
+
+        void apply_overflow();
+
+        void check_writable();
+
         void handle_write(const boost::system::error_code& ec, size_t bytes);
 
+        // the connect, read idle, write stall and heartbeat deadlines share one timer on the wheel,
+        // due at the earliest of them. It is not moved by every read or write, when it fires the
+        // deadlines are checked against the stamps and it is scheduled again for the next one
+        void schedule_timeouts();
+
+        void cancel_timeouts();
+
+        static void handle_timeout(void* socket);
+
         void check_deadline();
 
+        void send_heartbeat();
+
+        // closes the direct path of try_write, on the io_service thread or once it is stopped
+        void stop_inline_writes();
+
         // member variables  
 
         bool stopped_; // indicates if the service is stopped or not
         bool connection_status_;
         bool connect_deadline_passed;
+        bool write_in_progress_; // an async_write is outstanding, only touched on the io_service thread
+        bool read_in_progress_; // an async_read_some is outstanding, only touched on the io_service thread
+
+        size_t bytes_to_read; // the read request currently being served, 0 if none
+
+        SocketSettings settings_;
+
+        boost::asio::io_service& io_service_; // used to post write notifications to the io thread
 
-        size_t write_bytes_;
-        size_t read_bytes_;
-        size_t bytes_to_read;
+        StreamSocket socket_; // underlying asio socket, TCP or Unix-domain....
 
-        tcp::socket socket_; // underlying asio socket....
+        SocketOptions options_; // as asked for by the connect
+        SocketOptions applied_options_; // as granted by the kernel
 
-        deadline_timer deadline_;
-        deadline_timer read_timer_;
-        deadline_timer write_timer_;
+        static const boost::uint64_t NO_TIMEOUT = ~0ULL;
+
+        TimerWheel& wheel_; // of io_service_, shared by all its connections
+        TimerWheel::Timer timeout_timer_;
+        boost::uint64_t timeout_due_; // when timeout_timer_ fires, NO_TIMEOUT if it is not scheduled
+
+        // reconnect state, see ReconnectPolicy
+        deadline_timer retry_timer_;
+        ReconnectState reconnect_;
+        bool reconnect_waiting_; // the delay is over, the connect waits for the cancelled read and write to complete
 
         // these queues are used to parse the write and read objects
-        SynchronisedQueue<size_t>* _read_queue;
-        SynchronisedQueue<WriteMsg>* _write_queue;
+        BoundedQueue<size_t>* _read_queue;
+        BoundedQueue<WriteMsg>* _write_queue;
+
+        Handler* _handler; // used to invoke callbacks....
+
+        SocketMetrics& stats_; // owned by the handler, kept across connections
+        WriteBacklog& backlog_; // owned by the handler, reset for every connection
+        boost::uint64_t connect_started_;
+        boost::uint64_t read_stamp_; // when the data in the read buffer last grew
+        boost::uint64_t write_started_; // when the write in progress was started
+        boost::atomic<boost::uint64_t> write_stamp_; // when something was last written, also by try_write
 
-        SocketHandler* _handler; // used to invoke callbacks....
+        SocketEventLog* event_log_; // kept alive by settings_
+        SessionCapture* capture_; // as well
+        boost::uint64_t connection_id_;
 
-        char read_buffer_[BUFF_SIZE]; // this buffer gets filled when reading from socket....
+        std::vector<WriteMsg> write_batch_; // the messages currently being written by the write actor
+        std::vector<boost::asio::const_buffer> write_buffers_; // gather list over write_batch_
+        size_t write_count_; // messages of write_batch_ in the current write
+        WriteOverflow overflow_; // written before the write queue
 
-        boost::system::error_code error_code_;
+        // the socket's send side is used by the write actor or by try_write on the caller's thread,
+        // whoever holds writer_busy_. The actor keeps it from the first write of a run until the
+        // queue is empty, write_owned_ says it does. inline_rest_ is only touched by the holder
+        boost::atomic<bool> writer_busy_;
+        boost::atomic<bool> sendable_; // connected and the actors running
+        bool write_owned_;
+        WriteMsg inline_rest_; // the part of a try_write the kernel did not take
+        bool inline_rest_pending_;
+
+        // set while a notification is posted to the io_service thread, so producers post at most one
+        boost::atomic<bool> read_notified_;
+        boost::atomic<bool> write_notified_;
+        HandlerMemory read_notify_memory_;
+        HandlerMemory write_notify_memory_;
+
+        RingBuffer read_buffer_; // this buffer gets filled when reading from socket....
+        std::vector<BufferView> read_batch_; // views collected for OnReceiveBatch, READ_PER_BATCH only
+
+        // the rings of a local connection upgraded to shared memory, NULL otherwise. Handlers
+        // hold on to the one they were started for and are stale once it has been replaced
+        boost::shared_ptr<SharedMemoryStream> shm_;
+        bool shm_waiting_; // an eventfd wait is outstanding
+        bool shm_read_waiting_; // the read in progress waits for the peer to write
+        bool shm_write_waiting_; // the write in progress waits for room in the peer's ring
+        size_t shm_write_offset_; // bytes of the current batch copied into the ring
+        char shm_probe_; // the byte the socket of a shared memory connection reads
+
+        // open when the reads and writes go through io_uring
+        UringStream uring_;
+        size_t uring_write_size_; // bytes of the current batch
+        size_t uring_written_; // bytes of the current batch sent so far
 
     };
 
+    template <typename Handler>
+    void AsioSocket<Handler>::start(StreamEndpoint ep, const SocketOptions& options) {
+
+        options_ = options;
+        set_endpoints(ep);
+
+        // Start the connect actor.
+        start_connect(ep);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::start_accepted(const SocketOptions& options) {
+
+        if (stopped_)
+            return;
+
+        options_ = options;
+        apply_socket_options(socket_, options_);
+        read_back_options();
+
+        boost::system::error_code error;
+        if (settings_.shared_memory.enabled && is_local(socket_.local_endpoint(error)) && !error) {
+            wait_shared_memory();
+            return;
+        }
+
+        accepted();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::accepted() {
+
+        connection_status_ = true;
+        connect_deadline_passed = true;
+
+        stats_add(stats_.connects, 1);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT, 0, NULL);
+        capture(CAPTURE_CONNECT, NULL, 0);
+
+        _handler->OnConnect(connection_status_, boost::system::error_code());
+
+        start_actors();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::stop(const boost::system::error_code& ec) {
+
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DISCONNECT, 0, NULL);
+        capture(CAPTURE_CLOSE, NULL, 0);
+
+        // accepted connections have no endpoints to go back to
+        if (settings_.reconnect.enabled && connection_status_ && !reconnect_.empty()) {
+
+            // the socket object stays, only the connection is replaced
+            drop();
+            _handler->OnClose(ec);
+            schedule_reconnect(ec, false);
+            return;
+
+        }
+
+        abort();
+        _handler->OnClose(ec);
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::stop()", "Stopped the socket object and deadline canceled");
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::abort() {
+
+        if (connection_status_ && !stopped_)
+            capture(CAPTURE_CLOSE, NULL, 0);
+
+        stopped_ = true;
+        stop_inline_writes();
+        //socket_.cancel();
+        cancel_uring();
+        uring_.release_slot();
+        socket_.close();
+        close_shared_memory();
+        cancel_timeouts();
+        retry_timer_.cancel();
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::abort()", "Aborted the socket object and deadline canceled");
+
+    }
+
+    template <typename Handler>
+    bool AsioSocket<Handler>::try_write(const char* data, size_t size) {
+
+        // anything queued or in flight goes first, so does the write actor
+        if (!sendable_.load(boost::memory_order_acquire) || backlog_.messages.load(boost::memory_order_relaxed) != 0)
+            return false;
+
+        if (writer_busy_.exchange(true))
+            return false;
+
+        // abort() and drop() take writer_busy_ before closing the socket, so it stays open until released
+        if (!sendable_.load() || backlog_.messages.load() != 0) {
+            writer_busy_.store(false);
+            return false;
+        }
+
+        MODT_SOCKET_LOG_TRACE(g_Logger, "AsioSocket::try_write()", "Sending message : " << size << " bytes");
+
+        boost::uint64_t started = stats_now();
+        int flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+        flags |= MSG_NOSIGNAL;
+#endif
+        ssize_t sent;
+        if (shm_) {
+            boost::system::error_code ec;
+            sent = static_cast<ssize_t> (shm_->write_some(data, size, ec));
+            if (ec) {
+                sent = -1;
+                errno = EPROTO;
+            }
+        } else {
+            sent = ::send(socket_.native_handle(), data, size, flags);
+        }
+        stats_add(stats_.write_calls, 1);
+
+        if (sent < 0) {
+
+            sent = 0;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                // the write actor runs into the same error and closes the connection
+                MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::try_write()", "Send error : " << errno);
+            }
+
+        }
+
+        stats_add(stats_.bytes_out, sent);
+        write_stamp_.store(started, boost::memory_order_relaxed);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_INLINE_WRITE, sent, data);
+        if (sent)
+            capture(CAPTURE_OUT, data, sent);
+
+        if (static_cast<size_t> (sent) == size) {
+
+            stats_add(stats_.messages_out, 1);
+            stats_.write_latency.record(stats_now() - started);
+
+        } else {
+
+            // the rest is handed to the write actor, the message is counted once that is written
+            inline_rest_.msg.assign(data + sent, size - sent);
+            inline_rest_.enqueued = started;
+            inline_rest_pending_ = true;
+            backlog_.add(size - sent);
+
+        }
+
+        writer_busy_.store(false);
+
+        // the write actor may have found writer_busy_ taken, with something to write
+        if (backlog_.messages.load() != 0)
+            notify_write();
+
+        return true;
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::stop_inline_writes() {
+
+        sendable_.store(false);
+
+        // waits out a try_write in progress, the write actor keeps writer_busy_ until the actors start again
+        if (!write_owned_) {
+            while (writer_busy_.exchange(true))
+                boost::this_thread::yield();
+            write_owned_ = true;
+        }
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::start_connect(StreamEndpoint ep) {
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::start_connect()", "Attempting connection to " << endpoint_name(ep));
+
+        connect_started_ = stats_now();
+        open_socket(ep);
+
+        // Set a deadline for the connect operation.
+        schedule_timeouts();
+
+        // Start the asynchronous connect operation.
+        socket_.async_connect(ep,
+                boost::bind(&AsioSocket<Handler>::handle_connect,
+                this->shared_from_this(), _1, ep));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::open_socket(const StreamEndpoint& ep) {
+
+        // the connect would open the socket itself, but the buffer sizes have to be set
+        // before the handshake to have an effect on the window scaling
+        boost::system::error_code error;
+        socket_.open(ep.protocol(), error);
+        if (error) {
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::open_socket()", "Could not open the socket : " << error.message());
+            return; // the connect reports it
+        }
+
+        apply_socket_options(socket_, options_);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::read_back_options() {
+
+        applied_options_ = read_socket_options(socket_);
+        MODT_SOCKET_LOG_INFO(g_Logger, "AsioSocket::read_back_options()", "Socket options in effect : " << applied_options_);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_connect(const boost::system::error_code& ec,
+            StreamEndpoint ep) {
+
+        if (stopped_)
+            return;
+
+        // a local connection is only made once the shared memory is handed over
+        boost::system::error_code error = ec;
+        if (!error && socket_.is_open())
+            error = create_shared_memory(ep);
+
+        // The async_connect() function automatically opens the socket at the start
+        // of the asynchronous operation. If the socket is closed at this time then
+        // the timeout handler must have run first...
+        if (!socket_.is_open()) {
+
+            connection_status_ = false;
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::handle_connect()", "Connection timed out....");
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT_FAILED, 0, NULL);
+            _handler->OnConnect(connection_status_, boost::asio::error::timed_out);
+            schedule_reconnect(boost::asio::error::timed_out, true);
+
+        }// Check if the connect operation failed before the deadline expired.
+        else if (error) {
+
+            connection_status_ = false;
+
+            // We need to close the socket used in the previous connection attempt
+            // before starting a new one.
+            socket_.close();
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::handle_connect()", "Connection error....");
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT_FAILED, 0, NULL);
+
+            _handler->OnConnect(connection_status_, error);
+            schedule_reconnect(error, true);
+
+        }// Otherwise we have successfully established a connection.
+        else {
+
+            connection_status_ = true;
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::handle_connect()", "Connection successful....");
+
+            read_back_options();
+            reconnect_.connected();
+
+            stats_add(stats_.connects, 1);
+            stats_.connect_time_ns.store(stats_now() - connect_started_, boost::memory_order_relaxed);
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT, 0, NULL);
+            capture(CAPTURE_CONNECT, NULL, 0);
+
+            _handler->OnConnect(connection_status_, ec);
+            connect_deadline_passed = true;
+
+            start_actors();
+
+        }
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::start_actors() {
+
+        // nothing the frame parser kept from an earlier connection applies to this one
+        _handler->ResetFrames();
+
+        // the idle clocks start with the connection
+        read_stamp_ = stats_now();
+        write_stamp_.store(read_stamp_, boost::memory_order_relaxed);
+        schedule_timeouts();
+
+        if (shm_)
+            watch_peer();
+        else if (settings_.io_backend == IO_BACKEND_URING && !uring_.is_open())
+            use_uring();
+
+        // Start the input actor.....
+        // This will read whatever arrives on the socket and serve it via OnReceive
+        start_read();
+
+        // Start the write actor.....
+        // This will write the string requested via the write queue and call OnWriteComplete
+        sendable_.store(true);
+        start_write();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::notify_read() {
+
+        // one notification in flight is enough, it serves every request queued before it runs
+        if (!read_notified_.exchange(true, boost::memory_order_acq_rel))
+            io_service_.post(make_custom_alloc_handler(read_notify_memory_,
+                boost::bind(&AsioSocket<Handler>::handle_notify_read, this->shared_from_this())));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_notify_read() {
+
+        read_notified_.store(false, boost::memory_order_release);
+
+        if (stopped_ || !connection_status_)
+            return;
+
+        // the requested bytes may already be sitting in the buffer....
+        deliver_reads();
+
+        if (!stopped_ && !read_in_progress_)
+            start_read();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::start_read() {
+
+        if (stopped_ || !connection_status_)
+            return;
+
+        char* dest = read_buffer_.prepare();
+        if (read_buffer_.space() == 0) {
+            // the buffer is full of data nobody asked for yet, reading resumes once a
+            // read request consumes some of it
+            read_in_progress_ = false;
+            return;
+        }
+
+        // Keep one read outstanding at all times, whatever arrives is appended to the buffer
+        // and handed out either as it comes (streaming) or as requested via the read queue
+        read_in_progress_ = true;
+        stats_add(stats_.read_calls, 1);
+
+        if (shm_) {
+            read_shared_memory(dest, read_buffer_.space());
+            return;
+        }
+
+        // a full submission queue leaves this read to the reactor
+        if (uring_.is_open() && uring_.receive(socket_.native_handle(), read_buffer_.block(), dest, read_buffer_.space(),
+                &AsioSocket<Handler>::handle_uring_read, this, this->shared_from_this()))
+            return;
+
+        socket_.async_read_some(boost::asio::buffer(dest, read_buffer_.space()),
+                boost::bind(&AsioSocket<Handler>::handle_read, this->shared_from_this(), _1, _2));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_read(const boost::system::error_code& ec, size_t bytes) {
+
+        read_in_progress_ = false;
+
+        if (stopped_)
+            return;
+
+        if (!connection_status_) { // cancelled by a drop
+            resume_reconnect();
+            return;
+        }
+
+        if (ec) {
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::handle_read()", "Read Error : " << ec.message());
+            stop(ec);
+            return;
+        } // OnReceive will not be called in this instance....
+
+        received(bytes);
+        deliver_reads();
+
+        // start reading again....
+        start_read();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::received(size_t bytes) {
+
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_RECEIVE, bytes, read_buffer_.data() + read_buffer_.size());
+        capture(CAPTURE_IN, read_buffer_.data() + read_buffer_.size(), bytes);
+        read_buffer_.commit(bytes);
+        read_stamp_ = stats_now();
+
+        if (options_.quick_ack > 0 && !shm_) // the kernel falls back to delayed acks after a while
+            apply_quick_ack(socket_);
+        stats_add(stats_.bytes_in, bytes);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::deliver_reads() {
+
+        serve_reads();
+        deliver_batch();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::serve_reads() {
+
+        if (settings_.read_mode == READ_STREAMING) {
+
+            if (read_buffer_.empty())
+                return;
+
+            bytes_to_read = read_buffer_.size();
+            deliver(read_buffer_.view(bytes_to_read)); //make the callback to notify user via the socket handler...
+            read_buffer_.consume(bytes_to_read);
+            bytes_to_read = 0;
+            return;
+
+        }
+
+        if (settings_.read_mode == READ_FRAMED) {
+
+            // hand out every complete frame in the buffer, a partial frame stays for the next read
+            while (!stopped_ && !read_buffer_.empty()) {
+
+                FrameInfo frame;
+                FrameStatus status = _handler->ParseFrame(read_buffer_.data(), read_buffer_.size(), frame);
+
+                if (status == FRAME_INCOMPLETE) {
+
+                    if (frame.length <= read_buffer_.capacity() && !read_buffer_.full())
+                        return; // wait for more data from the socket
+
+                    MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::serve_reads()", "Frame of " << frame.length << " bytes exceeds the receive buffer size...");
+                    deliver_batch(); // the frames before it still go out ahead of OnClose
+                    stop(boost::asio::error::message_size);
+                    return;
+
+                }
+
+                if (status == FRAME_ERROR) {
+
+                    MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::serve_reads()", "Invalid frame received...");
+                    deliver_batch();
+                    stop(boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+                    return;
+
+                }
+
+                deliver(read_buffer_.view(frame.length).sub(frame.payload_offset, frame.payload_size));
+                read_buffer_.consume(frame.length);
+
+            }
+            return;
+
+        }
+
+        // serve as many queued read requests as the buffered data allows
+        while (!stopped_) {
+
+            if (bytes_to_read == 0) {
+
+                if (!_read_queue->try_Dequeue(bytes_to_read) || bytes_to_read == 0)
+                    return;
+
+                MODT_SOCKET_LOG_TRACE(g_Logger, "AsioSocket::serve_reads()", "Read request : " << bytes_to_read << " bytes");
+                MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_READ_REQUEST, bytes_to_read, NULL);
+                if (bytes_to_read > read_buffer_.capacity()) {
+
+                    bytes_to_read = read_buffer_.capacity();
+                    MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::serve_reads()", "Attempt to read more than maximum buffer size...");
+
+                }
+
+            }
+
+            if (read_buffer_.size() < bytes_to_read)
+                return; // wait for more data from the socket
+
+            deliver(read_buffer_.view(bytes_to_read)); //make the callback to notify user via the socket handler...
+            read_buffer_.consume(bytes_to_read);
+            bytes_to_read = 0;
+
+        }
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::deliver(const BufferView& data) {
+
+        // data sitting in the buffer waiting for a read request counts towards the latency
+        stats_add(stats_.messages_in, 1);
+        stats_.read_latency.record(stats_now() - read_stamp_);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DELIVER, data.size(), data.data());
+
+        if (settings_.read_notify == READ_PER_BATCH) {
+            read_batch_.push_back(data); // the consumed bytes are not overwritten while a view holds them
+            return;
+        }
+
+        _handler->OnReceive(data, boost::system::error_code());
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::deliver_batch() {
+
+        if (read_batch_.empty())
+            return;
+
+        _handler->OnReceiveBatch(&read_batch_[0], read_batch_.size());
+
+        // the views go, so the read buffer can reuse its block, the vector keeps its capacity
+        read_batch_.clear();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::notify_write() {
+
+        // hop on to the io_service thread, the write actor state is only touched from there....
+        // one notification in flight is enough, the write actor drains everything queued before it runs
+        if (!write_notified_.exchange(true, boost::memory_order_acq_rel))
+            io_service_.post(make_custom_alloc_handler(write_notify_memory_,
+                boost::bind(&AsioSocket<Handler>::handle_notify_write, this->shared_from_this())));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_notify_write() {
+
+        write_notified_.store(false, boost::memory_order_release);
+
+        if (stopped_ || !connection_status_)
+            return;
+
+        // a producer may have hit the high watermark just as the backlog drained, or the
+        // overflow policy has to thin out the queue behind a write that is not completing
+        if (overflow_queues(settings_.write_overflow) && backlog_.blocked.load(boost::memory_order_acquire))
+            apply_overflow();
+        else
+            check_writable();
+
+        // if a write is already in flight handle_write will pick up the new message,
+        // if the connection is not up yet the connect handler will start the write actor
+        if (stopped_ || write_in_progress_)
+            return;
+
+        start_write();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::start_write() {
+
+        if (stopped_ || !connection_status_)
+            return;
+
+        if (!write_owned_) {
+
+            // Write() is sending on the caller's thread, try again once it is done
+            if (writer_busy_.exchange(true)) {
+                write_in_progress_ = false;
+                notify_write();
+                return;
+            }
+            write_owned_ = true;
+
+        }
+
+        if (overflow_queues(settings_.write_overflow) && backlog_.blocked.load(boost::memory_order_acquire))
+            apply_overflow();
+
+        // drain whatever is queued right now, up to the batch limits, into a single gathered write.
+        // the messages are kept as members, the buffers have to outlive the async_write
+        size_t batch_bytes = 0;
+        write_count_ = 0;
+        write_buffers_.clear();
+
+        while (write_count_ == 0 || (write_count_ < settings_.write_batch_messages && batch_bytes < settings_.write_batch_bytes)) {
+
+            if (write_count_ == write_batch_.size())
+                write_batch_.resize(write_count_ + 1); // grows up to the message limit once, the slots are reused after that
+
+            WriteMsg& message = write_batch_[write_count_];
+            if (write_count_ == 0 && inline_rest_pending_) { // what Write() could not send goes first
+                message = boost::move(inline_rest_);
+                inline_rest_pending_ = false;
+            } else if (!next_write(message))
+                break;
+
+            MODT_SOCKET_LOG_TRACE(g_Logger, "AsioSocket::start_write()", "Sending message : " << message.size() << " bytes");
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_WRITE, message.size(), message.data());
+            batch_bytes += message.size();
+            ++write_count_;
+
+        }
+
+        // the gather list is built once the batch is complete, growing write_batch_ moves the messages
+        for (size_t i = 0; i < write_count_; ++i)
+            write_buffers_.push_back(boost::asio::buffer(write_batch_[i].data(), write_batch_[i].size()));
+
+        if (write_count_ > 0) {
+
+            // Start an asynchronous operation to send the messages to the server...        
+            write_in_progress_ = true;
+            write_started_ = stats_now();
+            stats_add(stats_.write_calls, 1);
+
+            // the only deadline that comes closer on its own, the others only ever move out
+            if (settings_.write_stall_timeout_ms && write_started_ + settings_.write_stall_timeout_ms * 1000000ULL < timeout_due_)
+                schedule_timeouts();
+
+            if (shm_) {
+                shm_write_offset_ = 0;
+                write_shared_memory();
+            } else if (uring_.is_open()) {
+                uring_write_size_ = batch_bytes;
+                uring_written_ = 0;
+                write_uring();
+            } else {
+                boost::asio::async_write(socket_, GatherBuffers(write_buffers_),
+                        boost::bind(&AsioSocket<Handler>::handle_write, this->shared_from_this(), _1, _2));
+            }
+
+        } else { // nothing to write at this time, the write actor sleeps until notify_write() is called
+
+            write_in_progress_ = false;
+            write_owned_ = false;
+            writer_busy_.store(false); // Write() may send directly again
+
+        }
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_write(const boost::system::error_code& ec, size_t bytes) {
+
+        if (stopped_)
+            return;
+
+        write_in_progress_ = false;
+        if (!connection_status_) { // cancelled by a drop, the reconnect decides what becomes of the batch
+            release_batch(bytes);
+            resume_reconnect();
+            return;
+        }
+
+        if (ec) {
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::handle_write()", "Write Error : " << ec.message());
+            if (settings_.reconnect.enabled)
+                release_batch(bytes);
+            stop(ec);
+            return;
+        } // OnWriteComplete will not be called in this instance....
+
+        stats_add(stats_.bytes_out, bytes);
+        stats_add(stats_.messages_out, write_count_);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_WRITE_DONE, bytes, NULL);
+        backlog_.remove(bytes, write_count_);
+
+        if (capture_) {
+            for (size_t i = 0; i < write_count_; ++i)
+                capture(CAPTURE_OUT, write_batch_[i].data(), write_batch_[i].size());
+        }
+
+        boost::uint64_t written = stats_now();
+        write_stamp_.store(written, boost::memory_order_relaxed);
+        for (size_t i = 0; i < write_count_; ++i)
+            stats_.write_latency.record(written - write_batch_[i].enqueued);
+
+        if (settings_.write_notify == NOTIFY_PER_MESSAGE) {
+
+            for (size_t i = 0; i < write_count_ && !stopped_; ++i)
+                _handler->OnWriteComplete(write_batch_[i].size(), ec); // make the callback for each message of the batch
+
+        } else {
+
+            _handler->OnWriteComplete(bytes, ec); // make the callback once for the whole batch
+
+        }
+
+        // hand the pooled buffers back, the strings keep their capacity for the next batch
+        for (size_t i = 0; i < write_count_; ++i)
+            write_batch_[i].buffer = BufferView();
+
+        check_writable();
+
+        start_write();
+
+    }
+
+    template <typename Handler>
+    bool AsioSocket<Handler>::next_write(WriteMsg& message) {
+
+        return overflow_.next(*_write_queue, message);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::apply_overflow() {
+
+        size_t dropped_bytes = 0;
+        size_t dropped = overflow_.apply(settings_, *_write_queue, backlog_, dropped_bytes);
+
+        if (dropped) {
+            stats_add(stats_.messages_dropped, dropped);
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::apply_overflow()", "Discarded " << dropped << " queued messages, " << dropped_bytes << " bytes");
+        }
+
+        check_writable();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::check_writable() {
+
+        if (stopped_ || !backlog_.blocked.load(boost::memory_order_acquire) || !backlog_.below_low(settings_))
+            return;
+
+        if (backlog_.blocked.exchange(false, boost::memory_order_acq_rel))
+            _handler->OnWritable();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::set_endpoints(const StreamEndpoint& ep) {
+
+        reconnect_.reset(ep, settings_.reconnect);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::drop() {
+
+        connection_status_ = false;
+        connect_deadline_passed = false;
+        stop_inline_writes();
+
+        // the outstanding read and write complete with operation_aborted and find the connection gone
+        cancel_uring();
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        cancel_timeouts(); // the reconnect sets the connect timeout
+
+        // the rings go with the connection, the handlers waiting on them never run
+        if (shm_write_waiting_) {
+            shm_write_waiting_ = false;
+            write_in_progress_ = false;
+            release_batch(shm_write_offset_);
+        }
+        close_shared_memory();
+
+        // a partial message from the old stream means nothing on the new one, the read
+        // requests stay queued and are served from the new connection
+        read_buffer_.clear();
+        _handler->ResetFrames();
+
+        // a batch still being written is dealt with by handle_write
+        if (!settings_.reconnect.replay_unsent)
+            discard_unsent();
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::drop()", "Connection dropped, keeping the socket object for a reconnect");
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::schedule_reconnect(const boost::system::error_code& ec, bool next_endpoint) {
+
+        if (stopped_ || !settings_.reconnect.enabled)
+            return;
+
+        if (next_endpoint)
+            reconnect_.next_endpoint();
+
+        if (reconnect_.exhausted(settings_.reconnect)) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::schedule_reconnect()", "Giving up after " << reconnect_.attempts() << " reconnect attempts : " << ec.message());
+            abort();
+            _handler->OnClose(ec);
+            return;
+
+        }
+
+        size_t delay = reconnect_.next_delay_ms(settings_.reconnect);
+        stats_add(stats_.reconnects, 1);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_RECONNECT, reconnect_.attempts(), NULL);
+        MODT_SOCKET_LOG_INFO(g_Logger, "AsioSocket::schedule_reconnect()", "Reconnect attempt " << reconnect_.attempts() << " in " << delay << " ms : " << ec.message());
+
+        retry_timer_.expires_from_now(boost::posix_time::milliseconds(delay));
+        retry_timer_.async_wait(boost::bind(&AsioSocket<Handler>::handle_reconnect, this->shared_from_this(), _1));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_reconnect(const boost::system::error_code& ec) {
+
+        if (stopped_ || ec == boost::asio::error::operation_aborted)
+            return;
+
+        // the operations cancelled by the drop have not run yet, they go first
+        reconnect_waiting_ = true;
+        resume_reconnect();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::resume_reconnect() {
+
+        if (!reconnect_waiting_ || read_in_progress_ || write_in_progress_)
+            return;
+
+        reconnect_waiting_ = false;
+        start_connect(reconnect_.endpoint());
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::release_batch(size_t bytes_written) {
+
+        // messages the old socket took in full are done with, whether the peer got them is unknown
+        size_t written = 0;
+        size_t written_bytes = 0;
+        while (written < write_count_ && written_bytes + write_batch_[written].size() <= bytes_written)
+            written_bytes += write_batch_[written++].size();
+
+        stats_add(stats_.bytes_out, written_bytes);
+        stats_add(stats_.messages_out, written);
+        backlog_.remove(written_bytes, written);
+
+        size_t unsent = 0;
+        size_t unsent_bytes = 0;
+        for (size_t i = write_count_; i > written; --i) {
+
+            WriteMsg& message = write_batch_[i - 1];
+            if (settings_.reconnect.replay_unsent) {
+
+                overflow_.push_front(message); // written before anything still queued
+
+            } else {
+
+                unsent_bytes += message.size();
+                ++unsent;
+
+            }
+            message.buffer = BufferView();
+
+        }
+
+        write_count_ = 0;
+
+        if (unsent) {
+            backlog_.remove(unsent_bytes, unsent);
+            stats_add(stats_.messages_dropped, unsent);
+        }
+
+        check_writable();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::discard_unsent() {
+
+        size_t dropped = 0;
+        size_t dropped_bytes = 0;
+
+        if (inline_rest_pending_) {
+            dropped_bytes += inline_rest_.size();
+            ++dropped;
+            inline_rest_pending_ = false;
+        }
+
+        WriteMsg message;
+        while (next_write(message)) {
+            dropped_bytes += message.size();
+            ++dropped;
+        }
+
+        if (dropped) {
+            backlog_.remove(dropped_bytes, dropped);
+            stats_add(stats_.messages_dropped, dropped);
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::discard_unsent()", "Discarded " << dropped << " unsent messages, " << dropped_bytes << " bytes");
+        }
+
+        check_writable();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::schedule_timeouts() {
+
+        const boost::uint64_t ms = 1000000ULL;
+        boost::uint64_t due = NO_TIMEOUT;
+
+        if (!connect_deadline_passed) {
+
+            // connecting, or waiting for the next reconnect attempt with the socket closed
+            if (socket_.is_open() && settings_.connect_timeout_ms)
+                due = connect_started_ + settings_.connect_timeout_ms * ms;
+
+        } else if (connection_status_) {
+
+            if (settings_.read_idle_timeout_ms)
+                due = std::min(due, read_stamp_ + settings_.read_idle_timeout_ms * ms);
+            if (settings_.write_stall_timeout_ms && write_in_progress_)
+                due = std::min(due, write_started_ + settings_.write_stall_timeout_ms * ms);
+            if (settings_.heartbeat_interval_ms && !settings_.heartbeat_message.empty())
+                due = std::min(due, write_stamp_.load(boost::memory_order_relaxed) + settings_.heartbeat_interval_ms * ms);
+
+        }
+
+        if (due == NO_TIMEOUT) {
+            cancel_timeouts();
+            return;
+        }
+
+        timeout_due_ = due;
+        wheel_.schedule(timeout_timer_, due, &AsioSocket<Handler>::handle_timeout, this, this->shared_from_this());
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::cancel_timeouts() {
+
+        timeout_due_ = NO_TIMEOUT;
+        wheel_.cancel(timeout_timer_);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_timeout(void* socket) {
+
+        static_cast<AsioSocket<Handler>*> (socket)->check_deadline();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::check_deadline() {
+
+        timeout_due_ = NO_TIMEOUT;
+
+        if (stopped_)
+            return;
+
+        const boost::uint64_t ms = 1000000ULL;
+        boost::uint64_t now = stats_now();
+
+        // Check whether a deadline has passed. The stamps are compared against the current
+        // time since reads and writes have moved them on without rescheduling the timer.
+        if (!connect_deadline_passed) {
+
+            if (socket_.is_open() && settings_.connect_timeout_ms && now >= connect_started_ + settings_.connect_timeout_ms * ms) {
+
+                MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::check_deadline()", "Connect time out...");
+                stats_add(stats_.timeouts, 1);
+                MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_TIMEOUT, 0, NULL);
+
+                // handle_connect finds the socket closed, reports it and schedules the next attempt if any
+                socket_.close();
+                return;
+
+            }
+
+        } else if (connection_status_) {
+
+            if (settings_.read_idle_timeout_ms && now >= read_stamp_ + settings_.read_idle_timeout_ms * ms) {
+
+                MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::check_deadline()", "Read time out...");
+                stats_add(stats_.timeouts, 1);
+                MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_TIMEOUT, 0, NULL);
+                stop(boost::asio::error::timed_out);
+                return;
+
+            }
+
+            if (settings_.write_stall_timeout_ms && write_in_progress_ && now >= write_started_ + settings_.write_stall_timeout_ms * ms) {
+
+                MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::check_deadline()", "Write stalled...");
+                stats_add(stats_.timeouts, 1);
+                MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_TIMEOUT, 0, NULL);
+                stop(boost::asio::error::timed_out);
+                return;
+
+            }
+
+            if (settings_.heartbeat_interval_ms && now >= write_stamp_.load(boost::memory_order_relaxed) + settings_.heartbeat_interval_ms * ms)
+                send_heartbeat();
+
+        }
+
+        // Put the actor back to sleep until the next deadline.
+        schedule_timeouts();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::send_heartbeat() {
+
+        boost::uint64_t now = stats_now();
+        write_stamp_.store(now, boost::memory_order_relaxed); // one per interval, even if it does not get through
+
+        // anything queued or being written goes out soon enough, and a stalled write is not helped by piling up more
+        if (settings_.heartbeat_message.empty() || backlog_.messages.load(boost::memory_order_acquire) != 0)
+            return;
+
+        WriteMsg message;
+        message.msg = settings_.heartbeat_message;
+        message.enqueued = now;
+        backlog_.add(message.size());
+        overflow_.push_back(message); // written ahead of the queue, which is empty
+
+        stats_add(stats_.heartbeats, 1);
+        MODT_SOCKET_LOG_TRACE(g_Logger, "AsioSocket::send_heartbeat()", "Heartbeat queued : " << settings_.heartbeat_message.size() << " bytes");
+
+        if (!write_in_progress_)
+            start_write();
+
+    }
+
+    template <typename Handler>
+    boost::system::error_code AsioSocket<Handler>::create_shared_memory(const StreamEndpoint& ep) {
+
+        if (!settings_.shared_memory.enabled || !is_local(ep))
+            return boost::system::error_code();
+
+        boost::shared_ptr<SharedMemoryStream> shm(new SharedMemoryStream(io_service_));
+        boost::system::error_code error = shm->create(socket_.native_handle(), settings_.shared_memory.ring_size);
+        if (!error) {
+            shm_ = shm;
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::create_shared_memory()", "Passed the shared memory to " << endpoint_name(ep));
+        }
+        return error;
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::wait_shared_memory() {
+
+        // a peek completes as soon as the message is there, the descriptors come with the recvmsg
+        socket_.async_receive(boost::asio::buffer(&shm_probe_, 1), boost::asio::socket_base::message_peek,
+                boost::bind(&AsioSocket<Handler>::handle_shared_memory, this->shared_from_this(), _1));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_shared_memory(const boost::system::error_code& ec) {
+
+        if (stopped_)
+            return;
+
+        boost::system::error_code error = ec;
+        boost::shared_ptr<SharedMemoryStream> shm(new SharedMemoryStream(io_service_));
+        if (!error)
+            error = shm->accept(socket_.native_handle());
+
+        if (error == boost::asio::error::would_block) {
+            wait_shared_memory();
+            return;
+        }
+
+        if (error) {
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::handle_shared_memory()", "No shared memory from the peer : " << error.message());
+            stop(error);
+            return;
+        }
+
+        shm_ = shm;
+        accepted();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::read_shared_memory(char* dest, size_t size) {
+
+        boost::system::error_code ec;
+        size_t bytes = shm_->read(dest, size, settings_.shared_memory.spin_us, shm_read_waiting_, ec);
+        if (shm_read_waiting_) {
+            wait_peer();
+            return;
+        }
+
+        // completes like an async_read_some, a direct call would recurse for as long as data keeps coming
+        io_service_.post(boost::bind(&AsioSocket<Handler>::handle_read, this->shared_from_this(), ec, bytes));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::write_shared_memory() {
+
+        // carries on from shm_write_offset_, after a wait for room in the ring
+        boost::system::error_code ec;
+        shm_write_offset_ = shm_->write(write_buffers_, shm_write_offset_, shm_write_waiting_, ec);
+        if (shm_write_waiting_) {
+            wait_peer();
+            return;
+        }
+
+        io_service_.post(boost::bind(&AsioSocket<Handler>::handle_write, this->shared_from_this(), ec, shm_write_offset_));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::wait_peer() {
+
+        if (shm_waiting_)
+            return;
+
+        shm_waiting_ = true;
+        shm_->async_wait(boost::bind(&AsioSocket<Handler>::handle_peer_wake, this->shared_from_this(), shm_, _1));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_peer_wake(boost::shared_ptr<SharedMemoryStream> shm, const boost::system::error_code& ec) {
+
+        if (stopped_ || shm != shm_) // closed, or the connection it belonged to is gone
+            return;
+
+        shm_waiting_ = false;
+
+        if (ec) {
+            MODT_SOCKET_LOG_ERROR(g_Logger, "AsioSocket::handle_peer_wake()", "Shared memory wait error : " << ec.message());
+            stop(ec);
+            return;
+        }
+
+        // either side may have been woken, or neither by a stray wakeup, each simply tries again
+        bool reading = shm_read_waiting_;
+        bool writing = shm_write_waiting_;
+        shm_read_waiting_ = false;
+        shm_write_waiting_ = false;
+
+        if (writing)
+            write_shared_memory();
+
+        if (reading) {
+            read_in_progress_ = false;
+            start_read();
+        }
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::watch_peer() {
+
+        socket_.async_receive(boost::asio::buffer(&shm_probe_, 1),
+                boost::bind(&AsioSocket<Handler>::handle_peer_closed, this->shared_from_this(), shm_, _1));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_peer_closed(boost::shared_ptr<SharedMemoryStream> shm, const boost::system::error_code& ec) {
+
+        if (stopped_ || shm != shm_)
+            return;
+
+        if (read_in_progress_ && !shm_read_waiting_) {
+            // a read from the ring is about to complete, it goes first
+            io_service_.post(boost::bind(&AsioSocket<Handler>::handle_peer_closed, this->shared_from_this(), shm, ec));
+            return;
+        }
+
+        // what the peer wrote before it went is still in the ring
+        while (!stopped_ && connection_status_ && shm == shm_) {
+
+            char* dest = read_buffer_.prepare();
+            boost::system::error_code ignored; // a broken ring ends the drain, the connection is closed below anyway
+            size_t bytes = read_buffer_.space() ? shm_->read_some(dest, read_buffer_.space(), ignored) : 0;
+            if (bytes == 0)
+                break;
+            received(bytes);
+            deliver_reads();
+
+        }
+
+        if (stopped_ || shm != shm_)
+            return;
+
+        boost::system::error_code error = ec ? ec : boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::handle_peer_closed()", "Shared memory peer gone : " << error.message());
+        stop(error);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::close_shared_memory() {
+
+        if (!shm_)
+            return;
+
+        if (shm_read_waiting_)
+            read_in_progress_ = false;
+        shm_read_waiting_ = false;
+        shm_write_waiting_ = false;
+        shm_waiting_ = false;
+
+        shm_->close();
+        shm_.reset();
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::use_uring() {
+
+        uring_.open(io_service_); // a kernel without io_uring is logged by the service, the connection stays on the reactor
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_uring_read(void* socket, int result) {
+
+        AsioSocket<Handler>* self = static_cast<AsioSocket<Handler>*> (socket);
+        self->handle_read(UringStream::read_error(result), result > 0 ? static_cast<size_t> (result) : 0);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::write_uring() {
+
+        // carries on from uring_written_ after a partial send
+        if (uring_.write(socket_.native_handle(), write_buffers_, uring_written_,
+                &AsioSocket<Handler>::handle_uring_write, this, this->shared_from_this()))
+            return;
+
+        // the submission queue is full, the rest of the batch goes over the reactor
+        consume_buffers(write_buffers_, uring_written_);
+        boost::asio::async_write(socket_, GatherBuffers(write_buffers_),
+                boost::bind(&AsioSocket<Handler>::handle_write_rest, this->shared_from_this(), _1, _2));
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_uring_write(void* socket, int result) {
+
+        AsioSocket<Handler>* self = static_cast<AsioSocket<Handler>*> (socket);
+
+        // the batch is written in full before it completes, as async_write does it
+        if (result > 0) {
+            self->uring_written_ += static_cast<size_t> (result);
+            if (self->uring_written_ < self->uring_write_size_ && !self->stopped_ && self->connection_status_) {
+                self->write_uring();
+                return;
+            }
+        }
+
+        self->handle_write(UringStream::write_error(result), self->uring_written_);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_write_rest(const boost::system::error_code& ec, size_t bytes) {
+
+        uring_written_ += bytes;
+        handle_write(ec, uring_written_);
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::cancel_uring() {
+
+        // no room in the ring for a cancel, a shutdown ends the receive and the send just as well
+        if (!uring_.cancel()) {
+            boost::system::error_code ignored;
+            socket_.shutdown(boost::asio::socket_base::shutdown_both, ignored);
+        }
+
+    }
+
+    template <typename Handler>
+    void AsioSocket<Handler>::handle_blocking_connect(StreamEndpoint ep, const SocketOptions& options, boost::system::error_code& ec) {
+
+        boost::system::error_code error = boost::asio::error::host_not_found;
+
+        if (stopped_)
+            return;
+
+        options_ = options;
+        set_endpoints(ep);
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::handle_blocking_connect()", "Waiting for connection establishment");
+        connect_started_ = stats_now();
+        open_socket(ep);
+        socket_.connect(ep, error);
+        if (!error)
+            error = create_shared_memory(ep);
+
+        if (error) {
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::handle_blocking_connect()", "Connection error : " << error.message());
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT_FAILED, 0, NULL);
+        } else {
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "AsioSocket::handle_blocking_connect()", "Connection success");
+
+            connection_status_ = true;
+            connect_deadline_passed = true;
+
+            read_back_options();
+
+            stats_add(stats_.connects, 1);
+            stats_.connect_time_ns.store(stats_now() - connect_started_, boost::memory_order_relaxed);
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT, 0, NULL);
+            capture(CAPTURE_CONNECT, NULL, 0);
+
+            // the actors run on the io_service thread, which may already be running when pooled,
+            // and so does the timer wheel
+            io_service_.post(boost::bind(&AsioSocket<Handler>::start_actors, this->shared_from_this()));
+
+        }
+
+        ec = error;
+
+    }
+
 }
 
 #endif	/* ASIOSOCKET_H */
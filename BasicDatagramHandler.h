@@ -0,0 +1,337 @@
+/*
+ * File:   BasicDatagramHandler.h
+ * Author: mihiranad
+ *
+ * The datagram socket handler, BasicSocketHandler's model over UDP. Derived
+ * hides the event handlers it is interested in, they are called straight
+ * from the io_service thread:
+ *
+ *   class Feed : public BasicDatagramHandler<Feed> {
+ *   public:
+ *       void OnDatagram(const BufferView& data, const DatagramInfo& info) { ... }
+ *   };
+ *
+ *   Feed feed;
+ *   feed.Open("0.0.0.0", "30001");
+ *   feed.JoinGroup("239.1.1.1");
+ *
+ * Derived should Close() in its own destructor, by the time the base
+ * destructor closes the socket the event handlers are gone.
+ */
+
+#ifndef BASICDATAGRAMHANDLER_H
+#define	BASICDATAGRAMHANDLER_H
+
+#include <cstdlib>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "AsioDatagram.h"
+#include "BasicSocketHandler.h" // IOServiceWrapper
+#include "IoServicePool.h"
+
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+namespace modt_socket {
+
+    template <typename Derived>
+    class BasicDatagramHandler {
+    public:
+
+        typedef AsioDatagram<Derived> Socket;
+
+        // binds to ip:port and starts receiving. For a multicast feed that is any address and the
+        // port of the group, port 0 picks a free one, e.g. for a socket that only sends
+        boost::system::error_code Open(const char* ip, const char* port);
+        void Close();
+
+        // the interface is the IPv4 address of the one to receive on, an interface index or name
+        // for an IPv6 group, empty for the default. Open first
+        boost::system::error_code JoinGroup(const char* group, const char* interface = "");
+        boost::system::error_code LeaveGroup(const char* group, const char* interface = "");
+
+        // sends one datagram at once on the caller's thread, from any thread. False if the socket
+        // is not open or the kernel did not take it, e.g. with the send buffer full
+        bool SendTo(const char* data, size_t size, const udp::endpoint& destination);
+        bool SendTo(const std::string& msg, const udp::endpoint& destination);
+
+        // settings take effect on the next Open
+        void Configure(const DatagramSettings& settings);
+        const DatagramSettings& Settings() const;
+
+        udp::endpoint LocalEndpoint() const; // as bound, e.g. the port Open picked
+
+        // counters and the kernel to callback latency with kernel_timestamps, cumulative over
+        // every Open. Safe to call from any thread
+        SocketStats GetStats() const;
+
+        // run the socket on a shared io_service pool instead of a dedicated thread, takes
+        // effect on the next Open, the pool must outlive the socket
+        void SetIoServicePool(IoServicePool* pool);
+
+        // event handlers, called on the io_service thread. These do nothing, Derived hides
+        // the ones it needs. The view passed to OnDatagram may be kept past the callback
+        void OnDatagram(const BufferView& data, const DatagramInfo& info) {
+        }
+
+        // with detect_gaps, the datagrams from expected up to received - 1 are missing. They may
+        // still come, out of order, and are delivered as usual if they do
+        void OnGap(boost::uint64_t expected, boost::uint64_t received) {
+        }
+
+        // the socket failed and is closed, Open again to carry on
+        void OnClose(const boost::system::error_code& ec) {
+        }
+
+        // used by detect_gaps to find the sequence number of a datagram, false if it has none
+        bool ParseSequence(const char* data, size_t size, boost::uint64_t& sequence) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "BasicDatagramHandler::ParseSequence()", "Gap detection used without a sequence parser");
+            return false;
+
+        }
+
+    protected:
+
+        BasicDatagramHandler();
+        ~BasicDatagramHandler(); // not virtual, a handler is never deleted through its BasicDatagramHandler
+
+    private:
+
+        BasicDatagramHandler(const BasicDatagramHandler& orig);
+
+        Derived* derived() {
+            return static_cast<Derived*> (this);
+        }
+
+        void ReleaseSocket();
+
+        DatagramSettings settings_;
+        SocketMetrics stats_;
+
+        IoServicePool* pool_; // when set, the socket runs on the pool rather than on its own thread
+        boost::asio::io_service* io_service_; // the io_service the current socket runs on
+
+        boost::scoped_ptr<IOServiceWrapper> io_service_wrapper;
+        boost::scoped_ptr<boost::thread> thread;
+        RunMetrics run_metrics_; // of the socket's own thread
+        boost::atomic<const RunMetrics*> current_run_; // those of the thread the socket runs on, for GetStats
+        boost::shared_ptr<Socket> sock; // shared with the pending handlers of the socket
+
+    };
+
+    template <typename Derived>
+    BasicDatagramHandler<Derived>::BasicDatagramHandler()
+    : pool_(NULL),
+    io_service_(NULL),
+    current_run_(NULL) {
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicDatagramHandler::BasicDatagramHandler()", "Creating datagram handler : " << this);
+
+    }
+
+    template <typename Derived>
+    BasicDatagramHandler<Derived>::~BasicDatagramHandler() {
+
+        if (sock)
+            Close();
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicDatagramHandler::~BasicDatagramHandler()", "Destroying datagram handler : " << this);
+
+    }
+
+    template <typename Derived>
+    boost::system::error_code BasicDatagramHandler<Derived>::Open(const char* ip, const char* port) {
+
+        if (sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicDatagramHandler::Open()", "Open attempted when already open, nothing will be done...");
+            return boost::asio::error::already_open;
+
+        }
+
+        if (pool_) {
+
+            io_service_ = &pool_->acquire();
+            current_run_ = pool_->run_metrics(*io_service_);
+
+        } else {
+
+            io_service_wrapper.reset(new IOServiceWrapper);
+            io_service_ = &io_service_wrapper.get()->io_service;
+            current_run_ = &run_metrics_;
+
+        }
+
+        sock.reset(new Socket(*io_service_, derived(), stats_, settings_));
+
+        udp::endpoint local(boost::asio::ip::address::from_string(ip), atoi(port)); // atoi?
+        boost::system::error_code error = sock->open(local);
+        if (error) {
+            ReleaseSocket();
+            return error;
+        }
+
+        // the read actor starts on the io_service thread, with a pool it may already be running
+        io_service_->post(boost::bind(&Socket::start, sock));
+
+        if (!pool_) {
+            thread.reset(new boost::thread(boost::bind(&run_io_service, boost::ref(*io_service_), settings_.run, boost::ref(run_metrics_))));
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicDatagramHandler::Open()", "A new thread is made for the datagram socket.... Thread ID : " << thread.get()->get_id());
+        }
+
+        return error;
+
+    }
+
+    template <typename Derived>
+    void BasicDatagramHandler<Derived>::Close() {
+
+        if (!sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicDatagramHandler::Close()", "Close attempted when not open, nothing will be done...");
+            return;
+
+        }
+
+        if (thread) {
+
+            io_service_->stop(); // allows the thread to exit
+            thread.get()->join();
+            io_service_->reset();
+            thread.reset();
+
+            sock.get()->abort();
+
+        } else if (io_service_->get_executor().running_in_this_thread()) {
+
+            // called from one of our own callbacks, we are already on the right thread
+            sock.get()->abort();
+
+        } else {
+
+            // the pool thread keeps running other sockets, so the abort is done on that thread
+            // and once it returns no further callbacks will be made into this handler. On a
+            // stopped pool it is done here
+            run_and_wait(*io_service_, boost::bind(&Socket::abort, sock));
+
+        }
+
+        ReleaseSocket();
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicDatagramHandler::Close()", "Closed the datagram socket");
+
+    }
+
+    template <typename Derived>
+    void BasicDatagramHandler<Derived>::ReleaseSocket() {
+
+        // the socket is shared with its pending handlers, it goes away once they have all run or been destroyed
+        sock.reset();
+
+        if (io_service_wrapper)
+            io_service_wrapper.reset();
+        else if (pool_)
+            pool_->release(*io_service_);
+
+        io_service_ = NULL;
+
+    }
+
+    template <typename Derived>
+    boost::system::error_code BasicDatagramHandler<Derived>::JoinGroup(const char* group, const char* interface) {
+
+        if (!sock)
+            return boost::asio::error::bad_descriptor;
+
+        boost::system::error_code error;
+        boost::asio::ip::address address = boost::asio::ip::address::from_string(group, error);
+        if (error)
+            return error;
+
+        return sock->join_group(address, interface);
+
+    }
+
+    template <typename Derived>
+    boost::system::error_code BasicDatagramHandler<Derived>::LeaveGroup(const char* group, const char* interface) {
+
+        if (!sock)
+            return boost::asio::error::bad_descriptor;
+
+        boost::system::error_code error;
+        boost::asio::ip::address address = boost::asio::ip::address::from_string(group, error);
+        if (error)
+            return error;
+
+        return sock->leave_group(address, interface);
+
+    }
+
+    template <typename Derived>
+    bool BasicDatagramHandler<Derived>::SendTo(const char* data, size_t size, const udp::endpoint& destination) {
+
+        return sock && sock->send_to(data, size, destination);
+
+    }
+
+    template <typename Derived>
+    bool BasicDatagramHandler<Derived>::SendTo(const std::string& msg, const udp::endpoint& destination) {
+
+        return SendTo(msg.data(), msg.size(), destination);
+
+    }
+
+    template <typename Derived>
+    void BasicDatagramHandler<Derived>::Configure(const DatagramSettings& settings) {
+
+        settings_ = settings;
+
+    }
+
+    template <typename Derived>
+    const DatagramSettings& BasicDatagramHandler<Derived>::Settings() const {
+
+        return settings_;
+
+    }
+
+    template <typename Derived>
+    udp::endpoint BasicDatagramHandler<Derived>::LocalEndpoint() const {
+
+        return sock ? sock->local_endpoint() : udp::endpoint();
+
+    }
+
+    template <typename Derived>
+    SocketStats BasicDatagramHandler<Derived>::GetStats() const {
+
+        SocketStats stats;
+        stats_.snapshot(stats);
+
+        const RunMetrics* run = current_run_;
+        if (run)
+            run->snapshot(stats);
+
+        return stats;
+
+    }
+
+    template <typename Derived>
+    void BasicDatagramHandler<Derived>::SetIoServicePool(IoServicePool* pool) {
+
+        if (sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicDatagramHandler::SetIoServicePool()", "Pool change attempted while open, nothing will be done...");
+            return;
+
+        }
+
+        pool_ = pool;
+
+    }
+
+}
+
+#endif	/* BASICDATAGRAMHANDLER_H */
@@ -0,0 +1,677 @@
+/*
+ * File:   BasicSocketHandler.h
+ * Author: mihiranad
+ *
+ * The socket handler with static dispatch. Derived hides the event handlers
+ * it is interested in, they are called straight from the io_service thread
+ * without going through a boost::function or a virtual call, and get the
+ * event data by value:
+ *
+ *   class MyHandler : public BasicSocketHandler<MyHandler> {
+ *   public:
+ *       void OnReceive(const BufferView& data, const boost::system::error_code& ec) { ... }
+ *   };
+ *
+ * Derived should Disconnect() in its own destructor, by the time the base
+ * destructor closes the connection the event handlers are gone. SocketHandler
+ * is the virtual interface on top of it.
+ */
+
+#ifndef BASICSOCKETHANDLER_H
+#define	BASICSOCKETHANDLER_H
+
+#include <cstdlib>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "AsioSocket.h"
+#include "IoServicePool.h"
+
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+using namespace modt_log;
+
+namespace modt_socket {
+
+    struct IOServiceWrapper { // this is required to control the life span of the io_service object....
+
+        boost::asio::io_service io_service;
+        boost::asio::io_service::work work; // keeps the thread running while the actors are idle
+
+        IOServiceWrapper() : work(io_service) {
+            MODT_SOCKET_LOG_INFO(g_Logger, "IOServiceWrapper::IOServiceWrapper()", "Created IOServiceWrapper Object [" << this << "]");
+        }
+
+        virtual ~IOServiceWrapper() {
+            MODT_SOCKET_LOG_INFO(g_Logger, "IOServiceWrapper::~IOServiceWrapper()", "Destruct IOServiceWrapper Object [" << this << "]");
+        }
+
+    };
+
+    template <typename Derived>
+    class BasicSocketHandler {
+    public:
+
+        typedef AsioSocket<Derived> Socket;
+
+        // user interface for the socket handler
+        void AsyncConnect(const char* ip, const char* port, const SocketOptions& options = SocketOptions());
+        void Disconnect();
+        bool Read(const size_t bytes); // false if the read queue is full
+        WriteStatus AsyncWrite(const std::string& msg);
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+        WriteStatus AsyncWrite(std::string&& msg); // takes the string over without copying it, untouched unless queued
+#endif
+        WriteStatus AsyncWrite(const BufferView& buffer); // pooled or shared buffer, only the reference is queued
+        // keyed messages, a later message with the same key supersedes this one under OVERFLOW_CONFLATE
+        WriteStatus AsyncWrite(const std::string& msg, boost::uint64_t key);
+        WriteStatus AsyncWrite(const BufferView& buffer, boost::uint64_t key);
+        // sends at once on the caller's thread when nothing is queued or being written, otherwise,
+        // or for what the kernel did not take, it goes through the write queue like AsyncWrite.
+        // Either way the bytes stay in order. msg.size() if sent or queued, 0 if refused. Only a
+        // queued part is reported to OnWriteComplete
+        size_t Write(const std::string msg);
+        boost::system::error_code Connect(const char* ip, const char* port, const SocketOptions& options = SocketOptions());
+
+        // the same over a Unix-domain socket, for a peer on this host. With shared_memory in the
+        // settings the data then goes through shared memory rings, see SharedMemoryStream.h
+        void AsyncConnectLocal(const char* path, const SocketOptions& options = SocketOptions());
+        boost::system::error_code ConnectLocal(const char* path, const SocketOptions& options = SocketOptions());
+
+        // the socket options the kernel granted the current connection, see SocketOptions.h.
+        // Known once the connection is made, all -1 before that
+        SocketOptions AppliedOptions() const;
+
+        // settings take effect on the next Connect/AsyncConnect
+        void Configure(const SocketSettings& settings);
+        const SocketSettings& Settings() const;
+
+        // a block from the connection's write buffer pool, fill it in and send it with
+        // AsyncWrite(BufferView(block, size)). No allocation once the pool is warm
+        BufferBlockPtr AllocateBuffer();
+
+        // request queue fill levels
+        size_t ReadQueueSize() const;
+        size_t ReadQueueCapacity() const;
+        size_t WriteQueueSize() const;
+        size_t WriteQueueCapacity() const;
+        size_t WriteBacklogBytes() const; // queued or being written, as limited by the write watermarks
+
+        // counters and latency histograms, cumulative over all the connections made by this
+        // handler. Safe to call from any thread, merge the results to aggregate handlers
+        SocketStats GetStats() const;
+
+        // run the connection on a shared io_service pool instead of a dedicated thread,
+        // takes effect on the next Connect/AsyncConnect, the pool must outlive the connection
+        void SetIoServicePool(IoServicePool* pool);
+
+        // used by AsioAcceptor for inbound connections. PrepareAccept creates the connection on
+        // the pool's io_service at index and gives out its socket to accept into, StartAccepted
+        // starts it once the accept completed. Until then Disconnect() abandons it
+        StreamSocket& PrepareAccept(IoServicePool& pool, size_t index);
+        void StartAccepted(const SocketOptions& options = SocketOptions());
+
+        // event handlers, called on the io_service thread. These do nothing, Derived hides
+        // the ones it needs. The view passed to OnReceive may be kept past the callback
+        void OnConnect(bool connected, const boost::system::error_code& ec) {
+        }
+
+        void OnReceive(const BufferView& data, const boost::system::error_code& ec) {
+        }
+
+        // with READ_PER_BATCH, everything one socket read completed, in order. The views may be
+        // kept, the array only lasts for the call. This one hands them to OnReceive one by one
+        void OnReceiveBatch(const BufferView* messages, size_t count) {
+
+            for (size_t i = 0; i < count; ++i)
+                derived()->OnReceive(messages[i], boost::system::error_code());
+
+        }
+
+        void OnWriteComplete(size_t bytes, const boost::system::error_code& ec) {
+        }
+
+        void OnClose(const boost::system::error_code& ec) {
+        }
+
+        // the write backlog went below the low watermarks after hitting a high one
+        void OnWritable() {
+        }
+
+        // used by the framed read mode to find complete frames in the received data, see Framing.h
+        FrameStatus ParseFrame(const char* data, size_t size, FrameInfo& frame) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "BasicSocketHandler::ParseFrame()", "Framed read mode used without a frame parser");
+            return FRAME_ERROR;
+
+        }
+
+        // the receive buffer starts over, on a new connection or a dropped one. A stateful frame
+        // parser forgets what it knew about the old data here
+        void ResetFrames() {
+        }
+
+    protected:
+
+        BasicSocketHandler();
+        ~BasicSocketHandler(); // not virtual, a handler is never deleted through its BasicSocketHandler
+
+    private:
+
+        BasicSocketHandler(const BasicSocketHandler& orig);
+
+        enum {
+            ANY_IO_SERVICE = static_cast<size_t> (-1) // let the pool pick
+        };
+
+        Derived* derived() {
+            return static_cast<Derived*> (this);
+        }
+
+        void ConfigureConnection(const StreamEndpoint& ep, const SocketOptions& options);
+
+        void StartConnect(const StreamEndpoint& ep, const SocketOptions& options);
+        boost::system::error_code BlockingConnect(const StreamEndpoint& ep, const SocketOptions& options);
+        void CreateSocket(size_t pool_index = ANY_IO_SERVICE);
+        void StartThread();
+        void ReleaseConnection();
+        WriteStatus QueueWrite(WriteMsg& message);
+
+        SocketSettings settings_;
+        SocketMetrics stats_;
+        WriteBacklog backlog_;
+
+        //boost::asio::io_service io_service;
+        boost::scoped_ptr<BoundedQueue<size_t> > read_queue;
+        boost::scoped_ptr<BoundedQueue<WriteMsg> > write_queue;
+
+        boost::shared_ptr<BufferPool> write_pool_; // backs AllocateBuffer()
+
+        IoServicePool* pool_; // when set, connections run on the pool rather than on their own thread
+        boost::asio::io_service* io_service_; // the io_service the current connection runs on
+
+        boost::scoped_ptr<IOServiceWrapper> io_service_wrapper;
+        boost::scoped_ptr<boost::thread> thread;
+        RunMetrics run_metrics_; // of the connection's own thread
+        boost::atomic<const RunMetrics*> current_run_; // those of the thread the connection runs on, for GetStats
+        boost::shared_ptr<Socket> sock; // shared with the pending handlers of the socket
+
+    };
+
+    template <typename Derived>
+    BasicSocketHandler<Derived>::BasicSocketHandler()
+    : read_queue(make_queue<size_t>(settings_.queue_kind, settings_.read_queue_capacity)),
+    write_queue(make_queue<WriteMsg>(settings_.queue_kind, settings_.write_queue_capacity)),
+    write_pool_(boost::make_shared<BufferPool>(settings_.write_buffer_size, settings_.write_buffer_cache)),
+    pool_(NULL),
+    io_service_(NULL),
+    current_run_(NULL) {
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::BasicSocketHandler()", "Creating socket handler : " << this);
+
+    }
+
+    template <typename Derived>
+    BasicSocketHandler<Derived>::~BasicSocketHandler() {
+
+        if (sock)
+            Disconnect();
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::~BasicSocketHandler()", "Destroying socket handler : " << this);
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::SetIoServicePool(IoServicePool* pool) {
+
+        if (sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::SetIoServicePool()", "Pool change attempted while connected, nothing will be done...");
+            return;
+
+        }
+
+        pool_ = pool;
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::CreateSocket(size_t pool_index) {
+
+        if (pool_) {
+
+            // pooled connections share the threads of the pool, nothing is created here....
+            io_service_ = pool_index == ANY_IO_SERVICE ? &pool_->acquire() : &pool_->acquire(pool_index);
+            current_run_ = pool_->run_metrics(*io_service_);
+
+        } else {
+
+            //every time a new connection is made, a new io_service object is generated ...
+            io_service_wrapper.reset(new IOServiceWrapper);
+            io_service_ = &io_service_wrapper.get()->io_service;
+            current_run_ = &run_metrics_;
+
+        }
+
+        // the queues are rebuilt if the settings ask for a different kind or size, otherwise just emptied
+        if (read_queue->Kind() != settings_.queue_kind || read_queue->Capacity() < settings_.read_queue_capacity)
+            read_queue.reset(make_queue<size_t>(settings_.queue_kind, settings_.read_queue_capacity));
+        else
+            read_queue->Clear(); // cancel all read requests
+
+        if (write_queue->Kind() != settings_.queue_kind || write_queue->Capacity() < settings_.write_queue_capacity)
+            write_queue.reset(make_queue<WriteMsg>(settings_.queue_kind, settings_.write_queue_capacity));
+        else
+            write_queue->Clear(); // cancel all write requests
+
+        backlog_.reset();
+
+        sock.reset(new Socket(*io_service_, read_queue.get(), write_queue.get(), derived(), stats_, backlog_, settings_));
+
+    }
+
+    template <typename Derived>
+    StreamSocket& BasicSocketHandler<Derived>::PrepareAccept(IoServicePool& pool, size_t index) {
+
+        if (!sock) {
+
+            pool_ = &pool; // accepted connections always run on the pool of the acceptor
+            CreateSocket(index);
+
+        }
+
+        return sock->socket();
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::StartAccepted(const SocketOptions& options) {
+
+        if (!sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::StartAccepted()", "No accepted connection to start, nothing will be done...");
+            return;
+
+        }
+
+        // the accept may have completed on the thread of another io_service
+        io_service_->post(boost::bind(&Socket::start_accepted, sock, options));
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::StartThread() {
+
+        if (pool_)
+            return; // the pool threads are already running the io_service
+
+        thread.reset(new boost::thread(boost::bind(&run_io_service, boost::ref(*io_service_), settings_.run, boost::ref(run_metrics_))));
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::StartThread()", "A new thread is made for the new connection.... Thread ID : " << thread.get()->get_id());
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::ReleaseConnection() {
+
+        // the socket is shared with its pending handlers, it goes away once they have all run or been destroyed
+        sock.reset();
+
+        if (io_service_wrapper) {
+
+            // the disconnect destroys the ioservice wrapper shutting down all associated handlers....
+            io_service_wrapper.reset();
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::ReleaseConnection()", "Deleted the reference to the current io_service");
+
+        } else if (pool_) {
+
+            pool_->release(*io_service_);
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::ReleaseConnection()", "Released the pooled io_service");
+
+        }
+
+        io_service_ = NULL;
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::ConfigureConnection(const StreamEndpoint& ep, const SocketOptions& options) {
+
+        CreateSocket();
+
+        // the actors are started on the io_service thread, with a pool it may already be running
+        io_service_->post(boost::bind(&Socket::start, sock, ep, options));
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::ConfigureConnection()", "Connection configured, asio socket created");
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::AsyncConnect(const char* ip, const char* port, const SocketOptions& options) {
+
+        StartConnect(make_tcp_endpoint(ip, port), options);
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::AsyncConnectLocal(const char* path, const SocketOptions& options) {
+
+        StartConnect(make_local_endpoint(path), options);
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::StartConnect(const StreamEndpoint& ep, const SocketOptions& options) {
+
+        if (sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::AsyncConnect()", "Connect attempted when a connection is already active, nothing will be done...");
+            return; // running
+
+        }
+
+        ConfigureConnection(ep, options);
+        StartThread();
+
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::Disconnect() { // should be called by the user probably on errors for sending/recieving....
+
+        if (!sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::Disconnect()", "Disconnect attempted when no connection is active, nothing will be done...");
+            return; // stopped - nothing to do......
+
+        }
+
+        if (thread) {
+
+            io_service_->stop(); // allows the thread to exit
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::Disconnect()", "Stopped the current io_service");
+
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::Disconnect()", "Thread joined. Thread ID : " << thread.get()->get_id());
+
+            thread.get()->join(); // blocks the current thread until the service thread completes....
+
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::Disconnect()", "Thread join complete");
+
+            io_service_->reset();
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::Disconnect()", "Reset the current io_service");
+
+            thread.reset();
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::Disconnect()", "Deleted the reference to the thread");
+
+            //cancel all operation of timers, close the socket
+            sock.get()->abort();
+            //after this point no services are supposed to access the io_service object, everything is cancelled
+
+        } else if (io_service_->get_executor().running_in_this_thread()) {
+
+            // called from one of our own callbacks, we are already on the right thread
+            sock.get()->abort();
+
+        } else {
+
+            // the pool thread keeps running other connections, so the abort is done on that thread
+            // and once it returns no further callbacks will be made into this handler. On a
+            // stopped pool it is done here
+            run_and_wait(*io_service_, boost::bind(&Socket::abort, sock));
+
+        }
+
+        ReleaseConnection();
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "BasicSocketHandler::Disconnect()", "Deleted the reference to the current asio scoket");
+
+        // all done, now the handler can be destroyed
+    }
+
+    template <typename Derived>
+    void BasicSocketHandler<Derived>::Configure(const SocketSettings& settings) {
+
+        // blocks already handed out keep the old pool alive until they are released
+        if (settings.write_buffer_size != settings_.write_buffer_size || settings.write_buffer_cache != settings_.write_buffer_cache)
+            write_pool_ = boost::make_shared<BufferPool>(settings.write_buffer_size, settings.write_buffer_cache);
+
+        settings_ = settings;
+
+    }
+
+    template <typename Derived>
+    const SocketSettings& BasicSocketHandler<Derived>::Settings() const {
+
+        return settings_;
+
+    }
+
+    template <typename Derived>
+    bool BasicSocketHandler<Derived>::Read(const size_t bytes) {
+
+        if (!read_queue->try_Enqueue(bytes)) {
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::Read()", "Read queue full, request dropped : " << bytes << " bytes");
+            return false;
+        }
+
+        stats_high_water(stats_.read_queue_high_water, read_queue->Size());
+
+        if (sock) // serve the request right away if the data is already there....
+            sock->notify_read();
+
+        return true;
+
+    }
+
+    template <typename Derived>
+    WriteStatus BasicSocketHandler<Derived>::QueueWrite(WriteMsg& message) {
+
+        size_t size = message.size();
+
+        if (backlog_.above_high(settings_, size)) {
+
+            backlog_.blocked.store(true, boost::memory_order_release);
+
+            if (!overflow_queues(settings_.write_overflow)) {
+
+                // the write actor may have drained the backlog in the meantime, it checks again
+                if (sock)
+                    sock->notify_write();
+
+                if (settings_.write_overflow == OVERFLOW_REJECT)
+                    return WRITE_WOULD_BLOCK;
+
+                stats_add(stats_.messages_dropped, 1);
+                return WRITE_DROPPED;
+
+            }
+
+        }
+
+        // counted before it is queued, the write actor may take it off the backlog as soon as it is
+        message.enqueued = stats_now();
+        backlog_.add(size);
+        if (!write_queue->try_Enqueue(boost::move(message))) {
+            backlog_.remove(size, 1);
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::AsyncWrite()", "Write queue full, message dropped");
+            return WRITE_QUEUE_FULL;
+        }
+
+        stats_high_water(stats_.write_queue_high_water, write_queue->Size());
+
+        if (sock) // wake up the write actor, no polling involved....
+            sock->notify_write();
+
+        return WRITE_QUEUED;
+
+    }
+
+    template <typename Derived>
+    WriteStatus BasicSocketHandler<Derived>::AsyncWrite(const std::string& msg) {
+
+        WriteMsg t;
+        t.msg = msg;
+        return QueueWrite(t);
+
+    }
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+
+    template <typename Derived>
+    WriteStatus BasicSocketHandler<Derived>::AsyncWrite(std::string&& msg) {
+
+        WriteMsg t;
+        t.msg.swap(msg);
+        WriteStatus status = QueueWrite(t);
+        if (status != WRITE_QUEUED)
+            msg.swap(t.msg); // give it back, the queue only moves from the message if it was taken
+        return status;
+
+    }
+
+#endif
+
+    template <typename Derived>
+    WriteStatus BasicSocketHandler<Derived>::AsyncWrite(const BufferView& buffer) {
+
+        WriteMsg t;
+        t.buffer = buffer;
+        return QueueWrite(t);
+
+    }
+
+    template <typename Derived>
+    WriteStatus BasicSocketHandler<Derived>::AsyncWrite(const std::string& msg, boost::uint64_t key) {
+
+        WriteMsg t;
+        t.msg = msg;
+        t.key = key;
+        return QueueWrite(t);
+
+    }
+
+    template <typename Derived>
+    WriteStatus BasicSocketHandler<Derived>::AsyncWrite(const BufferView& buffer, boost::uint64_t key) {
+
+        WriteMsg t;
+        t.buffer = buffer;
+        t.key = key;
+        return QueueWrite(t);
+
+    }
+
+    template <typename Derived>
+    BufferBlockPtr BasicSocketHandler<Derived>::AllocateBuffer() {
+
+        return write_pool_->acquire();
+
+    }
+
+    template <typename Derived>
+    size_t BasicSocketHandler<Derived>::ReadQueueSize() const {
+
+        return read_queue->Size();
+
+    }
+
+    template <typename Derived>
+    size_t BasicSocketHandler<Derived>::ReadQueueCapacity() const {
+
+        return read_queue->Capacity();
+
+    }
+
+    template <typename Derived>
+    size_t BasicSocketHandler<Derived>::WriteQueueSize() const {
+
+        return write_queue->Size();
+
+    }
+
+    template <typename Derived>
+    size_t BasicSocketHandler<Derived>::WriteQueueCapacity() const {
+
+        return write_queue->Capacity();
+
+    }
+
+    template <typename Derived>
+    size_t BasicSocketHandler<Derived>::WriteBacklogBytes() const {
+
+        return backlog_.bytes.load(boost::memory_order_relaxed);
+
+    }
+
+    template <typename Derived>
+    SocketOptions BasicSocketHandler<Derived>::AppliedOptions() const {
+
+        return sock ? sock->applied_options() : SocketOptions();
+
+    }
+
+    template <typename Derived>
+    SocketStats BasicSocketHandler<Derived>::GetStats() const {
+
+        SocketStats stats;
+        stats_.snapshot(stats);
+
+        const RunMetrics* run = current_run_;
+        if (run)
+            run->snapshot(stats);
+
+        return stats;
+
+    }
+
+    template <typename Derived>
+    size_t BasicSocketHandler<Derived>::Write(const std::string msg) {
+
+        if (sock && sock->try_write(msg.data(), msg.size()))
+            return msg.size();
+
+        return AsyncWrite(msg) == WRITE_QUEUED ? msg.size() : 0;
+
+    }
+
+    template <typename Derived>
+    boost::system::error_code BasicSocketHandler<Derived>::Connect(const char* ip, const char* port, const SocketOptions& options) {
+
+        return BlockingConnect(make_tcp_endpoint(ip, port), options);
+
+    }
+
+    template <typename Derived>
+    boost::system::error_code BasicSocketHandler<Derived>::ConnectLocal(const char* path, const SocketOptions& options) {
+
+        return BlockingConnect(make_local_endpoint(path), options);
+
+    }
+
+    template <typename Derived>
+    boost::system::error_code BasicSocketHandler<Derived>::BlockingConnect(const StreamEndpoint& ep, const SocketOptions& options) {
+
+        boost::system::error_code error = boost::asio::error::already_started;
+
+        if (sock) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "BasicSocketHandler::Connect()", "Connect attempted when a connection is already active, nothing will be done...");
+            return error; // running
+
+        }
+
+        CreateSocket();
+
+        // handle the sync connect
+        sock.get()->handle_blocking_connect(ep, options, error);
+        if (error) {
+            ReleaseConnection();
+            return error;
+        }
+
+        StartThread();
+        return error;
+
+    }
+
+}
+
+#endif	/* BASICSOCKETHANDLER_H */
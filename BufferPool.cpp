@@ -0,0 +1,95 @@
+/*
+ * File:   BufferPool.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "BufferPool.h"
+
+#include <cstring>
+
+namespace modt_socket {
+
+    void intrusive_ptr_add_ref(BufferBlock* block) {
+
+        block->refs_.fetch_add(1, boost::memory_order_relaxed);
+
+    }
+
+    void intrusive_ptr_release(BufferBlock* block) {
+
+        if (block->refs_.fetch_sub(1, boost::memory_order_release) != 1)
+            return;
+
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+
+        // the last view is gone, hand the block back to its pool. The pool reference
+        // is moved out first, the recycle call may be what keeps the pool alive
+        boost::shared_ptr<BufferPool> pool;
+        pool.swap(block->pool_);
+        if (pool)
+            pool->recycle(block);
+        else
+            delete block;
+
+    }
+
+    BufferView make_shared_buffer(const char* data, size_t size) {
+
+        BufferBlockPtr block(new BufferBlock(size));
+        if (size)
+            memcpy(block->data(), data, size);
+        return BufferView(block, size);
+
+    }
+
+}
+
+using namespace modt_socket;
+
+BufferPool::BufferPool(size_t block_size, size_t max_cached)
+: block_size_(block_size),
+max_cached_(max_cached) {
+}
+
+BufferPool::~BufferPool() {
+
+    // handed out blocks keep the pool alive, only the cached ones are left here
+    for (size_t i = 0; i < free_.size(); ++i)
+        delete free_[i];
+
+}
+
+BufferBlockPtr BufferPool::acquire() {
+
+    BufferBlock* block = NULL;
+
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (!free_.empty()) {
+            block = free_.back();
+            free_.pop_back();
+        }
+    }
+
+    if (!block)
+        block = new BufferBlock(block_size_);
+
+    block->pool_ = shared_from_this();
+    return BufferBlockPtr(block);
+
+}
+
+void BufferPool::recycle(BufferBlock* block) {
+
+    {
+        boost::mutex::scoped_lock lock(mutex_);
+        if (free_.size() < max_cached_) {
+            free_.push_back(block);
+            return;
+        }
+    }
+
+    delete block;
+
+}
@@ -0,0 +1,153 @@
+/*
+ * File:   BufferPool.h
+ * Author: mihiranad
+ *
+ * Reference counted receive buffers. The read actor receives into blocks
+ * taken from a BufferPool and hands the handler BufferViews into them, so
+ * received data is never cleared or copied on its way to the callback. A
+ * view keeps its block alive, the handler may hold on to it past the
+ * callback; the block goes back to its pool once the last view is gone.
+ */
+
+#ifndef BUFFERPOOL_H
+#define	BUFFERPOOL_H
+
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace modt_socket {
+
+    class BufferPool;
+
+    class BufferBlock : private boost::noncopyable {
+    public:
+
+        explicit BufferBlock(size_t capacity)
+        : refs_(0),
+        capacity_(capacity),
+        data_(new char[capacity]) { // intentionally not cleared
+        }
+
+        char* data() {
+            return data_.get();
+        }
+
+        size_t capacity() const {
+            return capacity_;
+        }
+
+        // true when nobody but the current owner refers to the block
+        bool unique() const {
+            return refs_.load(boost::memory_order_acquire) == 1;
+        }
+
+    private:
+
+        friend class BufferPool;
+        friend void intrusive_ptr_add_ref(BufferBlock* block);
+        friend void intrusive_ptr_release(BufferBlock* block);
+
+        boost::atomic<int> refs_;
+        size_t capacity_;
+        boost::scoped_array<char> data_;
+        boost::shared_ptr<BufferPool> pool_; // set while the block is handed out, keeps the pool alive
+
+    };
+
+    void intrusive_ptr_add_ref(BufferBlock* block);
+    void intrusive_ptr_release(BufferBlock* block);
+
+    typedef boost::intrusive_ptr<BufferBlock> BufferBlockPtr;
+
+    // a read only lease on a range of a pooled block, cheap to copy
+    class BufferView {
+    public:
+
+        BufferView()
+        : data_(NULL),
+        size_(0) {
+        }
+
+        BufferView(const BufferBlockPtr& block, const char* data, size_t size)
+        : block_(block),
+        data_(data),
+        size_(size) {
+        }
+
+        // the first size bytes of a block, e.g. one filled in after SocketHandler::AllocateBuffer()
+        BufferView(const BufferBlockPtr& block, size_t size)
+        : block_(block),
+        data_(block->data()),
+        size_(size) {
+        }
+
+        const char* data() const {
+            return data_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        // a narrower view sharing the same block
+        BufferView sub(size_t offset, size_t size) const {
+            return BufferView(block_, data_ + offset, size);
+        }
+
+        std::string str() const {
+            return std::string(data_, size_);
+        }
+
+    private:
+
+        BufferBlockPtr block_;
+        const char* data_;
+        size_t size_;
+
+    };
+
+    // an immutable shared copy of the data outside of any pool, e.g. a payload to be sent on many connections
+    BufferView make_shared_buffer(const char* data, size_t size);
+
+    class BufferPool : public boost::enable_shared_from_this<BufferPool>, private boost::noncopyable {
+    public:
+
+        // blocks are block_size bytes each, at most max_cached free blocks are kept for reuse
+        explicit BufferPool(size_t block_size, size_t max_cached = 16);
+        virtual ~BufferPool();
+
+        BufferBlockPtr acquire();
+
+        size_t block_size() const {
+            return block_size_;
+        }
+
+    private:
+
+        friend void intrusive_ptr_release(BufferBlock* block);
+
+        void recycle(BufferBlock* block);
+
+        size_t block_size_;
+        size_t max_cached_;
+
+        boost::mutex mutex_;
+        std::vector<BufferBlock*> free_;
+
+    };
+
+}
+
+#endif	/* BUFFERPOOL_H */
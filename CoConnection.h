@@ -0,0 +1,463 @@
+/*
+ * File:   CoConnection.h
+ * Author: mihiranad
+ *
+ * C++20 coroutine interface to a connection, next to the callback based
+ * SocketHandler. Every operation runs on the io_service thread of the
+ * coroutine, straight on the socket, without read or write queues:
+ *
+ *   boost::asio::awaitable<void> session(CoConnection<>& conn, tcp::endpoint ep) {
+ *       if (co_await conn.connect(ep, SocketOptions::LowLatency(), 5000))
+ *           co_return;
+ *       co_await conn.write(request);
+ *       BufferView reply;
+ *       while (!co_await conn.read_frame(reply, 10000))
+ *           ...
+ *   }
+ *
+ *   boost::asio::co_spawn(io_service, session(conn, ep), boost::asio::detached);
+ *
+ * Operations report errors through the returned error_code, a timeout as
+ * boost::asio::error::timed_out and cancel() as operation_aborted. asio can
+ * only cancel everything on a socket, so a timeout aborts the other direction
+ * as well. Views are leases on the receive buffer's pooled block and may be
+ * kept. A connection runs one read and one write at a time, and has to
+ * outlive its coroutines.
+ *
+ * Needs -std=c++20 (or -fcoroutines), the header is empty otherwise.
+ */
+
+#ifndef COCONNECTION_H
+#define	COCONNECTION_H
+
+#include "AsioSocket.h"
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+
+namespace modt_socket {
+
+    template <typename Codec = LengthPrefixCodec<4> >
+    class CoConnection : private boost::noncopyable {
+    public:
+
+        typedef boost::asio::awaitable<boost::system::error_code> Result;
+
+        // settings supplies the receive buffer and the event log, the queue and write settings do not apply
+        explicit CoConnection(boost::asio::io_service& io_service, const SocketSettings& settings = SocketSettings(), const Codec& codec = Codec());
+        virtual ~CoConnection();
+
+        // a timeout_ms of 0 waits for as long as it takes. Taken by value, the coroutine may
+        // outlive the caller's temporaries
+        Result connect(tcp::endpoint ep, SocketOptions options = SocketOptions(), size_t timeout_ms = 0);
+
+        // exactly bytes bytes, at most the receive buffer size
+        Result read_exactly(size_t bytes, BufferView& data, size_t timeout_ms = 0);
+
+        // the payload of the next frame, as found by the codec
+        Result read_frame(BufferView& payload, size_t timeout_ms = 0);
+
+        Result write(const char* data, size_t size, size_t timeout_ms = 0);
+        Result write(const BufferView& data, size_t timeout_ms = 0);
+
+        // encodes the payload into a frame and writes it
+        Result write_frame(const char* payload, size_t size, size_t timeout_ms = 0);
+
+        // any thread, the operations in progress complete with operation_aborted
+        void cancel();
+
+        // any thread, closes the socket, the connection may connect again afterwards
+        void close();
+
+        bool is_open() const {
+            return socket_.is_open();
+        }
+
+        SocketOptions applied_options() const {
+            return applied_options_;
+        }
+
+        SocketStats GetStats() const;
+
+        tcp::socket& socket() {
+            return socket_;
+        }
+
+    private:
+
+        // an operation's deadline, cancels the socket operations when it passes. The generation
+        // tells an expiry that was already on its way from the one of the current operation.
+        // The expiry handler shares it, it may still be queued once the connection is gone,
+        // and the destructor moves the generation on so that it finds nothing to do
+        struct Deadline {
+
+            Deadline(boost::asio::io_service& io_service, tcp::socket& socket)
+            : timer(io_service),
+            socket(socket),
+            generation(0),
+            timed_out(false) {
+            }
+
+            deadline_timer timer;
+            tcp::socket& socket; // only touched while the generation is current
+            size_t generation;
+            bool timed_out;
+
+        };
+
+        void arm(const boost::shared_ptr<Deadline>& deadline, size_t timeout_ms);
+        boost::system::error_code disarm(const boost::shared_ptr<Deadline>& deadline, const boost::system::error_code& ec);
+        static void handle_timeout(const boost::system::error_code& ec, boost::shared_ptr<Deadline> deadline, size_t generation);
+
+        // reads at least one more chunk into the receive buffer
+        Result fill(size_t timeout_ms);
+
+        void do_cancel();
+        void do_close();
+
+        boost::asio::io_service& io_service_;
+        tcp::socket socket_;
+        boost::shared_ptr<Deadline> read_deadline_; // also the connect's
+        boost::shared_ptr<Deadline> write_deadline_;
+
+        SocketSettings settings_;
+        Codec codec_;
+
+        SocketOptions applied_options_;
+
+        SocketMetrics stats_;
+        SocketEventLog* event_log_; // kept alive by settings_
+        boost::uint64_t connection_id_;
+        boost::uint64_t read_stamp_; // when the data in the read buffer last grew
+
+        RingBuffer read_buffer_;
+        std::string write_frame_; // write_frame encodes into it, its capacity is kept from frame to frame
+
+    };
+
+    template <typename Codec>
+    CoConnection<Codec>::CoConnection(boost::asio::io_service& io_service, const SocketSettings& settings, const Codec& codec)
+    : io_service_(io_service),
+    socket_(io_service),
+    read_deadline_(boost::make_shared<Deadline>(io_service, socket_)),
+    write_deadline_(boost::make_shared<Deadline>(io_service, socket_)),
+    settings_(settings),
+    codec_(codec),
+    event_log_(settings.event_log.get()),
+    connection_id_(reinterpret_cast<size_t> (this)),
+    read_stamp_(0),
+    read_buffer_(settings.buffer_pool ? settings.buffer_pool : boost::make_shared<BufferPool>(settings.read_buffer_size)) {
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "CoConnection::CoConnection()", "Creating coroutine connection : " << this);
+
+    }
+
+    template <typename Codec>
+    CoConnection<Codec>::~CoConnection() {
+
+        // an expiry that already fired may still be queued, it must not reach for the socket
+        ++read_deadline_->generation;
+        ++write_deadline_->generation;
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "CoConnection::~CoConnection()", "Destroying coroutine connection : " << this);
+
+    }
+
+    template <typename Codec>
+    void CoConnection<Codec>::arm(const boost::shared_ptr<Deadline>& deadline, size_t timeout_ms) {
+
+        ++deadline->generation;
+        deadline->timed_out = false;
+
+        if (timeout_ms == 0)
+            return;
+
+        deadline->timer.expires_from_now(boost::posix_time::milliseconds(timeout_ms));
+        deadline->timer.async_wait(boost::bind(&CoConnection<Codec>::handle_timeout, _1, deadline, deadline->generation));
+
+    }
+
+    template <typename Codec>
+    boost::system::error_code CoConnection<Codec>::disarm(const boost::shared_ptr<Deadline>& deadline, const boost::system::error_code& ec) {
+
+        ++deadline->generation;
+        deadline->timer.cancel();
+
+        if (deadline->timed_out && ec == boost::asio::error::operation_aborted)
+            return boost::asio::error::timed_out;
+        return ec;
+
+    }
+
+    template <typename Codec>
+    void CoConnection<Codec>::handle_timeout(const boost::system::error_code& ec, boost::shared_ptr<Deadline> deadline, size_t generation) {
+
+        // the connection may be gone, only a current generation says it is not
+        if (ec == boost::asio::error::operation_aborted || generation != deadline->generation)
+            return;
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "CoConnection::handle_timeout()", "Operation timed out....");
+        deadline->timed_out = true;
+        boost::system::error_code ignored;
+        deadline->socket.cancel(ignored);
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::connect(tcp::endpoint ep, SocketOptions options, size_t timeout_ms) {
+
+        boost::system::error_code error;
+
+        if (socket_.is_open())
+            co_return boost::asio::error::already_connected;
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "CoConnection::connect()", "Attempting connection to " << ep.address().to_string() << ":" << ep.port());
+
+        // set before the handshake, see SocketOptions.h
+        socket_.open(ep.protocol(), error);
+        if (error)
+            co_return error;
+        apply_socket_options(socket_, options);
+
+        read_buffer_.clear();
+        codec_.reset(); // whatever it made of the last connection's bytes is gone with them
+        boost::uint64_t started = stats_now();
+
+        arm(read_deadline_, timeout_ms);
+        co_await socket_.async_connect(ep, boost::asio::redirect_error(boost::asio::use_awaitable, error));
+        error = disarm(read_deadline_, error);
+
+        if (error) {
+
+            MODT_SOCKET_LOG_ERROR(g_Logger, "CoConnection::connect()", "Connection error : " << error.message());
+            MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT_FAILED, 0, NULL);
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+            co_return error;
+
+        }
+
+        applied_options_ = read_socket_options(socket_);
+
+        stats_add(stats_.connects, 1);
+        stats_.connect_time_ns.store(stats_now() - started, boost::memory_order_relaxed);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_CONNECT, 0, NULL);
+
+        co_return error;
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::fill(size_t timeout_ms) {
+
+        boost::system::error_code error;
+
+        char* dest = read_buffer_.prepare();
+        if (read_buffer_.space() == 0)
+            co_return boost::asio::error::message_size; // full, and what is in it is not enough
+
+        arm(read_deadline_, timeout_ms);
+        stats_add(stats_.read_calls, 1);
+        size_t bytes = co_await socket_.async_read_some(boost::asio::buffer(dest, read_buffer_.space()),
+                boost::asio::redirect_error(boost::asio::use_awaitable, error));
+        error = disarm(read_deadline_, error);
+
+        if (error) {
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "CoConnection::fill()", "Read Error : " << error.message());
+            co_return error;
+        }
+
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_RECEIVE, bytes, dest);
+        read_buffer_.commit(bytes);
+        read_stamp_ = stats_now();
+
+        if (applied_options_.quick_ack > 0) // the kernel falls back to delayed acks after a while
+            apply_quick_ack(socket_);
+        stats_add(stats_.bytes_in, bytes);
+
+        co_return error;
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::read_exactly(size_t bytes, BufferView& data, size_t timeout_ms) {
+
+        if (bytes > read_buffer_.capacity()) {
+            MODT_SOCKET_LOG_ERROR(g_Logger, "CoConnection::read_exactly()", "Attempt to read more than maximum buffer size...");
+            co_return boost::asio::error::message_size;
+        }
+
+        // the timeout covers the whole read, however many chunks it takes
+        boost::uint64_t deadline = stats_now() + timeout_ms * 1000000ULL;
+
+        while (read_buffer_.size() < bytes) {
+
+            size_t left = 0;
+            if (timeout_ms) {
+                boost::uint64_t now = stats_now();
+                if (now >= deadline)
+                    co_return boost::asio::error::timed_out;
+                left = static_cast<size_t> ((deadline - now + 999999) / 1000000);
+            }
+
+            boost::system::error_code error = co_await fill(left);
+            if (error)
+                co_return error;
+
+        }
+
+        data = read_buffer_.view(bytes);
+        read_buffer_.consume(bytes);
+
+        stats_add(stats_.messages_in, 1);
+        stats_.read_latency.record(stats_now() - read_stamp_);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DELIVER, data.size(), data.data());
+
+        co_return boost::system::error_code();
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::read_frame(BufferView& payload, size_t timeout_ms) {
+
+        boost::uint64_t deadline = stats_now() + timeout_ms * 1000000ULL;
+
+        for (;;) {
+
+            FrameInfo frame;
+            FrameStatus status = read_buffer_.empty() ? FRAME_INCOMPLETE : codec_.parse(read_buffer_.data(), read_buffer_.size(), frame);
+
+            if (status == FRAME_COMPLETE) {
+
+                payload = read_buffer_.view(frame.length).sub(frame.payload_offset, frame.payload_size);
+                read_buffer_.consume(frame.length);
+
+                stats_add(stats_.messages_in, 1);
+                stats_.read_latency.record(stats_now() - read_stamp_);
+                MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DELIVER, payload.size(), payload.data());
+
+                co_return boost::system::error_code();
+
+            }
+
+            if (status == FRAME_ERROR) {
+                MODT_SOCKET_LOG_ERROR(g_Logger, "CoConnection::read_frame()", "Invalid frame received...");
+                co_return boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+            }
+
+            if (frame.length > read_buffer_.capacity()) {
+                MODT_SOCKET_LOG_ERROR(g_Logger, "CoConnection::read_frame()", "Frame of " << frame.length << " bytes exceeds the receive buffer size...");
+                co_return boost::asio::error::message_size;
+            }
+
+            size_t left = 0;
+            if (timeout_ms) {
+                boost::uint64_t now = stats_now();
+                if (now >= deadline)
+                    co_return boost::asio::error::timed_out;
+                left = static_cast<size_t> ((deadline - now + 999999) / 1000000);
+            }
+
+            boost::system::error_code error = co_await fill(left);
+            if (error)
+                co_return error;
+
+        }
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::write(const char* data, size_t size, size_t timeout_ms) {
+
+        boost::system::error_code error;
+        boost::uint64_t started = stats_now();
+
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_WRITE, size, data);
+
+        arm(write_deadline_, timeout_ms);
+        stats_add(stats_.write_calls, 1);
+        size_t bytes = co_await boost::asio::async_write(socket_, boost::asio::buffer(data, size),
+                boost::asio::redirect_error(boost::asio::use_awaitable, error));
+        error = disarm(write_deadline_, error);
+
+        stats_add(stats_.bytes_out, bytes);
+        if (error) {
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "CoConnection::write()", "Write Error : " << error.message());
+            co_return error;
+        }
+
+        stats_add(stats_.messages_out, 1);
+        stats_.write_latency.record(stats_now() - started);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_WRITE_DONE, bytes, NULL);
+
+        co_return error;
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::write(const BufferView& data, size_t timeout_ms) {
+
+        BufferView hold = data; // the lease lasts until the write is done
+        co_return co_await write(hold.data(), hold.size(), timeout_ms);
+
+    }
+
+    template <typename Codec>
+    typename CoConnection<Codec>::Result CoConnection<Codec>::write_frame(const char* payload, size_t size, size_t timeout_ms) {
+
+        codec_.encode(payload, size, write_frame_);
+        co_return co_await write(write_frame_.data(), write_frame_.size(), timeout_ms);
+
+    }
+
+    template <typename Codec>
+    void CoConnection<Codec>::cancel() {
+
+        io_service_.post(boost::bind(&CoConnection<Codec>::do_cancel, this));
+
+    }
+
+    template <typename Codec>
+    void CoConnection<Codec>::close() {
+
+        io_service_.post(boost::bind(&CoConnection<Codec>::do_close, this));
+
+    }
+
+    template <typename Codec>
+    void CoConnection<Codec>::do_cancel() {
+
+        boost::system::error_code ignored;
+        socket_.cancel(ignored);
+
+    }
+
+    template <typename Codec>
+    void CoConnection<Codec>::do_close() {
+
+        if (!socket_.is_open())
+            return;
+
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        MODT_SOCKET_EVENT(event_log_, connection_id_, EVENT_DISCONNECT, 0, NULL);
+
+    }
+
+    template <typename Codec>
+    SocketStats CoConnection<Codec>::GetStats() const {
+
+        SocketStats stats;
+        stats_.snapshot(stats);
+        return stats;
+
+    }
+
+}
+
+#endif // BOOST_ASIO_HAS_CO_AWAIT
+
+#endif	/* COCONNECTION_H */
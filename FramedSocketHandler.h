@@ -0,0 +1,112 @@
+/*
+ * File:   FramedSocketHandler.h
+ * Author: mihiranad
+ *
+ * Socket handler for message based protocols. Frames are parsed out of the
+ * receive buffer on the io_service thread by the Codec (see Framing.h) and
+ * OnMessage is called once per frame with a view on its payload, there is
+ * no need for Read() requests. With READ_PER_BATCH OnMessageBatch gets all
+ * the frames of a socket read at once.
+ */
+
+#ifndef FRAMEDSOCKETHANDLER_H
+#define	FRAMEDSOCKETHANDLER_H
+
+#include <boost/move/utility_core.hpp>
+
+#include "SocketHandler.h"
+
+namespace modt_socket {
+
+    template <typename Codec>
+    class FramedSocketHandler : public SocketHandler {
+    public:
+
+        explicit FramedSocketHandler(const Codec& codec = Codec())
+        : codec_(codec) {
+
+            Configure(Settings());
+
+        }
+
+        // same as SocketHandler::Configure, the read mode is always READ_FRAMED
+        void Configure(SocketSettings settings) {
+
+            settings.read_mode = READ_FRAMED;
+            SocketHandler::Configure(settings);
+
+        }
+
+        // encodes the payload into a frame and queues it for writing. The frame goes into a block
+        // of the write buffer pool, no allocation once the pool is warm. Only a frame larger than
+        // write_buffer_size is encoded into a string of its own
+        WriteStatus SendMessage(const char* payload, size_t size) {
+
+            size_t frame_size = codec_.frame_size(size);
+            BufferBlockPtr block = AllocateBuffer();
+            if (frame_size <= block->capacity()) {
+                codec_.encode(payload, size, block->data());
+                return AsyncWrite(BufferView(block, frame_size));
+            }
+
+            std::string frame;
+            codec_.encode(payload, size, frame);
+            return AsyncWrite(boost::move(frame));
+
+        }
+
+        WriteStatus SendMessage(const std::string& payload) {
+
+            return SendMessage(payload.data(), payload.size());
+
+        }
+
+        // called once per received frame, the view covers the payload only
+        virtual void OnMessage(const BufferView& payload) = 0;
+
+        // with READ_PER_BATCH in the settings, called instead with all the frames of one socket
+        // read. The default implementation calls OnMessage for each
+        virtual void OnMessageBatch(const BufferView* payloads, size_t count) {
+
+            for (size_t i = 0; i < count; ++i)
+                OnMessage(payloads[i]);
+
+        }
+
+        virtual FrameStatus ParseFrame(const char* data, size_t size, FrameInfo& frame) {
+
+            return codec_.parse(data, size, frame);
+
+        }
+
+        virtual void ResetFrames() {
+
+            codec_.reset();
+
+        }
+
+        virtual void OnReceive(const BufferView& data, const boost::system::error_code& ec) {
+
+            OnMessage(data);
+
+        }
+
+        virtual void OnReceiveBatch(const BufferView* messages, size_t count) {
+
+            OnMessageBatch(messages, count);
+
+        }
+
+        // not used, frames are delivered via OnMessage
+        virtual void OnRead(const char *s, const size_t *bytes, const size_t *bytes_requested, boost::system::error_code *ec) {
+        }
+
+    protected:
+
+        Codec codec_; // only encode() may be used outside the io_service thread
+
+    };
+
+}
+
+#endif	/* FRAMEDSOCKETHANDLER_H */
@@ -0,0 +1,308 @@
+/*
+ * File:   Framing.h
+ * Author: mihiranad
+ *
+ * Message framing codecs used by the framed read mode. A codec looks at the
+ * start of the received data and tells the read actor whether a complete
+ * frame is there and where its payload is, and encodes payloads into frames
+ * for sending.
+ *
+ * Every codec provides
+ *     FrameStatus parse(const char* data, size_t size, FrameInfo& frame);
+ *     size_t frame_size(size_t payload_size) const;
+ *     void encode(const char* payload, size_t size, char* out) const; // frame_size(size) bytes at out
+ *     void encode(const char* payload, size_t size, std::string& out) const;
+ *     void reset();
+ * parse and reset are always called from the io_service thread of the
+ * connection. reset forgets whatever parse kept about the data seen so far,
+ * it is called whenever the receive buffer starts over, i.e. on every new
+ * connection and when one is dropped.
+ */
+
+#ifndef FRAMING_H
+#define	FRAMING_H
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace modt_socket {
+
+    enum FrameStatus {
+        FRAME_INCOMPLETE, // more data is needed
+        FRAME_COMPLETE, // frame describes a complete frame at the start of the data
+        FRAME_ERROR // the data can not be a valid frame, the connection is dropped
+    };
+
+    struct FrameInfo {
+
+        size_t length; // total bytes of the frame, known once the header is complete, 0 otherwise
+        size_t payload_offset; // where the payload starts within the frame
+        size_t payload_size;
+
+        FrameInfo()
+        : length(0),
+        payload_offset(0),
+        payload_size(0) {
+        }
+
+    };
+
+    enum ByteOrder {
+        FRAME_BIG_ENDIAN,
+        FRAME_LITTLE_ENDIAN
+    };
+
+    namespace framing_detail {
+
+        inline size_t read_length(const char* data, size_t bytes, ByteOrder order) {
+            const unsigned char* p = reinterpret_cast<const unsigned char*> (data);
+            size_t value = 0;
+            for (size_t i = 0; i < bytes; ++i) {
+                size_t byte = (order == FRAME_BIG_ENDIAN) ? p[i] : p[bytes - 1 - i];
+                value = (value << 8) | byte;
+            }
+            return value;
+        }
+
+        inline void write_length(char* data, size_t bytes, ByteOrder order, size_t value) {
+            for (size_t i = 0; i < bytes; ++i) {
+                size_t index = (order == FRAME_BIG_ENDIAN) ? bytes - 1 - i : i;
+                data[index] = static_cast<char> (value & 0xff);
+                value >>= 8;
+            }
+        }
+
+    }
+
+    // [N byte length][payload], the length counts the payload only
+    template <size_t Bytes, ByteOrder Order = FRAME_BIG_ENDIAN>
+    class LengthPrefixCodec {
+    public:
+
+        explicit LengthPrefixCodec(size_t max_payload = 64 * 1024)
+        : max_payload_(max_payload) {
+        }
+
+        FrameStatus parse(const char* data, size_t size, FrameInfo& frame) {
+
+            if (size < Bytes)
+                return FRAME_INCOMPLETE;
+
+            frame.payload_offset = Bytes;
+            frame.payload_size = framing_detail::read_length(data, Bytes, Order);
+            frame.length = Bytes + frame.payload_size;
+
+            if (frame.payload_size > max_payload_)
+                return FRAME_ERROR;
+
+            return size < frame.length ? FRAME_INCOMPLETE : FRAME_COMPLETE;
+
+        }
+
+        void reset() {
+        }
+
+        size_t frame_size(size_t size) const {
+
+            return Bytes + size;
+
+        }
+
+        void encode(const char* payload, size_t size, char* out) const {
+
+            framing_detail::write_length(out, Bytes, Order, size);
+            if (size)
+                memcpy(out + Bytes, payload, size);
+
+        }
+
+        void encode(const char* payload, size_t size, std::string& out) const {
+
+            out.resize(frame_size(size));
+            encode(payload, size, &out[0]);
+
+        }
+
+    private:
+
+        size_t max_payload_;
+
+    };
+
+    // [payload][delimiter], the delimiter may be one or more bytes and must not appear in the payload.
+    // Throws std::invalid_argument for an empty delimiter, which would match an empty frame forever
+    class DelimiterCodec {
+    public:
+
+        explicit DelimiterCodec(const std::string& delimiter = "\n", size_t max_payload = 64 * 1024)
+        : delimiter_(delimiter),
+        max_payload_(max_payload),
+        scanned_(0) {
+
+            if (delimiter_.empty())
+                throw std::invalid_argument("DelimiterCodec: empty delimiter");
+
+        }
+
+        FrameStatus parse(const char* data, size_t size, FrameInfo& frame) {
+
+            // carry on from where the previous call stopped rather than rescanning the partial frame.
+            // The data never shrinks between calls, but the scan is kept within it regardless
+            const char* begin = data + std::min(scanned_, size);
+            const char* end = data + size;
+            const char* found = std::search(begin, end, delimiter_.begin(), delimiter_.end());
+
+            if (found == end) {
+
+                // a delimiter may straddle the end of the data, so back off by its length less one
+                scanned_ = size >= delimiter_.size() ? size - delimiter_.size() + 1 : 0;
+                return scanned_ > max_payload_ ? FRAME_ERROR : FRAME_INCOMPLETE;
+
+            }
+
+            scanned_ = 0;
+            frame.payload_offset = 0;
+            frame.payload_size = found - data;
+            frame.length = frame.payload_size + delimiter_.size();
+
+            return frame.payload_size > max_payload_ ? FRAME_ERROR : FRAME_COMPLETE;
+
+        }
+
+        void reset() {
+
+            scanned_ = 0;
+
+        }
+
+        size_t frame_size(size_t size) const {
+
+            return size + delimiter_.size();
+
+        }
+
+        void encode(const char* payload, size_t size, char* out) const {
+
+            if (size)
+                memcpy(out, payload, size);
+            memcpy(out + size, delimiter_.data(), delimiter_.size());
+
+        }
+
+        void encode(const char* payload, size_t size, std::string& out) const {
+
+            out.resize(frame_size(size));
+            encode(payload, size, &out[0]);
+
+        }
+
+    private:
+
+        std::string delimiter_;
+        size_t max_payload_;
+        size_t scanned_; // bytes already known not to start a delimiter
+
+    };
+
+    // [fixed size header with a length field somewhere in it][payload]. length_adjust is
+    // added to the field value to get the payload size, e.g. -header_size when the field
+    // counts the whole frame. Throws std::invalid_argument unless the length field is 1 to
+    // sizeof(size_t) bytes and lies within the header
+    class FixedHeaderCodec {
+    public:
+
+        FixedHeaderCodec(size_t header_size,
+                size_t length_offset,
+                size_t length_bytes,
+                ByteOrder order = FRAME_BIG_ENDIAN,
+                long length_adjust = 0,
+                size_t max_payload = 64 * 1024)
+        : header_size_(header_size),
+        length_offset_(length_offset),
+        length_bytes_(length_bytes),
+        order_(order),
+        length_adjust_(length_adjust),
+        max_payload_(max_payload) {
+
+            if (length_bytes_ == 0 || length_bytes_ > sizeof (size_t))
+                throw std::invalid_argument("FixedHeaderCodec: length field of 1 to sizeof(size_t) bytes expected");
+            if (length_offset_ > header_size_ || length_bytes_ > header_size_ - length_offset_)
+                throw std::invalid_argument("FixedHeaderCodec: length field outside the header");
+
+        }
+
+        FrameStatus parse(const char* data, size_t size, FrameInfo& frame) {
+
+            if (size < header_size_)
+                return FRAME_INCOMPLETE;
+
+            long payload = static_cast<long> (framing_detail::read_length(data + length_offset_, length_bytes_, order_)) + length_adjust_;
+            if (payload < 0 || static_cast<size_t> (payload) > max_payload_)
+                return FRAME_ERROR;
+
+            frame.payload_offset = header_size_;
+            frame.payload_size = payload;
+            frame.length = header_size_ + frame.payload_size;
+
+            return size < frame.length ? FRAME_INCOMPLETE : FRAME_COMPLETE;
+
+        }
+
+        void reset() {
+        }
+
+        size_t frame_size(size_t size) const {
+
+            return header_size_ + size;
+
+        }
+
+        // the header is zero filled apart from the length field, use encode(header, ...) to supply one
+        void encode(const char* payload, size_t size, char* out) const {
+
+            encode(NULL, payload, size, out);
+
+        }
+
+        void encode(const char* payload, size_t size, std::string& out) const {
+
+            encode(NULL, payload, size, out);
+
+        }
+
+        void encode(const char* header, const char* payload, size_t size, char* out) const {
+
+            if (header)
+                memcpy(out, header, header_size_);
+            else
+                memset(out, 0, header_size_);
+
+            framing_detail::write_length(out + length_offset_, length_bytes_, order_, size - length_adjust_);
+            if (size)
+                memcpy(out + header_size_, payload, size);
+
+        }
+
+        void encode(const char* header, const char* payload, size_t size, std::string& out) const {
+
+            out.resize(frame_size(size));
+            encode(header, payload, size, &out[0]);
+
+        }
+
+    private:
+
+        size_t header_size_;
+        size_t length_offset_;
+        size_t length_bytes_;
+        ByteOrder order_;
+        long length_adjust_;
+        size_t max_payload_;
+
+    };
+
+}
+
+#endif	/* FRAMING_H */
@@ -0,0 +1,142 @@
+/*
+ * File:   HandlerAllocator.h
+ * Author: mihiranad
+ *
+ * Preallocated memory for handlers that are never outstanding more than
+ * once at a time, e.g. the write notification posted to the io_service
+ * thread. Wrapping such a handler with make_custom_alloc_handler() lets
+ * asio reuse the same storage for it instead of allocating on every post.
+ * Follows the allocation example that ships with asio.
+ */
+
+#ifndef HANDLERALLOCATOR_H
+#define	HANDLERALLOCATOR_H
+
+#include <new>
+
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/type_traits/aligned_storage.hpp>
+
+namespace modt_socket {
+
+    class HandlerMemory : private boost::noncopyable {
+    public:
+
+        HandlerMemory()
+        : in_use_(false) {
+        }
+
+        void* allocate(size_t size) {
+
+            // falls back to the heap if the storage is taken or too small
+            if (size <= sizeof (storage_) && !in_use_.exchange(true, boost::memory_order_acquire))
+                return storage_.address();
+            return ::operator new(size);
+
+        }
+
+        void deallocate(void* pointer) {
+
+            if (pointer == storage_.address())
+                in_use_.store(false, boost::memory_order_release);
+            else
+                ::operator delete(pointer);
+
+        }
+
+    private:
+
+        boost::aligned_storage<256> storage_;
+        boost::atomic<bool> in_use_;
+
+    };
+
+    template <typename T>
+    class HandlerAllocator {
+    public:
+
+        typedef T value_type;
+
+        template <typename U>
+        struct rebind { // needed by pre C++11 allocator traits
+            typedef HandlerAllocator<U> other;
+        };
+
+        explicit HandlerAllocator(HandlerMemory& memory)
+        : memory_(memory) {
+        }
+
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U>& other)
+        : memory_(other.memory_) {
+        }
+
+        T* allocate(size_t n) const {
+            return static_cast<T*> (memory_.allocate(sizeof (T) * n));
+        }
+
+        void deallocate(T* pointer, size_t) const {
+            memory_.deallocate(pointer);
+        }
+
+        bool operator==(const HandlerAllocator& other) const {
+            return &memory_ == &other.memory_;
+        }
+
+        bool operator!=(const HandlerAllocator& other) const {
+            return &memory_ != &other.memory_;
+        }
+
+    private:
+
+        template <typename> friend class HandlerAllocator;
+
+        HandlerMemory& memory_;
+
+    };
+
+    template <typename Handler>
+    class CustomAllocHandler {
+    public:
+
+        typedef HandlerAllocator<Handler> allocator_type;
+
+        CustomAllocHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory),
+        handler_(handler) {
+        }
+
+        allocator_type get_allocator() const {
+            return allocator_type(memory_);
+        }
+
+        void operator()() {
+            handler_();
+        }
+
+        template <typename Arg1>
+        void operator()(const Arg1& arg1) {
+            handler_(arg1);
+        }
+
+        template <typename Arg1, typename Arg2>
+        void operator()(const Arg1& arg1, const Arg2& arg2) {
+            handler_(arg1, arg2);
+        }
+
+    private:
+
+        HandlerMemory& memory_;
+        Handler handler_;
+
+    };
+
+    template <typename Handler>
+    inline CustomAllocHandler<Handler> make_custom_alloc_handler(HandlerMemory& memory, Handler handler) {
+        return CustomAllocHandler<Handler>(memory, handler);
+    }
+
+}
+
+#endif	/* HANDLERALLOCATOR_H */
@@ -0,0 +1,205 @@
+/*
+ * File:   IoRunner.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "IoRunner.h"
+
+#include <cstring>
+
+#include <boost/bind/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/future.hpp>
+
+#include "SocketLog.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+extern modt_log::LogSink g_Logger;
+
+using namespace modt_socket;
+
+namespace {
+
+    // tells the core this is a spin loop, saves power and the pipeline flush when it ends
+    inline void cpu_pause() {
+
+#if defined(__i386__) || defined(__x86_64__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+
+    }
+
+    // a run_and_wait handler, run by whichever of the io_service thread and the waiting thread claims it
+    struct WaitedHandler {
+
+        explicit WaitedHandler(const boost::function<void()>& handler)
+        : handler(handler),
+        claimed(false) {
+        }
+
+        boost::function<void()> handler;
+        boost::atomic<bool> claimed;
+        boost::promise<void> done;
+
+    };
+
+    void run_waited(boost::shared_ptr<WaitedHandler> waited) {
+
+        if (waited->claimed.exchange(true))
+            return;
+
+        waited->handler();
+        waited->done.set_value();
+
+    }
+
+    void set_thread(const RunSettings& settings, RunMetrics& metrics) {
+
+        metrics.cpu = -1;
+        metrics.rt_priority = 0;
+
+#ifdef __linux__
+        if (settings.cpu >= 0) {
+
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(settings.cpu, &cpus);
+
+            int error = pthread_setaffinity_np(pthread_self(), sizeof (cpus), &cpus);
+            if (error == 0)
+                metrics.cpu = settings.cpu;
+            else
+                MODT_SOCKET_LOG_WARN(g_Logger, "run_io_service()", "Could not pin the io thread to CPU " << settings.cpu << " : " << strerror(error));
+
+        }
+
+        if (settings.rt_priority > 0) {
+
+            struct sched_param param;
+            std::memset(&param, 0, sizeof (param));
+            param.sched_priority = settings.rt_priority;
+
+            int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (error == 0)
+                metrics.rt_priority = settings.rt_priority;
+            else
+                MODT_SOCKET_LOG_WARN(g_Logger, "run_io_service()", "Could not give the io thread SCHED_FIFO priority " << settings.rt_priority << " : " << strerror(error));
+
+        }
+#else
+        if (settings.cpu >= 0 || settings.rt_priority > 0)
+            MODT_SOCKET_LOG_WARN(g_Logger, "run_io_service()", "CPU pinning and real time priority are only supported on Linux");
+#endif
+
+    }
+
+    void busy_poll(boost::asio::io_service& io_service, const RunSettings& settings, RunMetrics& metrics) {
+
+        // counted locally and published every so often, the loop is too hot for an atomic add per poll.
+        // A handler reuses its metrics for the thread of every connection, the counts carry on
+        boost::uint64_t polls = metrics.polls.load(boost::memory_order_relaxed);
+        boost::uint64_t idle_polls = metrics.idle_polls.load(boost::memory_order_relaxed);
+        boost::uint64_t sleeps = metrics.sleeps.load(boost::memory_order_relaxed);
+
+        const boost::uint64_t idle_spin_ns = settings.idle_spin_us * 1000;
+        boost::uint64_t idle_since = 0; // 0 while the last poll ran something
+
+        while (!io_service.stopped()) {
+
+            size_t ran = io_service.poll();
+            ++polls;
+
+            if (ran) {
+
+                idle_since = 0;
+
+            } else {
+
+                ++idle_polls;
+
+                if (idle_spin_ns) {
+
+                    boost::uint64_t now = stats_now();
+                    if (!idle_since) {
+                        idle_since = now;
+                    } else if (now - idle_since >= idle_spin_ns) {
+                        // nothing for a while, wait in the reactor for the next event
+                        ++sleeps;
+                        metrics.sleeps.store(sleeps, boost::memory_order_relaxed);
+                        io_service.run_one();
+                        idle_since = 0;
+                    }
+
+                }
+
+                if (settings.pause)
+                    cpu_pause();
+
+            }
+
+            if ((polls & 1023) == 0 || ran) {
+                metrics.polls.store(polls, boost::memory_order_relaxed);
+                metrics.idle_polls.store(idle_polls, boost::memory_order_relaxed);
+            }
+
+        }
+
+        metrics.polls.store(polls, boost::memory_order_relaxed);
+        metrics.idle_polls.store(idle_polls, boost::memory_order_relaxed);
+
+    }
+
+}
+
+RunMetrics::RunMetrics()
+: mode(RUN_BLOCKING),
+cpu(-1),
+rt_priority(0),
+polls(0),
+idle_polls(0),
+sleeps(0) {
+}
+
+void RunMetrics::snapshot(SocketStats& out) const {
+
+    out.run_mode = mode.load(boost::memory_order_relaxed);
+    out.run_cpu = cpu.load(boost::memory_order_relaxed);
+    out.run_priority = rt_priority.load(boost::memory_order_relaxed);
+    out.polls = polls.load(boost::memory_order_relaxed);
+    out.idle_polls = idle_polls.load(boost::memory_order_relaxed);
+    out.poll_sleeps = sleeps.load(boost::memory_order_relaxed);
+
+}
+
+void modt_socket::run_io_service(boost::asio::io_service& io_service, const RunSettings& settings, RunMetrics& metrics) {
+
+    set_thread(settings, metrics);
+    metrics.mode = settings.mode;
+
+    if (settings.mode == RUN_BUSY_POLL)
+        busy_poll(io_service, settings, metrics);
+    else
+        io_service.run();
+
+}
+
+void modt_socket::run_and_wait(boost::asio::io_service& io_service, const boost::function<void()>& handler) {
+
+    boost::shared_ptr<WaitedHandler> waited = boost::make_shared<WaitedHandler>(handler);
+    boost::BOOST_THREAD_FUTURE<void> done = waited->done.get_future();
+    io_service.post(boost::bind(&run_waited, waited));
+
+    // nothing wakes this thread when the io_service stops, so the wait checks on it now and then
+    do {
+        if (io_service.stopped())
+            run_waited(waited);
+    } while (done.wait_for(boost::chrono::milliseconds(10)) == boost::future_status::timeout);
+
+}
@@ -0,0 +1,94 @@
+/*
+ * File:   IoRunner.h
+ * Author: mihiranad
+ *
+ * How an io thread runs its io_service. RUN_BLOCKING is plain run(): the
+ * thread sleeps in epoll between events and the scheduler puts it on any
+ * CPU. RUN_BUSY_POLL keeps calling poll() instead, so an event is picked up
+ * without a wakeup, at the cost of a core kept busy. Either mode can pin the
+ * thread to a CPU and give it a SCHED_FIFO priority, which keeps its caches
+ * warm and other threads off it:
+ *
+ *   SocketSettings settings;
+ *   settings.run.mode = RUN_BUSY_POLL;
+ *   settings.run.cpu = 3;
+ *   handler.Configure(settings); // for the thread of the next Connect
+ *
+ * A busy polling thread with idle_spin_us set goes to sleep in run_one()
+ * once it has found nothing to do for that long, and spins again after the
+ * next event. RunMetrics shows how the thread ended up running, it is part
+ * of the SocketStats of every connection on the thread.
+ *
+ * Busy polling only pays on a core of its own, e.g. one taken out of the
+ * scheduler with isolcpus. A spinning SCHED_FIFO thread on a shared CPU
+ * starves everything else there, including the threads feeding it.
+ */
+
+#ifndef IORUNNER_H
+#define	IORUNNER_H
+
+#include <boost/asio/io_service.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "SocketStats.h"
+
+namespace modt_socket {
+
+    enum RunMode {
+        RUN_BLOCKING, // io_service::run, sleeps in the reactor while there is nothing to do
+        RUN_BUSY_POLL // io_service::poll in a loop, never sleeps unless idle_spin_us says so
+    };
+
+    struct RunSettings {
+
+        RunMode mode;
+        int cpu; // the CPU the thread is pinned to, -1 for none. A pool pins thread i to cpu + i
+        int rt_priority; // SCHED_FIFO priority from 1 to 99, 0 keeps the normal policy. Needs CAP_SYS_NICE
+
+        // RUN_BUSY_POLL only. An idle thread sleeps after spinning idle_spin_us, 0 spins for good.
+        // With pause, a pause instruction between polls leaves a hyperthread sibling some room
+        size_t idle_spin_us;
+        bool pause;
+
+        RunSettings()
+        : mode(RUN_BLOCKING),
+        cpu(-1),
+        rt_priority(0),
+        idle_spin_us(0),
+        pause(true) {
+        }
+
+    };
+
+    // kept by the thread running the io_service, read by GetStats from any thread
+    class RunMetrics : private boost::noncopyable {
+    public:
+
+        RunMetrics();
+
+        // what the thread got, the CPU and priority stay -1 and 0 if the kernel refused them
+        boost::atomic<int> mode;
+        boost::atomic<int> cpu;
+        boost::atomic<int> rt_priority;
+
+        boost::atomic<boost::uint64_t> polls; // poll() calls
+        boost::atomic<boost::uint64_t> idle_polls; // of those, the ones that ran nothing
+        boost::atomic<boost::uint64_t> sleeps; // times the thread went to sleep after idle_spin_us
+
+        void snapshot(SocketStats& out) const;
+
+    };
+
+    // runs io_service on the calling thread as settings say, until it is stopped or runs out of work
+    void run_io_service(boost::asio::io_service& io_service, const RunSettings& settings, RunMetrics& metrics);
+
+    // runs handler on the thread of io_service and waits for it to return. Once io_service is
+    // stopped nothing else runs it, the calling thread does then. Not for the io_service's own thread
+    void run_and_wait(boost::asio::io_service& io_service, const boost::function<void()>& handler);
+
+}
+
+#endif	/* IORUNNER_H */
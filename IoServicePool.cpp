@@ -0,0 +1,136 @@
+/*
+ * File:   IoServicePool.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "IoServicePool.h"
+
+#include <boost/bind.hpp>
+
+using namespace modt_socket;
+
+IoServicePool::IoServicePool(size_t pool_size, PoolStrategy strategy, const RunSettings& run)
+: strategy_(strategy),
+next_(0),
+stopped_(false) {
+
+    if (pool_size == 0)
+        pool_size = boost::thread::hardware_concurrency();
+    if (pool_size == 0) // hardware_concurrency() may not be able to tell
+        pool_size = 1;
+
+    for (size_t i = 0; i < pool_size; ++i)
+        slots_.push_back(boost::shared_ptr<Slot>(new Slot));
+
+    // the threads are created once here, connecting and disconnecting handlers never creates or destroys threads
+    for (size_t i = 0; i < slots_.size(); ++i) {
+
+        RunSettings settings = run;
+        if (settings.cpu >= 0)
+            settings.cpu += i;
+
+        threads_.create_thread(boost::bind(&run_io_service, boost::ref(slots_[i]->io_service), settings, boost::ref(slots_[i]->run_metrics)));
+
+    }
+
+    MODT_SOCKET_LOG_DEBUG(g_Logger, "IoServicePool::IoServicePool()", "Started io_service pool [" << this << "] with " << slots_.size() << " threads");
+
+}
+
+IoServicePool::~IoServicePool() {
+
+    stop();
+
+}
+
+void IoServicePool::stop() {
+
+    if (stopped_)
+        return;
+
+    stopped_ = true;
+
+    for (size_t i = 0; i < slots_.size(); ++i)
+        slots_[i]->io_service.stop();
+
+    threads_.join_all();
+    MODT_SOCKET_LOG_DEBUG(g_Logger, "IoServicePool::stop()", "Stopped io_service pool [" << this << "]");
+
+}
+
+boost::asio::io_service& IoServicePool::acquire() {
+
+    size_t index = 0;
+
+    if (strategy_ == POOL_LEAST_LOADED) {
+
+        size_t least = slots_[0]->connections;
+        for (size_t i = 1; i < slots_.size(); ++i) {
+            size_t load = slots_[i]->connections;
+            if (load < least) {
+                least = load;
+                index = i;
+            }
+        }
+
+    } else {
+
+        index = next_++ % slots_.size();
+
+    }
+
+    ++slots_[index]->connections;
+    return slots_[index]->io_service;
+
+}
+
+boost::asio::io_service& IoServicePool::acquire(size_t index) {
+
+    Slot& slot = *slots_[index % slots_.size()];
+    ++slot.connections;
+    return slot.io_service;
+
+}
+
+boost::asio::io_service& IoServicePool::io_service(size_t index) {
+
+    return slots_[index % slots_.size()]->io_service;
+
+}
+
+void IoServicePool::release(boost::asio::io_service& io_service) {
+
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (&slots_[i]->io_service == &io_service) {
+            --slots_[i]->connections;
+            return;
+        }
+    }
+
+    MODT_SOCKET_LOG_ERROR(g_Logger, "IoServicePool::release()", "Released an io_service that does not belong to the pool");
+
+}
+
+size_t IoServicePool::size() const {
+
+    return slots_.size();
+
+}
+
+size_t IoServicePool::connections(size_t index) const {
+
+    return index < slots_.size() ? slots_[index]->connections.load() : 0;
+
+}
+
+const RunMetrics* IoServicePool::run_metrics(const boost::asio::io_service& io_service) const {
+
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (&slots_[i]->io_service == &io_service)
+            return &slots_[i]->run_metrics;
+    }
+
+    return NULL;
+
+}
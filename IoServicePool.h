@@ -0,0 +1,84 @@
+/*
+ * File:   IoServicePool.h
+ * Author: mihiranad
+ *
+ * A fixed set of io_service objects, each run by exactly one thread. Socket
+ * handlers attached to the pool are spread over the io_services instead of
+ * getting a thread of their own. Since every io_service has a single thread
+ * all the handlers of a connection run serialized, the io_service acts as
+ * the connection's strand. RunSettings say how the threads run, e.g. busy
+ * polling and pinned to a CPU each, see IoRunner.h.
+ */
+
+#ifndef IOSERVICEPOOL_H
+#define	IOSERVICEPOOL_H
+
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "IoRunner.h"
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+namespace modt_socket {
+
+    enum PoolStrategy {
+        POOL_ROUND_ROBIN, // hand out the io_services in turn
+        POOL_LEAST_LOADED // hand out the io_service with the fewest attached connections
+    };
+
+    class IoServicePool : private boost::noncopyable {
+    public:
+
+        // pool_size 0 means one io_service (and thread) per core. With run.cpu set, thread i is pinned to run.cpu + i
+        explicit IoServicePool(size_t pool_size = 0, PoolStrategy strategy = POOL_ROUND_ROBIN, const RunSettings& run = RunSettings());
+        virtual ~IoServicePool();
+
+        // pick an io_service for a new connection, every acquire must be matched with a release
+        boost::asio::io_service& acquire();
+        boost::asio::io_service& acquire(size_t index); // the io_service at index, e.g. the one that accepted the connection
+        void release(boost::asio::io_service& io_service);
+
+        // the io_service at index without attaching to it, e.g. for a listening socket
+        boost::asio::io_service& io_service(size_t index);
+
+        // stops all the io_services and joins the threads, called by the destructor
+        void stop();
+
+        size_t size() const;
+        size_t connections(size_t index) const; // connections currently attached to the io_service at index
+
+        // how the thread of io_service runs, NULL if the io_service is not one of the pool's
+        const RunMetrics* run_metrics(const boost::asio::io_service& io_service) const;
+
+    private:
+
+        struct Slot {
+
+            Slot() : work(io_service), connections(0) {
+            }
+
+            boost::asio::io_service io_service;
+            boost::asio::io_service::work work; // keeps run() going while no connection is attached
+            boost::atomic<size_t> connections;
+            RunMetrics run_metrics;
+
+        };
+
+        PoolStrategy strategy_;
+        std::vector<boost::shared_ptr<Slot> > slots_;
+        boost::thread_group threads_;
+        boost::atomic<size_t> next_; // round robin cursor
+        bool stopped_;
+
+    };
+
+}
+
+#endif	/* IOSERVICEPOOL_H */
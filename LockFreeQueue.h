@@ -0,0 +1,301 @@
+/*
+ * File:   LockFreeQueue.h
+ * Author: mihiranad
+ *
+ * Bounded lock free queues used to pass read and write requests from the
+ * application threads to the io_service thread. The io_service thread is
+ * always the only consumer. SpscQueue may be used when a single application
+ * thread produces, MpscQueue when several do. Capacities are rounded up to a
+ * power of two.
+ */
+
+#ifndef LOCKFREEQUEUE_H
+#define	LOCKFREEQUEUE_H
+
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/move/utility_core.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace modt_socket {
+
+    enum QueueKind {
+        QUEUE_SPSC, // one producer thread
+        QUEUE_MPSC // any number of producer threads
+    };
+
+    template <typename T>
+    class BoundedQueue : private boost::noncopyable {
+    public:
+
+        virtual ~BoundedQueue() {
+        }
+
+        // false if the queue is full
+        virtual bool try_Enqueue(const T& item) = 0;
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+        // the item is only moved from if it was enqueued
+        virtual bool try_Enqueue(T&& item) = 0;
+#endif
+        // false if the queue is empty, consumer thread only
+        virtual bool try_Dequeue(T& item) = 0;
+
+        // approximate when used concurrently
+        virtual size_t Size() const = 0;
+        virtual size_t Capacity() const = 0;
+
+        virtual QueueKind Kind() const = 0;
+
+        // consumer thread only, or while nobody else uses the queue
+        void Clear() {
+            T item;
+            while (try_Dequeue(item)) {
+            }
+        }
+
+    protected:
+
+        static size_t round_up(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity)
+                size <<= 1;
+            return size;
+        }
+
+        enum {
+            CACHE_LINE = 64
+        };
+
+    };
+
+    template <typename T>
+    class SpscQueue : public BoundedQueue<T> {
+    public:
+
+        explicit SpscQueue(size_t capacity)
+        : slots_(BoundedQueue<T>::round_up(capacity)),
+        mask_(slots_.size() - 1),
+        head_(0),
+        tail_(0) {
+        }
+
+        virtual bool try_Enqueue(const T& item) {
+
+            T* slot = claim();
+            if (!slot)
+                return false;
+
+            *slot = item;
+            publish();
+            return true;
+
+        }
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+        virtual bool try_Enqueue(T&& item) {
+
+            T* slot = claim();
+            if (!slot)
+                return false;
+
+            *slot = boost::move(item);
+            publish();
+            return true;
+
+        }
+#endif
+
+        virtual bool try_Dequeue(T& item) {
+
+            size_t head = head_.load(boost::memory_order_relaxed);
+            if (head == tail_.load(boost::memory_order_acquire))
+                return false;
+
+            item = boost::move(slots_[head & mask_]);
+            head_.store(head + 1, boost::memory_order_release);
+            return true;
+
+        }
+
+        virtual size_t Size() const {
+            return tail_.load(boost::memory_order_relaxed) - head_.load(boost::memory_order_relaxed);
+        }
+
+        virtual size_t Capacity() const {
+            return slots_.size();
+        }
+
+        virtual QueueKind Kind() const {
+            return QUEUE_SPSC;
+        }
+
+    private:
+
+        T* claim() {
+            size_t tail = tail_.load(boost::memory_order_relaxed);
+            if (tail - head_.load(boost::memory_order_acquire) == slots_.size())
+                return NULL;
+            return &slots_[tail & mask_];
+        }
+
+        void publish() {
+            tail_.store(tail_.load(boost::memory_order_relaxed) + 1, boost::memory_order_release);
+        }
+
+        std::vector<T> slots_;
+        size_t mask_;
+
+        // the consumer and producer positions live on cache lines of their own
+        char pad0_[BoundedQueue<T>::CACHE_LINE];
+        boost::atomic<size_t> head_; // next slot to consume, written by the consumer
+        char pad1_[BoundedQueue<T>::CACHE_LINE];
+        boost::atomic<size_t> tail_; // next slot to fill, written by the producer
+        char pad2_[BoundedQueue<T>::CACHE_LINE];
+
+    };
+
+    // bounded queue with a sequence number per slot, producers claim slots with a CAS on tail_
+    template <typename T>
+    class MpscQueue : public BoundedQueue<T> {
+    public:
+
+        explicit MpscQueue(size_t capacity)
+        : slots_(BoundedQueue<T>::round_up(capacity)),
+        mask_(slots_.size() - 1),
+        head_(0),
+        tail_(0) {
+
+            for (size_t i = 0; i < slots_.size(); ++i)
+                slots_[i].sequence.store(i, boost::memory_order_relaxed);
+
+        }
+
+        virtual bool try_Enqueue(const T& item) {
+
+            size_t position;
+            Slot* slot = claim(position);
+            if (!slot)
+                return false;
+
+            slot->item = item;
+            slot->sequence.store(position + 1, boost::memory_order_release);
+            return true;
+
+        }
+
+#ifndef BOOST_NO_CXX11_RVALUE_REFERENCES
+        virtual bool try_Enqueue(T&& item) {
+
+            size_t position;
+            Slot* slot = claim(position);
+            if (!slot)
+                return false;
+
+            slot->item = boost::move(item);
+            slot->sequence.store(position + 1, boost::memory_order_release);
+            return true;
+
+        }
+#endif
+
+        virtual bool try_Dequeue(T& item) {
+
+            size_t head = head_.load(boost::memory_order_relaxed);
+            Slot& slot = slots_[head & mask_];
+
+            if (slot.sequence.load(boost::memory_order_acquire) != head + 1)
+                return false; // empty, or the producer is still filling the slot
+
+            item = boost::move(slot.item);
+            slot.sequence.store(head + slots_.size(), boost::memory_order_release);
+            head_.store(head + 1, boost::memory_order_relaxed);
+            return true;
+
+        }
+
+        virtual size_t Size() const {
+            size_t tail = tail_.load(boost::memory_order_relaxed);
+            size_t head = head_.load(boost::memory_order_relaxed);
+            return tail > head ? tail - head : 0;
+        }
+
+        virtual size_t Capacity() const {
+            return slots_.size();
+        }
+
+        virtual QueueKind Kind() const {
+            return QUEUE_MPSC;
+        }
+
+    private:
+
+        struct Slot {
+
+            Slot() : sequence(0) {
+            }
+
+            Slot(const Slot& other) : sequence(other.sequence.load()), item(other.item) {
+            }
+
+            boost::atomic<size_t> sequence;
+            T item;
+
+        };
+
+        // reserves the next free slot for the calling producer, NULL if the queue is full
+        Slot* claim(size_t& position) {
+
+            size_t tail = tail_.load(boost::memory_order_relaxed);
+
+            for (;;) {
+
+                Slot& slot = slots_[tail & mask_];
+                size_t sequence = slot.sequence.load(boost::memory_order_acquire);
+                long diff = static_cast<long> (sequence) - static_cast<long> (tail);
+
+                if (diff == 0) {
+
+                    // the slot is free, claim it
+                    if (tail_.compare_exchange_weak(tail, tail + 1, boost::memory_order_relaxed)) {
+                        position = tail;
+                        return &slot;
+                    }
+
+                } else if (diff < 0) {
+
+                    return NULL; // full, the consumer has not freed the slot yet
+
+                } else {
+
+                    tail = tail_.load(boost::memory_order_relaxed); // another producer took it
+
+                }
+
+            }
+
+        }
+
+        std::vector<Slot> slots_;
+        size_t mask_;
+
+        char pad0_[BoundedQueue<T>::CACHE_LINE];
+        boost::atomic<size_t> head_; // only the consumer moves it
+        char pad1_[BoundedQueue<T>::CACHE_LINE];
+        boost::atomic<size_t> tail_; // shared by the producers
+        char pad2_[BoundedQueue<T>::CACHE_LINE];
+
+    };
+
+    template <typename T>
+    BoundedQueue<T>* make_queue(QueueKind kind, size_t capacity) {
+
+        if (kind == QUEUE_SPSC)
+            return new SpscQueue<T>(capacity);
+        return new MpscQueue<T>(capacity);
+
+    }
+
+}
+
+#endif	/* LOCKFREEQUEUE_H */
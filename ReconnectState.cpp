@@ -0,0 +1,51 @@
+/*
+ * File:   ReconnectState.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "ReconnectState.h"
+
+using namespace modt_socket;
+
+ReconnectState::ReconnectState(boost::uint64_t seed)
+: index_(0),
+attempt_(0),
+jitter_state_(seed | 1) {
+}
+
+void ReconnectState::reset(const StreamEndpoint& ep, const ReconnectPolicy& policy) {
+
+    endpoints_.clear();
+    endpoints_.push_back(ep);
+    endpoints_.insert(endpoints_.end(), policy.alternate_endpoints.begin(), policy.alternate_endpoints.end());
+    index_ = 0;
+    attempt_ = 0;
+
+}
+
+void ReconnectState::next_endpoint() {
+
+    if (!endpoints_.empty())
+        index_ = (index_ + 1) % endpoints_.size();
+
+}
+
+size_t ReconnectState::next_delay_ms(const ReconnectPolicy& policy) {
+
+    double delay = static_cast<double> (policy.initial_delay_ms);
+    for (size_t i = 0; i < attempt_ && delay < policy.max_delay_ms; ++i)
+        delay *= policy.multiplier;
+    if (delay > policy.max_delay_ms)
+        delay = static_cast<double> (policy.max_delay_ms);
+    ++attempt_;
+
+    // xorshift64, all the connections of a failed peer should not come back at the same moment
+    jitter_state_ ^= jitter_state_ << 13;
+    jitter_state_ ^= jitter_state_ >> 7;
+    jitter_state_ ^= jitter_state_ << 17;
+    double random = static_cast<double> (jitter_state_ >> 11) / static_cast<double> (1ULL << 53);
+
+    return static_cast<size_t> (delay - delay * policy.jitter * random);
+
+}
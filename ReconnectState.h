@@ -0,0 +1,100 @@
+/*
+ * File:   ReconnectState.h
+ * Author: mihiranad
+ *
+ * What a connection with a ReconnectPolicy in its settings keeps between its
+ * connections: the endpoints to go back to, the consecutive failed attempts
+ * and the backoff before the next one. The connection itself only decides
+ * when to drop and when to connect, see AsioSocket::schedule_reconnect.
+ */
+
+#ifndef RECONNECTSTATE_H
+#define	RECONNECTSTATE_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include "StreamEndpoint.h"
+
+namespace modt_socket {
+
+    // reconnects a connection that failed or dropped without tearing it down, the io thread,
+    // timers, buffers and queues are kept. Attempt n waits initial_delay_ms * multiplier^n,
+    // capped at max_delay_ms, less a random part of up to jitter of it. A failed attempt moves
+    // on to the next endpoint, the one connected to first followed by alternate_endpoints
+    struct ReconnectPolicy {
+
+        bool enabled;
+        size_t max_attempts; // consecutive failed attempts before giving up, 0 never gives up
+        size_t initial_delay_ms;
+        size_t max_delay_ms;
+        double multiplier;
+        double jitter; // 0 to 1
+        std::vector<StreamEndpoint> alternate_endpoints; // tcp::endpoints convert
+
+        // messages queued but not yet written when the connection dropped are sent on the new
+        // connection, otherwise they are discarded. A message that was only partly written is
+        // sent again in full, one that was fully handed to the old socket is not
+        bool replay_unsent;
+
+        ReconnectPolicy()
+        : enabled(false),
+        max_attempts(0),
+        initial_delay_ms(100),
+        max_delay_ms(10000),
+        multiplier(2.0),
+        jitter(0.2),
+        replay_unsent(false) {
+        }
+
+    };
+
+    class ReconnectState {
+    public:
+
+        // seed picks the jitter, connections of the same peer should each have their own
+        explicit ReconnectState(boost::uint64_t seed);
+
+        // the endpoint connected to first followed by the policy's alternates, from the first attempt
+        void reset(const StreamEndpoint& ep, const ReconnectPolicy& policy);
+
+        // accepted connections have no endpoints to go back to
+        bool empty() const {
+            return endpoints_.empty();
+        }
+
+        const StreamEndpoint& endpoint() const {
+            return endpoints_[index_];
+        }
+
+        // a failed attempt moves on, a drop retries the endpoint that was working
+        void next_endpoint();
+
+        void connected() {
+            attempt_ = 0;
+        }
+
+        size_t attempts() const { // consecutive failed attempts
+            return attempt_;
+        }
+
+        bool exhausted(const ReconnectPolicy& policy) const {
+            return policy.max_attempts && attempt_ >= policy.max_attempts;
+        }
+
+        // the wait before the next attempt, which it counts
+        size_t next_delay_ms(const ReconnectPolicy& policy);
+
+    private:
+
+        std::vector<StreamEndpoint> endpoints_; // the one connected to first, then the alternates
+        size_t index_;
+        size_t attempt_;
+        boost::uint64_t jitter_state_; // xorshift state for the backoff jitter
+
+    };
+
+}
+
+#endif	/* RECONNECTSTATE_H */
@@ -0,0 +1,122 @@
+/*
+ * File:   RingBuffer.h
+ * Author: mihiranad
+ *
+ * Receive buffer used by the read actor. Bytes are appended at the tail by
+ * async_read_some and consumed from the head when delivered to the handler.
+ * The readable region is always kept contiguous so that it can be handed to
+ * a callback as a single view; instead of wrapping around the end of the
+ * storage the (usually small) unconsumed remainder is moved back to the
+ * front once the tail runs out of room.
+ *
+ * The storage is a pooled block. Delivered data is handed out as views on
+ * the block, so while a view is still held the consumed bytes must not be
+ * overwritten; in that case the remainder is moved to a fresh block from the
+ * pool instead.
+ */
+
+#ifndef RINGBUFFER_H
+#define	RINGBUFFER_H
+
+#include <cstring>
+
+#include "BufferPool.h"
+
+namespace modt_socket {
+
+    class RingBuffer {
+    public:
+
+        explicit RingBuffer(const boost::shared_ptr<BufferPool>& pool)
+        : pool_(pool),
+        block_(pool->acquire()),
+        head_(0),
+        tail_(0) {
+        }
+
+        // readable region....
+        const char* data() const {
+            return block_->data() + head_;
+        }
+
+        size_t size() const {
+            return tail_ - head_;
+        }
+
+        bool empty() const {
+            return head_ == tail_;
+        }
+
+        bool full() const {
+            return size() == capacity();
+        }
+
+        size_t capacity() const {
+            return block_->capacity();
+        }
+
+        // the block behind both regions, e.g. to keep it alive while the kernel writes into it
+        const BufferBlockPtr& block() const {
+            return block_;
+        }
+
+        // a view on the first bytes of the readable region, valid for as long as it is held
+        BufferView view(size_t bytes) const {
+            return BufferView(block_, data(), bytes < size() ? bytes : size());
+        }
+
+        void consume(size_t bytes) {
+            head_ += (bytes < size() ? bytes : size());
+            if (head_ == tail_ && block_->unique()) // nothing left and nobody is looking, rewind for free
+                head_ = tail_ = 0;
+        }
+
+        // writable region, makes room if the tail is running short of space
+        char* prepare() {
+            if (head_ > 0 && capacity() - tail_ < capacity() / 4) {
+
+                if (block_->unique()) {
+
+                    memmove(block_->data(), block_->data() + head_, size());
+
+                } else { // consumed data is still leased, move the remainder instead of overwriting it
+
+                    BufferBlockPtr fresh = pool_->acquire();
+                    memcpy(fresh->data(), block_->data() + head_, size());
+                    block_.swap(fresh);
+
+                }
+
+                tail_ -= head_;
+                head_ = 0;
+
+            }
+            return block_->data() + tail_;
+        }
+
+        size_t space() const {
+            return capacity() - tail_;
+        }
+
+        void commit(size_t bytes) {
+            tail_ += (bytes < space() ? bytes : space());
+        }
+
+        void clear() {
+            head_ = tail_ = 0;
+            if (!block_->unique())
+                block_ = pool_->acquire();
+        }
+
+    private:
+
+        boost::shared_ptr<BufferPool> pool_;
+        BufferBlockPtr block_;
+        size_t head_; // first unconsumed byte
+        size_t tail_; // one past the last received byte
+
+    };
+
+}
+
+#endif	/* RINGBUFFER_H */
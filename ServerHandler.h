@@ -0,0 +1,391 @@
+/*
+ * File:   ServerHandler.h
+ * Author: mihiranad
+ *
+ * The server side counterpart of SocketHandler. Listen() opens the listening
+ * sockets (see AsioAcceptor.h) and every accepted connection gets a
+ * Connection of its own, any BasicSocketHandler, e.g. a SocketHandler
+ * subclass. The connections run on an IoServicePool and are owned by the
+ * server; a connection that is done with, typically from its OnClose, is
+ * handed back with Close():
+ *
+ *   class Session : public SocketHandler { ... OnDisconnect() { server->Close(this); } };
+ *
+ *   ServerHandler<Session> server;
+ *   server.Listen("0.0.0.0", "9000");
+ *
+ * or ListenLocal("/tmp/session.sock") for peers on the same host. A server
+ * that overrides CreateConnection or OnAccept should Stop() in its own
+ * destructor, the acceptors call them until they are stopped.
+ */
+
+#ifndef SERVERHANDLER_H
+#define	SERVERHANDLER_H
+
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "AsioAcceptor.h"
+#include "IoServicePool.h"
+
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+namespace modt_socket {
+
+    template <typename ConnectionType>
+    class ServerHandler {
+    public:
+
+        typedef ConnectionType Connection;
+        typedef AsioAcceptor<ServerHandler> Acceptor;
+
+        ServerHandler();
+        virtual ~ServerHandler();
+
+        // the connections run on this pool, it must outlive the server. Without one the server makes
+        // a pool of its own with a thread per core at Listen. Takes effect on the next Listen
+        void SetIoServicePool(IoServicePool* pool);
+
+        // listens on ip:port, port 0 picks a free one, see Port()
+        boost::system::error_code Listen(const char* ip, const char* port, const ServerSettings& settings = ServerSettings());
+
+        // listens on a Unix-domain socket, with a single listening socket. A socket file left
+        // behind at the path is removed first, and the path is removed again by Stop
+        boost::system::error_code ListenLocal(const char* path, const ServerSettings& settings = ServerSettings());
+
+        // stops accepting and closes every connection, not to be called from a connection's callback
+        void Stop();
+
+        // disconnects and deletes the connection, from any thread including its own callbacks
+        void Close(Connection* connection);
+
+        unsigned short Port() const; // the port listened on, 0 when not listening or listening locally
+        size_t Listeners() const; // listening sockets, more than one with SO_REUSEPORT
+        size_t Connections() const; // connections currently open
+        boost::uint64_t Accepted() const; // connections accepted since Listen
+
+        // a connection for the next accept, called on an acceptor thread. Configure it here,
+        // the default is a default constructed Connection
+        virtual Connection* CreateConnection();
+
+        // the connection was accepted, called on an acceptor thread before the connection starts
+        virtual void OnAccept(Connection& connection) {
+        }
+
+    private:
+
+        friend class AsioAcceptor<ServerHandler>;
+
+        ServerHandler(const ServerHandler& orig);
+
+        boost::system::error_code listen(StreamEndpoint ep, ServerSettings settings);
+
+        // called by the acceptors
+        Connection* create_connection();
+        void connection_accepted(Connection* connection, size_t index);
+        void connection_abandoned(Connection* connection);
+
+        // connections handed back with Close that are still to be deleted. Shared with the posted
+        // deletions, which may run after the server is gone, or never if the pool stops first
+        struct Closing {
+
+            boost::mutex mutex;
+            std::set<Connection*> connections;
+
+        };
+
+        // runs on the connection's io_service thread, after the callback that closed it has returned
+        static void destroy_connection(boost::shared_ptr<Closing> closing, Connection* connection) {
+
+            {
+                boost::mutex::scoped_lock lock(closing->mutex);
+                if (closing->connections.erase(connection) == 0)
+                    return; // deleted by Stop
+            }
+            delete connection;
+
+        }
+
+        IoServicePool* pool_;
+        boost::scoped_ptr<IoServicePool> own_pool_;
+
+        std::vector<boost::shared_ptr<Acceptor> > acceptors_;
+        std::string local_path_; // of the Unix-domain socket listened on, removed by Stop
+
+        mutable boost::mutex mutex_; // guards the two below, the acceptors run on many threads
+        std::map<Connection*, size_t> connections_; // the io_service index of every open connection
+        std::vector<Connection*> abandoned_; // created for an accept that never happened
+        boost::shared_ptr<Closing> closing_; // taken under mutex_ as well, so Stop sees a connection in one place or the other
+
+    };
+
+    template <typename ConnectionType>
+    ServerHandler<ConnectionType>::ServerHandler()
+    : pool_(NULL),
+    closing_(boost::make_shared<Closing>()) {
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "ServerHandler::ServerHandler()", "Creating server handler : " << this);
+
+    }
+
+    template <typename ConnectionType>
+    ServerHandler<ConnectionType>::~ServerHandler() {
+
+        Stop();
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "ServerHandler::~ServerHandler()", "Destroying server handler : " << this);
+
+    }
+
+    template <typename ConnectionType>
+    void ServerHandler<ConnectionType>::SetIoServicePool(IoServicePool* pool) {
+
+        if (!acceptors_.empty()) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "ServerHandler::SetIoServicePool()", "Pool change attempted while listening, nothing will be done...");
+            return;
+
+        }
+
+        pool_ = pool;
+
+    }
+
+    template <typename ConnectionType>
+    boost::system::error_code ServerHandler<ConnectionType>::Listen(const char* ip, const char* port, const ServerSettings& settings) {
+
+        return listen(make_tcp_endpoint(ip, port), settings);
+
+    }
+
+    template <typename ConnectionType>
+    boost::system::error_code ServerHandler<ConnectionType>::ListenLocal(const char* path, const ServerSettings& settings) {
+
+        if (!acceptors_.empty())
+            return listen(make_local_endpoint(path), settings); // only to warn
+
+        // the socket file of a server that went away without Stop, anything else is left alone
+        struct stat info;
+        if (::lstat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+            ::unlink(path);
+
+        ServerSettings local_settings = settings;
+        local_settings.reuse_port = false;
+        boost::system::error_code error = listen(make_local_endpoint(path), local_settings);
+        if (!error)
+            local_path_ = path;
+        return error;
+
+    }
+
+    template <typename ConnectionType>
+    boost::system::error_code ServerHandler<ConnectionType>::listen(StreamEndpoint ep, ServerSettings settings) {
+
+        if (!acceptors_.empty()) {
+
+            MODT_SOCKET_LOG_WARN(g_Logger, "ServerHandler::Listen()", "Listen attempted when already listening, nothing will be done...");
+            return boost::asio::error::already_started;
+
+        }
+
+        IoServicePool* pool = pool_;
+        if (!pool) {
+            if (!own_pool_)
+                own_pool_.reset(new IoServicePool);
+            pool = own_pool_.get();
+        }
+
+        size_t count = settings.reuse_port ? pool->size() : 1;
+        double rate = settings.max_accept_rate / count;
+
+        boost::system::error_code error;
+        for (size_t i = 0; i < count && !error; ++i) {
+
+            boost::shared_ptr<Acceptor> acceptor(new Acceptor(*pool, i, this, settings, rate));
+            error = acceptor->listen(ep);
+
+            if (error == boost::asio::error::operation_not_supported && i == 0) {
+
+                MODT_SOCKET_LOG_WARN(g_Logger, "ServerHandler::Listen()", "SO_REUSEPORT not available, using a single listening socket");
+                settings.reuse_port = false;
+                count = 1;
+                rate = settings.max_accept_rate;
+                acceptor.reset(new Acceptor(*pool, i, this, settings, rate));
+                error = acceptor->listen(ep);
+
+            }
+
+            if (!error) {
+                acceptors_.push_back(acceptor);
+                if (i == 0) // the others have to share the port the kernel picked for port 0
+                    ep = acceptor->local_endpoint();
+            }
+
+        }
+
+        if (error) {
+            acceptors_.clear(); // nothing has been started, closing the listening sockets is all there is
+            return error;
+        }
+
+        pool_ = pool;
+        for (size_t i = 0; i < acceptors_.size(); ++i)
+            pool->io_service(i).post(boost::bind(&Acceptor::start, acceptors_[i]));
+
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "ServerHandler::Listen()", "Listening with " << acceptors_.size() << " acceptors on " << endpoint_name(ep));
+        return error;
+
+    }
+
+    template <typename ConnectionType>
+    void ServerHandler<ConnectionType>::Stop() {
+
+        // the acceptors stop first so no connection is added behind our back
+        for (size_t i = 0; i < acceptors_.size(); ++i)
+            run_and_wait(pool_->io_service(i), boost::bind(&Acceptor::abort, acceptors_[i]));
+        acceptors_.clear();
+
+        if (!local_path_.empty()) {
+            ::unlink(local_path_.c_str());
+            local_path_.clear();
+        }
+
+        // the threads of a pool of our own are joined before the connections go, which are then
+        // aborted on this thread and are sure to get no further callbacks
+        bool own_pool = own_pool_ && pool_ == own_pool_.get();
+        if (own_pool)
+            own_pool_->stop();
+
+        std::map<Connection*, size_t> connections;
+        std::set<Connection*> closing;
+        std::vector<Connection*> abandoned;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            boost::mutex::scoped_lock closing_lock(closing_->mutex);
+            connections.swap(connections_);
+            closing.swap(closing_->connections);
+            abandoned.swap(abandoned_);
+        }
+
+        // deleting a connection disconnects it, and no callback is made into it after that.
+        // Those Close handed back are deleted here too, their posted deletion finds them gone
+        for (typename std::map<Connection*, size_t>::iterator it = connections.begin(); it != connections.end(); ++it)
+            delete it->first;
+        for (typename std::set<Connection*>::iterator it = closing.begin(); it != closing.end(); ++it)
+            delete *it;
+        for (size_t i = 0; i < abandoned.size(); ++i)
+            delete abandoned[i];
+
+        if (own_pool) { // the next Listen starts a new one
+            own_pool_.reset();
+            pool_ = NULL;
+        }
+
+        if (!connections.empty() || !closing.empty())
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "ServerHandler::Stop()", "Closed " << connections.size() + closing.size() << " connections");
+
+    }
+
+    template <typename ConnectionType>
+    void ServerHandler<ConnectionType>::Close(Connection* connection) {
+
+        size_t index = 0;
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            typename std::map<Connection*, size_t>::iterator it = connections_.find(connection);
+            if (it == connections_.end())
+                return; // closed already, or by Stop
+            index = it->second;
+            connections_.erase(it);
+
+            boost::mutex::scoped_lock closing_lock(closing_->mutex);
+            closing_->connections.insert(connection);
+        }
+
+        // posted, the connection may be in the middle of one of its own callbacks. Should the
+        // pool stop before it runs, Stop deletes the connection
+        pool_->io_service(index).post(boost::bind(&ServerHandler::destroy_connection, closing_, connection));
+
+    }
+
+    template <typename ConnectionType>
+    unsigned short ServerHandler<ConnectionType>::Port() const {
+
+        return acceptors_.empty() ? 0 : endpoint_port(acceptors_[0]->local_endpoint());
+
+    }
+
+    template <typename ConnectionType>
+    size_t ServerHandler<ConnectionType>::Listeners() const {
+
+        return acceptors_.size();
+
+    }
+
+    template <typename ConnectionType>
+    size_t ServerHandler<ConnectionType>::Connections() const {
+
+        boost::mutex::scoped_lock lock(mutex_);
+        return connections_.size();
+
+    }
+
+    template <typename ConnectionType>
+    boost::uint64_t ServerHandler<ConnectionType>::Accepted() const {
+
+        boost::uint64_t accepted = 0;
+        for (size_t i = 0; i < acceptors_.size(); ++i)
+            accepted += acceptors_[i]->accepted();
+        return accepted;
+
+    }
+
+    template <typename ConnectionType>
+    ConnectionType* ServerHandler<ConnectionType>::CreateConnection() {
+
+        return new Connection;
+
+    }
+
+    template <typename ConnectionType>
+    ConnectionType* ServerHandler<ConnectionType>::create_connection() {
+
+        return CreateConnection();
+
+    }
+
+    template <typename ConnectionType>
+    void ServerHandler<ConnectionType>::connection_accepted(Connection* connection, size_t index) {
+
+        {
+            boost::mutex::scoped_lock lock(mutex_);
+            connections_[connection] = index;
+        }
+
+        OnAccept(*connection);
+
+    }
+
+    template <typename ConnectionType>
+    void ServerHandler<ConnectionType>::connection_abandoned(Connection* connection) {
+
+        boost::mutex::scoped_lock lock(mutex_);
+        abandoned_.push_back(connection);
+
+    }
+
+}
+
+#endif	/* SERVERHANDLER_H */
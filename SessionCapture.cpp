@@ -0,0 +1,274 @@
+/*
+ * File:   SessionCapture.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "SessionCapture.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/asio/error.hpp>
+#include <boost/atomic/atomic_ref.hpp>
+#include <boost/chrono.hpp>
+
+#include "SocketLog.h"
+#include "SocketStats.h"
+
+extern modt_log::LogSink g_Logger;
+
+using namespace modt_socket;
+
+namespace {
+
+    const char CAPTURE_MAGIC[8] = {'M', 'O', 'D', 'T', 'C', 'A', 'P', '\0'};
+
+    inline size_t capture_align(size_t size) {
+        return (size + CAPTURE_ALIGNMENT - 1) & ~static_cast<size_t> (CAPTURE_ALIGNMENT - 1);
+    }
+
+    inline boost::system::error_code last_error() {
+        return boost::system::error_code(errno, boost::system::system_category());
+    }
+
+}
+
+const char* modt_socket::capture_kind_name(CaptureKind kind) {
+
+    switch (kind) {
+        case CAPTURE_NONE: return "none";
+        case CAPTURE_CONNECT: return "connect";
+        case CAPTURE_IN: return "in";
+        case CAPTURE_OUT: return "out";
+        case CAPTURE_CLOSE: return "close";
+    }
+    return "unknown";
+
+}
+
+SessionCapture::SessionCapture()
+: fd_(-1),
+base_(NULL),
+capacity_(0),
+tail_(0),
+dropped_(0) {
+}
+
+SessionCapture::~SessionCapture() {
+
+    close();
+
+}
+
+boost::system::error_code SessionCapture::open(const std::string& path, size_t capacity) {
+
+    if (base_ || fd_ >= 0)
+        return boost::asio::error::already_open;
+
+    capacity &= ~static_cast<size_t> (CAPTURE_ALIGNMENT - 1);
+    if (capacity < sizeof (CaptureFileHeader) + sizeof (CaptureRecord))
+        return boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0)
+        return last_error();
+
+    // the blocks are allocated now, a full disk would otherwise be a SIGBUS on some later record
+    int error = posix_fallocate(fd_, 0, capacity);
+    if (error == EOPNOTSUPP || error == EINVAL)
+        error = ftruncate(fd_, capacity) == 0 ? 0 : errno;
+
+    void* base = error ? MAP_FAILED : mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) {
+
+        boost::system::error_code ec(error ? error : errno, boost::system::system_category());
+        ::close(fd_);
+        fd_ = -1;
+        ::unlink(path.c_str());
+        return ec;
+
+    }
+
+    CaptureFileHeader* header = static_cast<CaptureFileHeader*> (base);
+    std::memcpy(header->magic, CAPTURE_MAGIC, sizeof (header->magic));
+    header->version = CAPTURE_VERSION;
+    header->header_size = sizeof (CaptureFileHeader);
+    header->started = stats_now();
+    header->started_wall_ns = boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+            boost::chrono::system_clock::now().time_since_epoch()).count();
+    header->length = 0;
+
+    capacity_ = capacity;
+    path_ = path;
+    tail_.store(sizeof (CaptureFileHeader));
+    base_ = static_cast<char*> (base);
+
+    MODT_SOCKET_LOG_INFO(g_Logger, "SessionCapture::open()", "Capturing to " << path << ", " << capacity << " bytes");
+    return boost::system::error_code();
+
+}
+
+void SessionCapture::record(boost::uint64_t connection, CaptureKind kind, const char* data, size_t size) {
+
+    char* base = base_;
+    if (!base)
+        return;
+
+    // reserve the space, nothing is reserved once the file is full so the tail stays where the records end
+    size_t total = sizeof (CaptureRecord) + capture_align(size);
+    size_t offset = tail_.load(boost::memory_order_relaxed);
+    do {
+        if (total > capacity_ - offset) {
+            dropped_.fetch_add(1, boost::memory_order_relaxed);
+            return;
+        }
+    } while (!tail_.compare_exchange_weak(offset, offset + total, boost::memory_order_relaxed));
+
+    CaptureRecord* record = reinterpret_cast<CaptureRecord*> (base + offset);
+    record->timestamp = stats_now();
+    record->connection = connection;
+    record->size = static_cast<boost::uint32_t> (size);
+    if (size)
+        std::memcpy(record + 1, data, size);
+
+    // a reader that finds the kind set finds the rest of the record as well
+    boost::atomic_ref<boost::uint32_t>(record->kind).store(kind, boost::memory_order_release);
+
+}
+
+void SessionCapture::close() {
+
+    if (!base_)
+        return;
+
+    size_t tail = tail_.load();
+    reinterpret_cast<CaptureFileHeader*> (base_)->length = tail - sizeof (CaptureFileHeader);
+
+    munmap(base_, capacity_);
+    base_ = NULL;
+
+    if (ftruncate(fd_, tail) != 0)
+        MODT_SOCKET_LOG_WARN(g_Logger, "SessionCapture::close()", "Could not truncate " << path_ << " : " << strerror(errno));
+    ::close(fd_);
+    fd_ = -1;
+
+    if (dropped())
+        MODT_SOCKET_LOG_WARN(g_Logger, "SessionCapture::close()", dropped() << " records did not fit into " << path_);
+    MODT_SOCKET_LOG_INFO(g_Logger, "SessionCapture::close()", "Closed capture " << path_ << ", " << tail << " bytes");
+
+}
+
+size_t SessionCapture::size() const {
+
+    return tail_.load(boost::memory_order_relaxed);
+
+}
+
+size_t SessionCapture::dropped() const {
+
+    return dropped_.load(boost::memory_order_relaxed);
+
+}
+
+CaptureReader::CaptureReader()
+: fd_(-1),
+base_(NULL),
+mapped_(0),
+size_(0),
+offset_(0) {
+}
+
+CaptureReader::~CaptureReader() {
+
+    close();
+
+}
+
+boost::system::error_code CaptureReader::open(const std::string& path) {
+
+    close();
+
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+        return last_error();
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        boost::system::error_code ec = last_error();
+        close();
+        return ec;
+    }
+
+    if (static_cast<size_t> (st.st_size) < sizeof (CaptureFileHeader)) {
+        close();
+        return boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+    }
+
+    void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+    if (base == MAP_FAILED) {
+        boost::system::error_code ec = last_error();
+        close();
+        return ec;
+    }
+
+    base_ = static_cast<const char*> (base);
+    mapped_ = st.st_size;
+    size_ = st.st_size;
+
+    const CaptureFileHeader& file = header();
+    if (std::memcmp(file.magic, CAPTURE_MAGIC, sizeof (file.magic)) != 0 || file.version != CAPTURE_VERSION
+            || file.header_size < sizeof (CaptureFileHeader) || file.header_size > size_) {
+        close();
+        return boost::system::errc::make_error_code(boost::system::errc::invalid_argument);
+    }
+
+    // a capture that was not closed is as long as the file, its records end at the first kind still 0
+    if (file.length && file.header_size + file.length <= size_)
+        size_ = file.header_size + file.length;
+
+    rewind();
+    return boost::system::error_code();
+
+}
+
+void CaptureReader::close() {
+
+    if (base_)
+        munmap(const_cast<char*> (base_), mapped_);
+    base_ = NULL;
+    mapped_ = 0;
+    size_ = 0;
+    offset_ = 0;
+
+    if (fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+
+}
+
+bool CaptureReader::next(CaptureRecord& record, const char*& payload) {
+
+    if (!base_ || size_ - offset_ < sizeof (CaptureRecord))
+        return false;
+
+    std::memcpy(&record, base_ + offset_, sizeof (record));
+    if (record.kind == CAPTURE_NONE || capture_align(record.size) > size_ - offset_ - sizeof (CaptureRecord))
+        return false;
+
+    payload = base_ + offset_ + sizeof (CaptureRecord);
+    offset_ += sizeof (CaptureRecord) + capture_align(record.size);
+    return true;
+
+}
+
+void CaptureReader::rewind() {
+
+    offset_ = base_ ? header().header_size : 0;
+
+}
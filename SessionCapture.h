@@ -0,0 +1,140 @@
+/*
+ * File:   SessionCapture.h
+ * Author: mihiranad
+ *
+ * Records what connections receive and write into a memory mapped, append
+ * only file, for replaying real traffic later (see bench/SessionReplay.cpp).
+ * A capture is set in the settings of the connections to record, and may be
+ * shared by any number of them:
+ *
+ *   boost::shared_ptr<SessionCapture> capture(new SessionCapture);
+ *   if (!capture->open("/var/tmp/feed.cap", 1024 * 1024 * 1024)) {
+ *       settings.capture = capture;
+ *       handler.Configure(settings);
+ *   }
+ *
+ * The file is allocated to its full capacity on open and mapped, so a record
+ * costs a compare and swap on the write offset and a memcpy, on the thread
+ * that received or wrote the data. Nothing is flushed explicitly, the pages
+ * go to disk as the kernel sees fit and at close, and survive the process
+ * dying. Once the capacity is used up further records are dropped.
+ *
+ * The file is a CaptureFileHeader followed by records, each a CaptureRecord
+ * and its payload padded to 8 bytes. A record's kind is written last, a
+ * reader stops at the first one that is still 0. CaptureReader walks them.
+ */
+
+#ifndef SESSIONCAPTURE_H
+#define	SESSIONCAPTURE_H
+
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace modt_socket {
+
+    enum CaptureKind {
+        CAPTURE_NONE, // not written yet, the end of the capture
+        CAPTURE_CONNECT, // a connection was made or accepted, no payload
+        CAPTURE_IN, // bytes received from the socket
+        CAPTURE_OUT, // bytes written to the socket
+        CAPTURE_CLOSE // the connection was dropped, or closed by Disconnect, no payload
+    };
+
+    const char* capture_kind_name(CaptureKind kind);
+
+    enum {
+        CAPTURE_VERSION = 1,
+        CAPTURE_ALIGNMENT = 8
+    };
+
+    struct CaptureFileHeader {
+
+        char magic[8]; // "MODTCAP\0"
+        boost::uint32_t version;
+        boost::uint32_t header_size; // where the first record is
+        boost::uint64_t started; // stats_now() at open, the record timestamps are on the same clock
+        boost::uint64_t started_wall_ns; // the same moment as nanoseconds since the epoch
+        boost::uint64_t length; // bytes of records, set at close. 0 if the process did not get there
+        char reserved[24];
+
+    };
+
+    struct CaptureRecord {
+
+        boost::uint64_t timestamp; // stats_now()
+        boost::uint64_t connection; // the socket handler's address, as in the event log
+        boost::uint32_t kind; // a CaptureKind
+        boost::uint32_t size; // payload bytes following the record
+
+    };
+
+    class SessionCapture : private boost::noncopyable {
+    public:
+
+        SessionCapture();
+        virtual ~SessionCapture();
+
+        // creates or truncates path and sets aside capacity bytes for it. May only be called once
+        boost::system::error_code open(const std::string& path, size_t capacity = 256 * 1024 * 1024);
+
+        // any thread, never blocks or allocates. Does nothing before open or after close
+        void record(boost::uint64_t connection, CaptureKind kind, const char* data, size_t size);
+
+        // sets the length in the header and cuts the file down to it, called by the destructor.
+        // No connection may still be recording
+        void close();
+
+        bool is_open() const {
+            return base_ != NULL;
+        }
+
+        size_t size() const; // bytes written so far, the header included
+        size_t dropped() const; // records lost to a full file
+
+    private:
+
+        int fd_;
+        char* base_;
+        size_t capacity_;
+        boost::atomic<size_t> tail_; // offset of the next record
+        boost::atomic<size_t> dropped_;
+        std::string path_;
+
+    };
+
+    // reads a capture file, whether it was closed or not
+    class CaptureReader : private boost::noncopyable {
+    public:
+
+        CaptureReader();
+        virtual ~CaptureReader();
+
+        boost::system::error_code open(const std::string& path);
+        void close();
+
+        const CaptureFileHeader& header() const {
+            return *reinterpret_cast<const CaptureFileHeader*> (base_);
+        }
+
+        // the next record and its payload, false at the end of the capture
+        bool next(CaptureRecord& record, const char*& payload);
+
+        void rewind();
+
+    private:
+
+        int fd_;
+        const char* base_;
+        size_t mapped_;
+        size_t size_; // where the records end at the latest
+        size_t offset_;
+
+    };
+
+}
+
+#endif	/* SESSIONCAPTURE_H */
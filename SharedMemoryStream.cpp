@@ -0,0 +1,507 @@
+/*
+ * File:   SharedMemoryStream.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "SharedMemoryStream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <boost/atomic.hpp>
+#include <boost/static_assert.hpp>
+
+#include "SocketLog.h"
+
+using namespace modt_socket;
+
+// the atomics are shared with another process, only lock free ones work there
+BOOST_STATIC_ASSERT(BOOST_ATOMIC_INT64_LOCK_FREE == 2 && BOOST_ATOMIC_INT32_LOCK_FREE == 2);
+
+namespace modt_socket {
+
+    // head and tail count every byte ever written and read, so the ring is empty when they are
+    // equal and full when they are capacity apart. Each sits in a cache line of its own
+    struct SharedRing {
+
+        boost::atomic<boost::uint64_t> head; // written by the producer
+        char head_pad[64 - sizeof (boost::atomic<boost::uint64_t>)];
+        boost::atomic<boost::uint64_t> tail; // written by the consumer
+        char tail_pad[64 - sizeof (boost::atomic<boost::uint64_t>)];
+
+        // set by a side about to sleep, taken by the other side, which then writes its eventfd
+        boost::atomic<boost::uint32_t> reader_waiting;
+        boost::atomic<boost::uint32_t> writer_waiting;
+
+        boost::uint64_t magic;
+        boost::uint64_t capacity;
+
+    };
+
+}
+
+namespace {
+
+    enum {
+        RING_HEADER_SIZE = 4096, // a page, so the data of both rings is page aligned
+        RING_MIN_SIZE = 4096
+    };
+
+    const boost::uint64_t RING_MAGIC = 0x4d4f4454524e4731ULL;
+
+    boost::system::error_code last_error() {
+
+        return boost::system::error_code(errno, boost::system::system_category());
+
+    }
+
+    size_t ring_capacity(size_t size) {
+
+        size_t capacity = RING_MIN_SIZE;
+        while (capacity < size)
+            capacity <<= 1;
+        return capacity;
+
+    }
+
+    boost::uint64_t monotonic_ns() {
+
+        struct timespec now;
+        ::clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<boost::uint64_t> (now.tv_sec) * 1000000000ULL + now.tv_nsec;
+
+    }
+
+    void close_fds(const int* fds, size_t count) {
+
+        for (size_t i = 0; i < count; ++i)
+            if (fds[i] >= 0)
+                ::close(fds[i]);
+
+    }
+
+}
+
+SharedMemoryStream::SharedMemoryStream(boost::asio::io_service& io_service)
+: wake_(io_service),
+peer_wake_(-1),
+region_(NULL),
+region_size_(0),
+rx_(NULL),
+rx_data_(NULL),
+tx_(NULL),
+tx_data_(NULL),
+capacity_(0),
+wake_count_(0) {
+}
+
+SharedMemoryStream::~SharedMemoryStream() {
+
+    close();
+
+}
+
+boost::system::error_code SharedMemoryStream::create(int socket_fd, size_t ring_size) {
+
+#ifdef __linux__
+
+    size_t capacity = ring_capacity(ring_size);
+    size_t region_size = 2 * (RING_HEADER_SIZE + capacity);
+
+    // the memory, then our eventfd and the peer's
+    int fds[3] = {-1, -1, -1};
+    boost::system::error_code error;
+
+    fds[0] = ::memfd_create("modt_socket", MFD_CLOEXEC);
+    if (fds[0] < 0 || ::ftruncate(fds[0], static_cast<off_t> (region_size)) != 0)
+        error = last_error();
+    if (!error && ((fds[1] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0 || (fds[2] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0))
+        error = last_error();
+
+    if (!error) {
+
+        void* region = ::mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (region == MAP_FAILED) {
+            error = last_error();
+        } else {
+            region_ = static_cast<char*> (region);
+            region_size_ = region_size;
+            map(region_size, true);
+        }
+
+    }
+
+    if (!error) {
+
+        char tag = 'M';
+        struct iovec data = {&tag, 1};
+        char control[CMSG_SPACE(sizeof (fds))];
+        std::memset(control, 0, sizeof (control));
+
+        struct msghdr message;
+        std::memset(&message, 0, sizeof (message));
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof (control);
+
+        struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof (fds));
+        std::memcpy(CMSG_DATA(rights), fds, sizeof (fds));
+
+        // a single byte on a fresh connection, the socket buffer always has room for it
+        if (::sendmsg(socket_fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL) != 1)
+            error = last_error();
+
+    }
+
+    if (error) {
+
+        MODT_SOCKET_LOG_ERROR(g_Logger, "SharedMemoryStream::create()", "Could not set up the shared memory : " << error.message());
+        close();
+        close_fds(fds, 3);
+        return error;
+
+    }
+
+    // the mapping and the peer's copies keep the memory, our eventfd goes to the reactor
+    ::close(fds[0]);
+    wake_.assign(fds[1], error);
+    peer_wake_ = fds[2];
+    if (error) {
+        ::close(fds[1]);
+        close();
+    }
+    return error;
+
+#else
+
+    return boost::asio::error::operation_not_supported;
+
+#endif
+
+}
+
+boost::system::error_code SharedMemoryStream::accept(int socket_fd) {
+
+    char tag = 0;
+    struct iovec data = {&tag, 1};
+    int fds[3] = {-1, -1, -1};
+    char control[CMSG_SPACE(sizeof (fds))];
+
+    struct msghdr message;
+    std::memset(&message, 0, sizeof (message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof (control);
+
+    int flags = MSG_DONTWAIT;
+#ifdef MSG_CMSG_CLOEXEC
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    ssize_t received = ::recvmsg(socket_fd, &message, flags);
+    if (received < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK ? boost::asio::error::would_block : last_error();
+    if (received == 0)
+        return boost::asio::error::eof;
+
+    struct cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    if (rights && rights->cmsg_level == SOL_SOCKET && rights->cmsg_type == SCM_RIGHTS && rights->cmsg_len == CMSG_LEN(sizeof (fds)))
+        std::memcpy(fds, CMSG_DATA(rights), sizeof (fds));
+
+    boost::system::error_code error;
+    struct stat info;
+
+    if (tag != 'M' || (message.msg_flags & MSG_CTRUNC) || fds[2] < 0)
+        error = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+    if (!error && ::fstat(fds[0], &info) != 0)
+        error = last_error();
+
+    if (!error) {
+
+        size_t region_size = static_cast<size_t> (info.st_size);
+        void* region = ::mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+        if (region == MAP_FAILED) {
+            error = last_error();
+        } else {
+            region_ = static_cast<char*> (region);
+            region_size_ = region_size;
+            map(region_size, false);
+            if (!rx_)
+                error = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        }
+
+    }
+
+    if (!error)
+        wake_.assign(fds[2], error);
+
+    if (error) {
+
+        MODT_SOCKET_LOG_ERROR(g_Logger, "SharedMemoryStream::accept()", "Could not take the shared memory : " << error.message());
+        close();
+        close_fds(fds, 3);
+        return error;
+
+    }
+
+    ::close(fds[0]);
+    peer_wake_ = fds[1];
+    return error;
+
+}
+
+void SharedMemoryStream::map(size_t region_size, bool creator) {
+
+    // the creator's send ring comes first
+    SharedRing* first = reinterpret_cast<SharedRing*> (region_);
+    size_t capacity = region_size / 2 - RING_HEADER_SIZE;
+
+    if (creator) {
+
+        for (int i = 0; i < 2; ++i) {
+
+            SharedRing* ring = new (region_ + i * (RING_HEADER_SIZE + capacity)) SharedRing;
+            ring->head.store(0, boost::memory_order_relaxed);
+            ring->tail.store(0, boost::memory_order_relaxed);
+            ring->reader_waiting.store(0, boost::memory_order_relaxed);
+            ring->writer_waiting.store(0, boost::memory_order_relaxed);
+            ring->capacity = capacity;
+            ring->magic = RING_MAGIC;
+
+        }
+        boost::atomic_thread_fence(boost::memory_order_release);
+
+    } else if (region_size < 2 * (RING_HEADER_SIZE + RING_MIN_SIZE) || first->magic != RING_MAGIC
+            || first->capacity != capacity || (capacity & (capacity - 1))) {
+
+        return; // not a region made by create, rx_ stays NULL
+
+    }
+
+    // from here on the size comes from the region, not from the headers
+    SharedRing* second = reinterpret_cast<SharedRing*> (region_ + RING_HEADER_SIZE + capacity);
+
+    tx_ = creator ? first : second;
+    rx_ = creator ? second : first;
+    tx_data_ = reinterpret_cast<char*> (tx_) + RING_HEADER_SIZE;
+    rx_data_ = reinterpret_cast<char*> (rx_) + RING_HEADER_SIZE;
+    capacity_ = capacity;
+
+}
+
+size_t SharedMemoryStream::read_some(char* data, size_t size, boost::system::error_code& ec) {
+
+    boost::uint64_t tail = rx_->tail.load(boost::memory_order_relaxed);
+    boost::uint64_t head = rx_->head.load(boost::memory_order_acquire);
+
+    ec = boost::system::error_code();
+    if (head - tail > capacity_) {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        return 0;
+    }
+
+    size_t count = static_cast<size_t> (head - tail);
+    if (count > size)
+        count = size;
+    if (count == 0)
+        return 0;
+
+    // in up to two pieces, around the end of the ring
+    size_t offset = static_cast<size_t> (tail & (capacity_ - 1));
+    size_t first = std::min(count, capacity_ - offset);
+    std::memcpy(data, rx_data_ + offset, first);
+    std::memcpy(data + first, rx_data_, count - first);
+
+    rx_->tail.store(tail + count, boost::memory_order_release);
+
+    // pairs with the fence in prepare_wait_write, either the writer sees the room or we see it waiting
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (rx_->writer_waiting.load(boost::memory_order_relaxed) && rx_->writer_waiting.exchange(0))
+        signal_peer();
+
+    return count;
+
+}
+
+size_t SharedMemoryStream::write_some(const char* data, size_t size, boost::system::error_code& ec) {
+
+    boost::uint64_t head = tx_->head.load(boost::memory_order_relaxed);
+    boost::uint64_t tail = tx_->tail.load(boost::memory_order_acquire);
+
+    ec = boost::system::error_code();
+    if (head - tail > capacity_) {
+        ec = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        return 0;
+    }
+
+    size_t count = capacity_ - static_cast<size_t> (head - tail);
+    if (count > size)
+        count = size;
+    if (count == 0)
+        return 0;
+
+    size_t offset = static_cast<size_t> (head & (capacity_ - 1));
+    size_t first = std::min(count, capacity_ - offset);
+    std::memcpy(tx_data_ + offset, data, first);
+    std::memcpy(tx_data_, data + first, count - first);
+
+    tx_->head.store(head + count, boost::memory_order_release);
+
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (tx_->reader_waiting.load(boost::memory_order_relaxed) && tx_->reader_waiting.exchange(0))
+        signal_peer();
+
+    return count;
+
+}
+
+bool SharedMemoryStream::spin_readable(size_t spin_us) const {
+
+    boost::uint64_t deadline = monotonic_ns() + spin_us * 1000ULL;
+    for (size_t i = 1;; ++i) {
+
+        if (rx_->head.load(boost::memory_order_acquire) != rx_->tail.load(boost::memory_order_relaxed))
+            return true;
+        if (i % 64 == 0 && monotonic_ns() >= deadline) // the clock is read now and then only
+            return false;
+
+    }
+
+}
+
+bool SharedMemoryStream::prepare_wait_read() {
+
+    rx_->reader_waiting.store(1, boost::memory_order_seq_cst);
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (rx_->head.load(boost::memory_order_seq_cst) == rx_->tail.load(boost::memory_order_relaxed))
+        return true;
+
+    // the writer may or may not have taken the flag, a stray wakeup is harmless
+    rx_->reader_waiting.store(0, boost::memory_order_relaxed);
+    return false;
+
+}
+
+bool SharedMemoryStream::prepare_wait_write() {
+
+    tx_->writer_waiting.store(1, boost::memory_order_seq_cst);
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    // a broken tail does not wait either, the next write_some reports it
+    if (tx_->head.load(boost::memory_order_relaxed) - tx_->tail.load(boost::memory_order_seq_cst) == capacity_)
+        return true;
+
+    tx_->writer_waiting.store(0, boost::memory_order_relaxed);
+    return false;
+
+}
+
+size_t SharedMemoryStream::read(char* data, size_t size, size_t spin_us, bool& wait, boost::system::error_code& ec) {
+
+    wait = false;
+    size_t bytes = read_some(data, size, ec);
+    while (bytes == 0 && !ec) {
+
+        if (spin_us && spin_readable(spin_us)) {
+            // something came in while spinning
+        } else if (prepare_wait_read()) {
+            wait = true;
+            return 0;
+        }
+        bytes = read_some(data, size, ec);
+
+    }
+
+    return bytes;
+
+}
+
+size_t SharedMemoryStream::write(const std::vector<boost::asio::const_buffer>& buffers, size_t offset, bool& wait, boost::system::error_code& ec) {
+
+    wait = false;
+    ec = boost::system::error_code();
+
+    size_t skip = offset;
+    for (size_t i = 0; i < buffers.size(); ++i) {
+
+        const char* data = boost::asio::buffer_cast<const char*> (buffers[i]);
+        size_t size = boost::asio::buffer_size(buffers[i]);
+        if (skip >= size) {
+            skip -= size;
+            continue;
+        }
+
+        data += skip;
+        size -= skip;
+        skip = 0;
+
+        while (size) {
+
+            size_t copied = write_some(data, size, ec);
+            if (ec)
+                return offset;
+            if (copied == 0) {
+                if (prepare_wait_write()) {
+                    wait = true;
+                    return offset;
+                }
+                continue;
+            }
+
+            data += copied;
+            size -= copied;
+            offset += copied;
+
+        }
+
+    }
+
+    return offset;
+
+}
+
+void SharedMemoryStream::signal_peer() {
+
+    boost::uint64_t one = 1;
+    ssize_t written = ::write(peer_wake_, &one, sizeof (one));
+    (void) written; // only fails with the counter about to overflow, when the peer is awake anyway
+
+}
+
+void SharedMemoryStream::close() {
+
+    // the wait completes with operation_aborted
+    boost::system::error_code ignored;
+    wake_.close(ignored);
+
+    if (peer_wake_ >= 0) {
+        ::close(peer_wake_);
+        peer_wake_ = -1;
+    }
+
+    if (region_) {
+        ::munmap(region_, region_size_);
+        region_ = NULL;
+        region_size_ = 0;
+    }
+
+    rx_ = tx_ = NULL;
+    rx_data_ = tx_data_ = NULL;
+    capacity_ = 0;
+
+}
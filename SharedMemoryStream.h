@@ -0,0 +1,121 @@
+/*
+ * File:   SharedMemoryStream.h
+ * Author: mihiranad
+ *
+ * A byte stream between two processes on the same host over shared memory.
+ * It upgrades a connected Unix-domain socket: the connecting side creates a
+ * memfd with two single producer, single consumer rings, one per direction,
+ * and an eventfd for each side, and passes them to the accepting side over
+ * the socket. From then on the socket carries nothing, it only tells either
+ * side that the other one went away.
+ *
+ * Bytes are copied straight into the peer's ring. A side that finds its ring
+ * empty, or the peer's ring full, says so in the ring header and sleeps on
+ * its eventfd; the other side writes the eventfd only then, so a busy
+ * stream makes no system calls at all. With spinning the reader polls the
+ * ring for a while before it goes to sleep, trading a core for the wakeup.
+ */
+
+#ifndef SHAREDMEMORYSTREAM_H
+#define	SHAREDMEMORYSTREAM_H
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+
+namespace modt_socket {
+
+    struct SharedMemorySettings { // picked up by local connections, both sides have to enable it
+
+        bool enabled;
+        size_t ring_size; // bytes per direction, rounded up to a power of two of at least a page
+        size_t spin_us; // the reader polls an empty ring this long before sleeping, 0 sleeps at once
+
+        SharedMemorySettings()
+        : enabled(false),
+        ring_size(1024 * 1024),
+        spin_us(0) {
+        }
+
+    };
+
+    struct SharedRing; // the header of a ring in the shared region
+
+    class SharedMemoryStream : private boost::noncopyable {
+    public:
+
+        explicit SharedMemoryStream(boost::asio::io_service& io_service);
+        ~SharedMemoryStream();
+
+        // the connecting side, creates the region and passes it over the connected socket
+        boost::system::error_code create(int socket_fd, size_t ring_size);
+
+        // the accepting side, takes the region passed by create. would_block if it has not arrived yet
+        boost::system::error_code accept(int socket_fd);
+
+        // copy out of the receive ring, or into the send ring, as much as there is data or room
+        // for. Never block, a single thread may read and a single thread may write at a time.
+        // protocol_error once the peer has left a ring holding more than it can, e.g. a tail
+        // moved past the head, the connection is beyond saving then
+        size_t read_some(char* data, size_t size, boost::system::error_code& ec);
+        size_t write_some(const char* data, size_t size, boost::system::error_code& ec);
+
+        // polls the receive ring for up to spin_us, true once there is something to read
+        bool spin_readable(size_t spin_us) const;
+
+        // tells the peer this side is about to sleep on an empty receive ring, or a full send ring.
+        // False if that changed meanwhile and there is no need to wait after all
+        bool prepare_wait_read();
+        bool prepare_wait_write();
+
+        // what a connection's read and write actors do with the rings. read reads whatever there
+        // is, spinning first if spin_us says so, and sets wait instead when the ring is empty and
+        // the peer has been told. write copies the gather list on from offset, the bytes of it
+        // already copied, and returns how far it got, setting wait when the peer's ring is full
+        size_t read(char* data, size_t size, size_t spin_us, bool& wait, boost::system::error_code& ec);
+        size_t write(const std::vector<boost::asio::const_buffer>& buffers, size_t offset, bool& wait, boost::system::error_code& ec);
+
+        // completes once the peer has written to or made room in a ring this side said it waits
+        // on, or with an error once closed. One wait at a time, for both directions
+        template <typename WaitHandler>
+        void async_wait(WaitHandler handler) {
+            wake_.async_read_some(boost::asio::buffer(&wake_count_, sizeof (wake_count_)), handler);
+        }
+
+        bool is_open() const {
+            return region_ != NULL;
+        }
+
+        void close();
+
+    private:
+
+        void map(size_t region_size, bool creator);
+
+        void signal_peer();
+
+        boost::asio::posix::stream_descriptor wake_; // our eventfd, the peer writes it
+        int peer_wake_; // the peer's eventfd
+
+        char* region_;
+        size_t region_size_;
+
+        SharedRing* rx_; // written by the peer
+        char* rx_data_;
+        SharedRing* tx_; // written by us
+        char* tx_data_;
+        size_t capacity_; // of either ring, as checked by map. The copy in the headers is the peer's to scribble on
+
+        boost::uint64_t wake_count_; // read off the eventfd
+
+    };
+
+}
+
+#endif	/* SHAREDMEMORYSTREAM_H */
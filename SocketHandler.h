@@ -8,46 +8,37 @@
 #ifndef SOCKETHANDLER_H
 #define	SOCKETHANDLER_H
 
-#include "AsioSocket.h"
-
-#include "ModtLogHandlers.h"
-
-extern modt_log::LogSink g_Logger;
-
-using namespace modt_log;
+#include "BasicSocketHandler.h"
 
 namespace modt_socket {
 
-    struct IOServiceWrapper { // this is required to control the life span of the io_service object....
-
-        boost::asio::io_service io_service;
-        
-        IOServiceWrapper() {
-            MODT_LOG_INFO(g_Logger, "IOServiceWrapper::IOServiceWrapper()", "Created IOServiceWrapper Object [" << this << "]");                        
-        }
-        
-        virtual ~IOServiceWrapper() {
-            MODT_LOG_INFO(g_Logger, "IOServiceWrapper::~IOServiceWrapper()", "Destruct IOServiceWrapper Object [" << this << "]");   
-        }
-
-    };
-
-    class SocketHandler {
+    // the virtual interface, an adapter over BasicSocketHandler for handlers that are
+    // chosen at runtime. Each event costs a virtual call on top of the static dispatch
+    class SocketHandler : public BasicSocketHandler<SocketHandler> {
     public:
 
-        // user interface for the socket handler
-        void AsyncConnect(const char* ip, const char* port);
-        void Disconnect();
-        void Read(const size_t bytes);
-        void AsyncWrite(const std::string msg);
-        size_t Write(const std::string msg);
-        boost::system::error_code Connect(const char* ip, const char* port);
-
         //callbacks provided to serve the interface requests 
         virtual void OnConnectionStatus(bool *isConnected, boost::system::error_code* ec) = 0;
         virtual void OnRead(const char *s, const size_t *bytes, const size_t *bytes_requested, boost::system::error_code *ec) = 0;
+        // zero copy receive, the view may be kept past the callback without copying the data.
+        // the default implementation forwards to OnRead
+        virtual void OnReceive(const BufferView& data, const boost::system::error_code& ec);
+        // with READ_PER_BATCH, all the messages of one socket read in a single call, see
+        // BasicSocketHandler. The default implementation forwards each to OnReceive
+        virtual void OnReceiveBatch(const BufferView* messages, size_t count);
+        // used by the framed read mode to find complete frames in the received data, see Framing.h
+        virtual FrameStatus ParseFrame(const char* data, size_t size, FrameInfo& frame);
+        virtual void ResetFrames();
         virtual void OnAsyncWrite(const size_t *bytes, boost::system::error_code* ec) = 0;
         virtual void OnDisconnect() = 0;
+        // the write backlog went below the low watermarks after hitting a high one, see SocketSettings
+        virtual void OnWritable();
+
+        // events from BasicSocketHandler, passed on to the callbacks above. The pointers
+        // handed to the callbacks refer to copies private to the call
+        void OnConnect(bool connected, const boost::system::error_code& ec);
+        void OnWriteComplete(size_t bytes, const boost::system::error_code& ec);
+        void OnClose(const boost::system::error_code& ec);
 
         SocketHandler();        
         virtual ~SocketHandler();
@@ -56,19 +47,8 @@ namespace modt_socket {
         
         SocketHandler(const SocketHandler& orig);
 
-        void ConfigureConnection(const char* ip, const char* port);
-        
-        //boost::asio::io_service io_service;
-        SynchronisedQueue<size_t> read_queue;
-        SynchronisedQueue<WriteMsg> write_queue;
-
-        boost::scoped_ptr<IOServiceWrapper> io_service_wrapper;
-        boost::scoped_ptr<boost::thread> thread;
-        boost::scoped_ptr<AsioSocket> sock;
-
     };
 
 }
 
 #endif	/* SOCKETHANDLER_H */
-
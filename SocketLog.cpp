@@ -0,0 +1,137 @@
+/*
+ * File:   SocketLog.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "SocketLog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#include <boost/bind.hpp>
+
+#include "SocketStats.h"
+
+using namespace modt_socket;
+
+const char* modt_socket::event_name(SocketEvent event) {
+
+    switch (event) {
+        case EVENT_CONNECT: return "connect";
+        case EVENT_CONNECT_FAILED: return "connect_failed";
+        case EVENT_RECONNECT: return "reconnect";
+        case EVENT_DISCONNECT: return "disconnect";
+        case EVENT_TIMEOUT: return "timeout";
+        case EVENT_RECEIVE: return "receive";
+        case EVENT_READ_REQUEST: return "read_request";
+        case EVENT_DELIVER: return "deliver";
+        case EVENT_WRITE: return "write";
+        case EVENT_WRITE_DONE: return "write_done";
+        case EVENT_INLINE_WRITE: return "inline_write";
+    }
+    return "unknown";
+
+}
+
+SocketEventLog::SocketEventLog(size_t capacity, size_t payload_sample, size_t flush_interval_ms)
+: queue_(capacity),
+payload_sample_(payload_sample),
+flush_interval_ms_(flush_interval_ms),
+sampled_(0),
+dropped_(0),
+stopped_(false) {
+
+    thread_.reset(new boost::thread(boost::bind(&SocketEventLog::run, this)));
+    MODT_SOCKET_LOG_DEBUG(g_Logger, "SocketEventLog::SocketEventLog()", "Started socket event log [" << this << "], capacity " << queue_.Capacity());
+
+}
+
+SocketEventLog::~SocketEventLog() {
+
+    stop();
+
+}
+
+void SocketEventLog::stop() {
+
+    if (stopped_.exchange(true))
+        return;
+
+    thread_->join();
+
+    if (dropped())
+        MODT_SOCKET_LOG_WARN(g_Logger, "SocketEventLog::stop()", dropped() << " socket events were dropped, the queue was full");
+
+}
+
+size_t SocketEventLog::dropped() const {
+
+    return dropped_.load(boost::memory_order_relaxed);
+
+}
+
+void SocketEventLog::record(boost::uint64_t connection, SocketEvent event, size_t bytes, const char* payload) {
+
+    EventRecord record;
+    record.timestamp = stats_now();
+    record.connection = connection;
+    record.event = event;
+    record.bytes = static_cast<boost::uint32_t> (bytes);
+    record.payload_size = 0;
+
+    if (payload && payload_sample_ && sampled_.fetch_add(1, boost::memory_order_relaxed) % payload_sample_ == 0) {
+        record.payload_size = static_cast<boost::uint32_t> (std::min<size_t>(bytes, EVENT_PAYLOAD_BYTES));
+        std::memcpy(record.payload, payload, record.payload_size);
+    }
+
+    if (!queue_.try_Enqueue(record))
+        dropped_.fetch_add(1, boost::memory_order_relaxed);
+
+}
+
+void SocketEventLog::run() {
+
+    // the only consumer of the queue, all the formatting happens here
+    EventRecord record;
+    for (;;) {
+
+        bool stopping = stopped_.load(boost::memory_order_acquire);
+
+        while (queue_.try_Dequeue(record))
+            format(record);
+
+        if (stopping)
+            return; // everything recorded before stop() has been formatted
+
+        boost::this_thread::sleep(boost::posix_time::milliseconds(flush_interval_ms_));
+
+    }
+
+}
+
+void SocketEventLog::format(const EventRecord& record) {
+
+    std::ostringstream payload;
+    if (record.payload_size) {
+
+        // printable bytes as they are, anything else escaped
+        payload << " : ";
+        for (size_t i = 0; i < record.payload_size; ++i) {
+            unsigned char c = static_cast<unsigned char> (record.payload[i]);
+            if (c >= 0x20 && c < 0x7f && c != '\\')
+                payload << c;
+            else
+                payload << "\\x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<int> (c) << std::dec;
+        }
+        if (record.payload_size < record.bytes)
+            payload << "...";
+
+    }
+
+    MODT_LOG_INFO(g_Logger, "SocketEventLog::format()", record.timestamp << " [0x" << std::hex << record.connection << std::dec << "] "
+            << event_name(static_cast<SocketEvent> (record.event)) << " " << record.bytes << " bytes" << payload.str());
+
+}
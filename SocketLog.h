@@ -0,0 +1,150 @@
+/*
+ * File:   SocketLog.h
+ * Author: mihiranad
+ *
+ * Logging for the socket layer. The MODT_SOCKET_LOG_* macros wrap the
+ * MODT_LOG_* ones and compile to nothing below MODT_SOCKET_LOG_LEVEL, so the
+ * message is not even formatted. Per message logging uses the TRACE level,
+ * which is left out unless asked for, e.g. -DMODT_SOCKET_LOG_LEVEL=0.
+ *
+ * For tracing a live connection without the cost of formatting on the
+ * io_service thread, a SocketEventLog can be set in the SocketSettings. It
+ * takes fixed size binary records into a lock free queue and a background
+ * thread of its own formats them into g_Logger. Payload bytes are only
+ * recorded when sampling is switched on.
+ */
+
+#ifndef SOCKETLOG_H
+#define	SOCKETLOG_H
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "LockFreeQueue.h"
+
+#include "ModtLogHandlers.h"
+
+extern modt_log::LogSink g_Logger;
+
+#define MODT_SOCKET_LOG_LEVEL_TRACE 0
+#define MODT_SOCKET_LOG_LEVEL_DEBUG 1
+#define MODT_SOCKET_LOG_LEVEL_INFO 2
+#define MODT_SOCKET_LOG_LEVEL_WARN 3
+#define MODT_SOCKET_LOG_LEVEL_ERROR 4
+#define MODT_SOCKET_LOG_LEVEL_NONE 5
+
+#ifndef MODT_SOCKET_LOG_LEVEL
+#define MODT_SOCKET_LOG_LEVEL MODT_SOCKET_LOG_LEVEL_DEBUG
+#endif
+
+#define MODT_SOCKET_LOG_NOTHING() do { } while (0)
+
+#if MODT_SOCKET_LOG_LEVEL <= MODT_SOCKET_LOG_LEVEL_TRACE
+#define MODT_SOCKET_LOG_TRACE(logger, function, message) MODT_LOG_DEBUG(logger, function, message)
+#else
+#define MODT_SOCKET_LOG_TRACE(logger, function, message) MODT_SOCKET_LOG_NOTHING()
+#endif
+
+#if MODT_SOCKET_LOG_LEVEL <= MODT_SOCKET_LOG_LEVEL_DEBUG
+#define MODT_SOCKET_LOG_DEBUG(logger, function, message) MODT_LOG_DEBUG(logger, function, message)
+#else
+#define MODT_SOCKET_LOG_DEBUG(logger, function, message) MODT_SOCKET_LOG_NOTHING()
+#endif
+
+#if MODT_SOCKET_LOG_LEVEL <= MODT_SOCKET_LOG_LEVEL_INFO
+#define MODT_SOCKET_LOG_INFO(logger, function, message) MODT_LOG_INFO(logger, function, message)
+#else
+#define MODT_SOCKET_LOG_INFO(logger, function, message) MODT_SOCKET_LOG_NOTHING()
+#endif
+
+#if MODT_SOCKET_LOG_LEVEL <= MODT_SOCKET_LOG_LEVEL_WARN
+#define MODT_SOCKET_LOG_WARN(logger, function, message) MODT_LOG_WARN(logger, function, message)
+#else
+#define MODT_SOCKET_LOG_WARN(logger, function, message) MODT_SOCKET_LOG_NOTHING()
+#endif
+
+#if MODT_SOCKET_LOG_LEVEL <= MODT_SOCKET_LOG_LEVEL_ERROR
+#define MODT_SOCKET_LOG_ERROR(logger, function, message) MODT_LOG_ERROR(logger, function, message)
+#else
+#define MODT_SOCKET_LOG_ERROR(logger, function, message) MODT_SOCKET_LOG_NOTHING()
+#endif
+
+// -DMODT_SOCKET_NO_EVENT_LOG takes the event records out as well, otherwise
+// they cost a pointer test while no SocketEventLog is set
+#ifndef MODT_SOCKET_NO_EVENT_LOG
+#define MODT_SOCKET_EVENT(log, connection, event, bytes, payload) \
+    do { if (log) (log)->record(connection, event, bytes, payload); } while (0)
+#else
+#define MODT_SOCKET_EVENT(log, connection, event, bytes, payload) MODT_SOCKET_LOG_NOTHING()
+#endif
+
+namespace modt_socket {
+
+    enum SocketEvent {
+        EVENT_CONNECT, // connection established
+        EVENT_CONNECT_FAILED,
+        EVENT_RECONNECT, // reconnect attempt scheduled, bytes is the attempt number
+        EVENT_DISCONNECT, // the connection was closed on an error or by the peer
+        EVENT_TIMEOUT, // a connect, read idle or write stall timeout passed
+        EVENT_RECEIVE, // bytes received from the socket
+        EVENT_READ_REQUEST, // read request taken off the read queue
+        EVENT_DELIVER, // bytes handed to the read callback
+        EVENT_WRITE, // message put into a gathered write
+        EVENT_WRITE_DONE, // bytes of a gathered write completed
+        EVENT_INLINE_WRITE // bytes sent by SocketHandler::Write on the caller's thread
+    };
+
+    const char* event_name(SocketEvent event);
+
+    enum {
+        EVENT_PAYLOAD_BYTES = 36 // leading payload bytes kept by a sampled record, makes a record 64 bytes
+    };
+
+    struct EventRecord {
+
+        boost::uint64_t timestamp; // stats_now()
+        boost::uint64_t connection; // the socket handler's address
+        boost::uint32_t event;
+        boost::uint32_t bytes;
+        boost::uint32_t payload_size; // 0 unless the record was sampled
+        char payload[EVENT_PAYLOAD_BYTES];
+
+    };
+
+    class SocketEventLog : private boost::noncopyable {
+    public:
+
+        // payload_sample N keeps the leading payload bytes of every Nth record that has a payload,
+        // 0 never does. Records are dropped rather than waited for when the queue is full
+        explicit SocketEventLog(size_t capacity = 64 * 1024, size_t payload_sample = 0, size_t flush_interval_ms = 10);
+        virtual ~SocketEventLog();
+
+        // any thread, never blocks or allocates
+        void record(boost::uint64_t connection, SocketEvent event, size_t bytes, const char* payload = NULL);
+
+        // formats what is still queued and joins the background thread, called by the destructor
+        void stop();
+
+        size_t dropped() const; // records lost to a full queue
+
+    private:
+
+        void run();
+        void format(const EventRecord& record);
+
+        MpscQueue<EventRecord> queue_;
+        size_t payload_sample_;
+        size_t flush_interval_ms_;
+        boost::atomic<size_t> sampled_;
+        boost::atomic<size_t> dropped_;
+        boost::atomic<bool> stopped_;
+        boost::scoped_ptr<boost::thread> thread_;
+
+    };
+
+}
+
+#endif	/* SOCKETLOG_H */
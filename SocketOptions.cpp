@@ -0,0 +1,239 @@
+/*
+ * File:   SocketOptions.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "SocketOptions.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "SocketLog.h"
+
+using namespace modt_socket;
+
+namespace {
+
+    void set_option(int fd, int level, int name, int value, const char* option) {
+
+        if (value < 0)
+            return;
+
+        if (::setsockopt(fd, level, name, &value, sizeof (value)) != 0)
+            MODT_SOCKET_LOG_WARN(g_Logger, "apply_socket_options()", "Could not set " << option << " to " << value << " : " << std::strerror(errno));
+
+    }
+
+    int get_option(int fd, int level, int name) {
+
+        int value = 0;
+        socklen_t size = sizeof (value);
+        if (::getsockopt(fd, level, name, &value, &size) != 0)
+            return -1;
+        return value;
+
+    }
+
+}
+
+SocketOptions SocketOptions::LowLatency() {
+
+    SocketOptions options;
+    options.no_delay = 1;
+    options.quick_ack = 1;
+    options.busy_poll = 50;
+    options.user_timeout = 5000;
+    options.keep_alive = 1;
+    options.keep_idle = 5;
+    options.keep_interval = 1;
+    options.keep_count = 3;
+    return options;
+
+}
+
+SocketOptions SocketOptions::BulkThroughput() {
+
+    SocketOptions options;
+    options.no_delay = 0;
+    options.send_buffer = 4 * 1024 * 1024;
+    options.receive_buffer = 4 * 1024 * 1024;
+    options.keep_alive = 1;
+    options.keep_idle = 60;
+    options.keep_interval = 10;
+    options.keep_count = 5;
+    return options;
+
+}
+
+std::ostream& modt_socket::operator<<(std::ostream& os, const SocketOptions& options) {
+
+    return os << "no_delay " << options.no_delay
+            << ", send_buffer " << options.send_buffer
+            << ", receive_buffer " << options.receive_buffer
+            << ", quick_ack " << options.quick_ack
+            << ", busy_poll " << options.busy_poll
+            << ", user_timeout " << options.user_timeout
+            << ", keep_alive " << options.keep_alive
+            << ", keep_idle " << options.keep_idle
+            << ", keep_interval " << options.keep_interval
+            << ", keep_count " << options.keep_count;
+
+}
+
+namespace {
+
+    // the options of a TCP socket, or only the socket level ones for any other family
+    void apply_options(int fd, bool tcp, const SocketOptions& options) {
+
+        set_option(fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF");
+        set_option(fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF");
+        if (!tcp)
+            return;
+
+        set_option(fd, IPPROTO_TCP, TCP_NODELAY, options.no_delay, "TCP_NODELAY");
+        set_option(fd, SOL_SOCKET, SO_KEEPALIVE, options.keep_alive, "SO_KEEPALIVE");
+#ifdef TCP_QUICKACK
+        set_option(fd, IPPROTO_TCP, TCP_QUICKACK, options.quick_ack, "TCP_QUICKACK");
+#endif
+#ifdef SO_BUSY_POLL
+        set_option(fd, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll, "SO_BUSY_POLL");
+#endif
+#ifdef TCP_USER_TIMEOUT
+        set_option(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, options.user_timeout, "TCP_USER_TIMEOUT");
+#endif
+#ifdef TCP_KEEPIDLE
+        set_option(fd, IPPROTO_TCP, TCP_KEEPIDLE, options.keep_idle, "TCP_KEEPIDLE");
+#endif
+#ifdef TCP_KEEPINTVL
+        set_option(fd, IPPROTO_TCP, TCP_KEEPINTVL, options.keep_interval, "TCP_KEEPINTVL");
+#endif
+#ifdef TCP_KEEPCNT
+        set_option(fd, IPPROTO_TCP, TCP_KEEPCNT, options.keep_count, "TCP_KEEPCNT");
+#endif
+
+    }
+
+    bool listen_options(int fd, const SocketOptions& options, bool reuse_port) {
+
+        // accepted sockets inherit the buffer sizes, which have to be there before the handshake
+        set_option(fd, SOL_SOCKET, SO_SNDBUF, options.send_buffer, "SO_SNDBUF");
+        set_option(fd, SOL_SOCKET, SO_RCVBUF, options.receive_buffer, "SO_RCVBUF");
+
+        if (!reuse_port)
+            return true;
+
+#ifdef SO_REUSEPORT
+        int value = 1;
+        if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof (value)) == 0)
+            return true;
+        MODT_SOCKET_LOG_WARN(g_Logger, "apply_listen_options()", "Could not set SO_REUSEPORT : " << std::strerror(errno));
+#endif
+        return false;
+
+    }
+
+    void quick_ack(int fd) {
+
+#ifdef TCP_QUICKACK
+        int value = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &value, sizeof (value));
+#endif
+
+    }
+
+    SocketOptions read_options(int fd, bool tcp) {
+
+        SocketOptions options;
+
+        options.send_buffer = get_option(fd, SOL_SOCKET, SO_SNDBUF);
+        options.receive_buffer = get_option(fd, SOL_SOCKET, SO_RCVBUF);
+        if (!tcp)
+            return options;
+
+        options.no_delay = get_option(fd, IPPROTO_TCP, TCP_NODELAY);
+        options.keep_alive = get_option(fd, SOL_SOCKET, SO_KEEPALIVE);
+#ifdef TCP_QUICKACK
+        options.quick_ack = get_option(fd, IPPROTO_TCP, TCP_QUICKACK);
+#endif
+#ifdef SO_BUSY_POLL
+        options.busy_poll = get_option(fd, SOL_SOCKET, SO_BUSY_POLL);
+#endif
+#ifdef TCP_USER_TIMEOUT
+        options.user_timeout = get_option(fd, IPPROTO_TCP, TCP_USER_TIMEOUT);
+#endif
+#ifdef TCP_KEEPIDLE
+        options.keep_idle = get_option(fd, IPPROTO_TCP, TCP_KEEPIDLE);
+#endif
+#ifdef TCP_KEEPINTVL
+        options.keep_interval = get_option(fd, IPPROTO_TCP, TCP_KEEPINTVL);
+#endif
+#ifdef TCP_KEEPCNT
+        options.keep_count = get_option(fd, IPPROTO_TCP, TCP_KEEPCNT);
+#endif
+
+        return options;
+
+    }
+
+    bool is_tcp(StreamSocket& socket) {
+
+        boost::system::error_code error;
+        int family = socket.local_endpoint(error).protocol().family();
+        return !error && (family == AF_INET || family == AF_INET6);
+
+    }
+
+}
+
+void modt_socket::apply_socket_options(boost::asio::ip::tcp::socket& socket, const SocketOptions& options) {
+
+    apply_options(socket.native_handle(), true, options);
+
+}
+
+void modt_socket::apply_socket_options(StreamSocket& socket, const SocketOptions& options) {
+
+    apply_options(socket.native_handle(), is_tcp(socket), options);
+
+}
+
+bool modt_socket::apply_listen_options(boost::asio::ip::tcp::acceptor& acceptor, const SocketOptions& options, bool reuse_port) {
+
+    return listen_options(acceptor.native_handle(), options, reuse_port);
+
+}
+
+bool modt_socket::apply_listen_options(StreamAcceptor& acceptor, const SocketOptions& options, bool reuse_port) {
+
+    return listen_options(acceptor.native_handle(), options, reuse_port);
+
+}
+
+void modt_socket::apply_quick_ack(boost::asio::ip::tcp::socket& socket) {
+
+    quick_ack(socket.native_handle());
+
+}
+
+void modt_socket::apply_quick_ack(StreamSocket& socket) {
+
+    quick_ack(socket.native_handle());
+
+}
+
+SocketOptions modt_socket::read_socket_options(boost::asio::ip::tcp::socket& socket) {
+
+    return read_options(socket.native_handle(), true);
+
+}
+
+SocketOptions modt_socket::read_socket_options(StreamSocket& socket) {
+
+    return read_options(socket.native_handle(), is_tcp(socket));
+
+}
@@ -0,0 +1,79 @@
+/*
+ * File:   SocketOptions.h
+ * Author: mihiranad
+ *
+ * Kernel level tuning of a connection's socket. The options are set on the
+ * socket before it connects, so the buffer sizes count towards the window
+ * scale, and read back once it is connected to see what the kernel granted.
+ * A value of -1 leaves the kernel default alone. Options the platform does
+ * not have are skipped and read back as -1. On a Unix-domain socket only
+ * the socket level ones apply, the TCP ones are skipped.
+ */
+
+#ifndef SOCKETOPTIONS_H
+#define	SOCKETOPTIONS_H
+
+#include <ostream>
+
+#include <boost/asio/ip/tcp.hpp>
+
+#include "StreamEndpoint.h"
+
+namespace modt_socket {
+
+    struct SocketOptions {
+
+        int no_delay; // TCP_NODELAY, 1 turns Nagle's algorithm off
+        int send_buffer; // SO_SNDBUF in bytes, linux reports back double the size asked for
+        int receive_buffer; // SO_RCVBUF in bytes, as above
+        int quick_ack; // TCP_QUICKACK, the kernel drops it again so it is set again after every read
+        int busy_poll; // SO_BUSY_POLL in microseconds, may need CAP_NET_ADMIN
+        int user_timeout; // TCP_USER_TIMEOUT in milliseconds, how long sent data may stay unacknowledged
+        int keep_alive; // SO_KEEPALIVE
+        int keep_idle; // TCP_KEEPIDLE in seconds
+        int keep_interval; // TCP_KEEPINTVL in seconds
+        int keep_count; // TCP_KEEPCNT
+
+        SocketOptions()
+        : no_delay(-1),
+        send_buffer(-1),
+        receive_buffer(-1),
+        quick_ack(-1),
+        busy_poll(-1),
+        user_timeout(-1),
+        keep_alive(-1),
+        keep_idle(-1),
+        keep_interval(-1),
+        keep_count(-1) {
+        }
+
+        // small messages that have to go out at once, and dead peers found within seconds
+        static SocketOptions LowLatency();
+
+        // large transfers, big buffers and Nagle left on to fill the segments
+        static SocketOptions BulkThroughput();
+
+    };
+
+    std::ostream& operator<<(std::ostream& os, const SocketOptions& options);
+
+    // sets the options on an open socket, each failure is logged and the rest still applied
+    void apply_socket_options(boost::asio::ip::tcp::socket& socket, const SocketOptions& options);
+    void apply_socket_options(StreamSocket& socket, const SocketOptions& options);
+
+    // the buffer sizes for the sockets accepted by a listening socket, and SO_REUSEPORT if asked
+    // for. False if SO_REUSEPORT was asked for but could not be set
+    bool apply_listen_options(boost::asio::ip::tcp::acceptor& acceptor, const SocketOptions& options, bool reuse_port);
+    bool apply_listen_options(StreamAcceptor& acceptor, const SocketOptions& options, bool reuse_port);
+
+    // TCP_QUICKACK only, for re-arming it after a read
+    void apply_quick_ack(boost::asio::ip::tcp::socket& socket);
+    void apply_quick_ack(StreamSocket& socket);
+
+    // the values currently in effect on the socket
+    SocketOptions read_socket_options(boost::asio::ip::tcp::socket& socket);
+    SocketOptions read_socket_options(StreamSocket& socket);
+
+}
+
+#endif	/* SOCKETOPTIONS_H */
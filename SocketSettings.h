@@ -0,0 +1,160 @@
+/*
+ * File:   SocketSettings.h
+ * Author: mihiranad
+ *
+ * The per connection settings of a stream socket handler and the enums they
+ * are made of, see BasicSocketHandler::Configure.
+ */
+
+#ifndef SOCKETSETTINGS_H
+#define	SOCKETSETTINGS_H
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include "BufferPool.h"
+#include "IoRunner.h"
+#include "LockFreeQueue.h"
+#include "ReconnectState.h"
+#include "SessionCapture.h"
+#include "SharedMemoryStream.h"
+#include "SocketLog.h"
+#include "UringService.h"
+
+#define CONNECT_TIMEOUT 10 // seconds, the default of SocketSettings::connect_timeout_ms
+
+namespace modt_socket {
+
+    enum ReadMode {
+        READ_REQUESTED, // deliver exactly the number of bytes asked for via SocketHandler::Read()
+        READ_STREAMING, // deliver whatever has arrived as soon as it arrives, no read requests needed
+        READ_FRAMED // deliver complete frames, as found by SocketHandler::ParseFrame, no read requests needed
+    };
+
+    enum WriteNotify {
+        NOTIFY_PER_BATCH, // OnAsyncWrite is called once per gathered write with the total bytes written
+        NOTIFY_PER_MESSAGE // OnAsyncWrite is called for every message of the gathered write
+    };
+
+    enum ReadNotify {
+        READ_PER_MESSAGE, // OnReceive is called for every chunk, read request or frame delivered
+        READ_PER_BATCH // OnReceiveBatch is called once with everything a single socket read completed
+    };
+
+    enum WriteStatus {
+        WRITE_QUEUED, // queued for writing
+        WRITE_QUEUE_FULL, // refused, the write queue is at its capacity
+        WRITE_WOULD_BLOCK, // refused, the backlog is above the high watermark (OVERFLOW_REJECT)
+        WRITE_DROPPED // discarded, the backlog is above the high watermark (OVERFLOW_DROP_NEWEST)
+    };
+
+    enum OverflowPolicy { // what AsyncWrite does while the backlog is above the high watermark
+        OVERFLOW_REJECT, // refuse the message with WRITE_WOULD_BLOCK
+        OVERFLOW_DROP_NEWEST, // discard the message with WRITE_DROPPED
+        OVERFLOW_DROP_OLDEST, // queue the message, the write actor discards the oldest ones until below the high watermark
+        OVERFLOW_CONFLATE // queue the message, the write actor discards queued messages superseded by a later one with the same key
+    };
+
+    // whether the policy queues the message and leaves it to the write actor to thin out the queue
+    inline bool overflow_queues(OverflowPolicy policy) {
+        return policy == OVERFLOW_DROP_OLDEST || policy == OVERFLOW_CONFLATE;
+    }
+
+    struct SocketSettings { // per connection settings, picked up when the connection is made
+
+        ReadMode read_mode;
+        ReadNotify read_notify;
+
+        // the read and write request queues, QUEUE_SPSC is only safe if a single thread calls
+        // Read() and a single thread calls AsyncWrite(). Requests are refused when a queue is full
+        QueueKind queue_kind;
+        size_t read_queue_capacity;
+        size_t write_queue_capacity;
+
+        // size of the receive buffer, i.e. the largest read request that can be served. Ignored when
+        // buffer_pool is set, otherwise each connection gets a pool of its own of this block size
+        size_t read_buffer_size;
+        boost::shared_ptr<BufferPool> buffer_pool;
+
+        // block size and number of cached blocks of the pool behind SocketHandler::AllocateBuffer()
+        size_t write_buffer_size;
+        size_t write_buffer_cache;
+
+        // the write actor gathers queued messages into a single write until either limit is reached
+        size_t write_batch_messages;
+        size_t write_batch_bytes;
+        WriteNotify write_notify;
+
+        // limits on the write backlog, i.e. the bytes and messages queued or being written, 0 for no
+        // limit. Once a high watermark is reached write_overflow applies, and OnWritable is called when
+        // the backlog is back below both low watermarks. A low watermark of 0 is half the high one
+        size_t write_high_watermark_bytes;
+        size_t write_low_watermark_bytes;
+        size_t write_high_watermark_messages;
+        size_t write_low_watermark_messages;
+        OverflowPolicy write_overflow;
+
+        // binary trace of the connection's events, see SocketLog.h. May be shared by many connections
+        boost::shared_ptr<SocketEventLog> event_log;
+
+        // records the bytes received and written to a file for replaying later, see SessionCapture.h.
+        // May be shared by many connections
+        boost::shared_ptr<SessionCapture> capture;
+
+        // in milliseconds, 0 for none. Kept on the timer wheel of the io_service, see TimerWheel.h, and
+        // good to WHEEL_TICK_MS. A connection that receives nothing for read_idle_timeout_ms, or whose
+        // write does not complete within write_stall_timeout_ms, is closed with timed_out
+        size_t connect_timeout_ms;
+        size_t read_idle_timeout_ms;
+        size_t write_stall_timeout_ms;
+
+        // queued once nothing has been written for heartbeat_interval_ms, 0 for none. It has to be
+        // something the peer understands, e.g. a whole frame, and keeps its read idle timeout at bay
+        size_t heartbeat_interval_ms;
+        std::string heartbeat_message;
+
+        // off by default, a dropped connection stays down until Disconnect() and a new connect
+        ReconnectPolicy reconnect;
+
+        // a connection over a Unix-domain socket moves its data to shared memory rings, see
+        // SharedMemoryStream.h. Off by default, the accepting side has to have it on as well
+        SharedMemorySettings shared_memory;
+
+        // IO_BACKEND_URING moves the reads and writes of the connection to the io_uring of its
+        // io_service, see UringService.h. The connect, and shared memory connections, stay as they are
+        IoBackend io_backend;
+
+        // how the connection's own io thread runs, e.g. busy polling on a pinned CPU, see IoRunner.h.
+        // A pooled connection runs as its pool does
+        RunSettings run;
+
+        SocketSettings()
+        : read_mode(READ_REQUESTED),
+        read_notify(READ_PER_MESSAGE),
+        queue_kind(QUEUE_MPSC),
+        read_queue_capacity(1024),
+        write_queue_capacity(4096),
+        read_buffer_size(65000),
+        write_buffer_size(4096),
+        write_buffer_cache(64),
+        write_batch_messages(64),
+        write_batch_bytes(64 * 1024),
+        write_notify(NOTIFY_PER_MESSAGE),
+        write_high_watermark_bytes(0),
+        write_low_watermark_bytes(0),
+        write_high_watermark_messages(0),
+        write_low_watermark_messages(0),
+        write_overflow(OVERFLOW_REJECT),
+        connect_timeout_ms(CONNECT_TIMEOUT * 1000),
+        read_idle_timeout_ms(0),
+        write_stall_timeout_ms(0),
+        heartbeat_interval_ms(0),
+        io_backend(IO_BACKEND_REACTOR) {
+        }
+
+    };
+
+}
+
+#endif	/* SOCKETSETTINGS_H */
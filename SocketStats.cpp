@@ -0,0 +1,233 @@
+/*
+ * File:   SocketStats.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "SocketStats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace modt_socket;
+
+namespace {
+
+    const boost::uint64_t NO_MIN = std::numeric_limits<boost::uint64_t>::max();
+
+    size_t magnitude(boost::uint64_t value) { // position of the highest bit set
+
+        size_t bit = 0;
+        while (value >>= 1)
+            ++bit;
+        return bit;
+
+    }
+
+}
+
+size_t modt_socket::histogram_bucket(boost::uint64_t value) {
+
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return static_cast<size_t> (value);
+
+    size_t bits = magnitude(value);
+    if (bits > HISTOGRAM_MAX_MAGNITUDE)
+        return HISTOGRAM_BUCKETS - 1;
+
+    // the top HISTOGRAM_SUB_BITS + 1 bits pick the bucket within the power of two
+    size_t shift = bits - HISTOGRAM_SUB_BITS;
+    return HISTOGRAM_SUB_BUCKETS * (shift + 1) + static_cast<size_t> ((value >> shift) - HISTOGRAM_SUB_BUCKETS);
+
+}
+
+boost::uint64_t modt_socket::histogram_bucket_upper(size_t bucket) {
+
+    if (bucket < HISTOGRAM_SUB_BUCKETS)
+        return bucket;
+
+    size_t shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    boost::uint64_t lower = static_cast<boost::uint64_t> (HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+    return lower + ((static_cast<boost::uint64_t> (1) << shift) - 1);
+
+}
+
+HistogramSnapshot::HistogramSnapshot()
+: count(0),
+sum(0),
+min(0),
+max(0) {
+
+    std::fill(counts, counts + HISTOGRAM_BUCKETS, 0);
+
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& other) {
+
+    if (other.count == 0)
+        return;
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        counts[i] += other.counts[i];
+
+    min = count ? std::min(min, other.min) : other.min;
+    max = std::max(max, other.max);
+    count += other.count;
+    sum += other.sum;
+
+}
+
+boost::uint64_t HistogramSnapshot::percentile(double fraction) const {
+
+    // the bucket counts may add up to a little more or less than count if the
+    // snapshot was taken while samples were being recorded
+    boost::uint64_t total = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        total += counts[i];
+
+    if (total == 0)
+        return 0;
+
+    boost::uint64_t rank = static_cast<boost::uint64_t> (std::ceil(fraction * total));
+    rank = std::max<boost::uint64_t>(rank, 1);
+
+    boost::uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+
+        seen += counts[i];
+        if (seen >= rank)
+            return std::min(histogram_bucket_upper(i), max);
+
+    }
+
+    return max;
+
+}
+
+LatencyHistogram::LatencyHistogram()
+: count_(0),
+sum_(0),
+min_(NO_MIN),
+max_(0) {
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        counts_[i].store(0, boost::memory_order_relaxed);
+
+}
+
+void LatencyHistogram::snapshot(HistogramSnapshot& out) const {
+
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+        out.counts[i] = counts_[i].load(boost::memory_order_relaxed);
+
+    out.count = count_.load(boost::memory_order_relaxed);
+    out.sum = sum_.load(boost::memory_order_relaxed);
+    out.max = max_.load(boost::memory_order_relaxed);
+
+    boost::uint64_t min = min_.load(boost::memory_order_relaxed);
+    out.min = min == NO_MIN ? 0 : min;
+
+}
+
+SocketStats::SocketStats()
+: bytes_in(0),
+bytes_out(0),
+messages_in(0),
+messages_out(0),
+messages_dropped(0),
+read_queue_high_water(0),
+write_queue_high_water(0),
+connects(0),
+connect_time_ns(0),
+reconnects(0),
+timeouts(0),
+heartbeats(0),
+sequence_gaps(0),
+out_of_order(0),
+read_calls(0),
+write_calls(0),
+run_mode(0),
+run_cpu(-1),
+run_priority(0),
+polls(0),
+idle_polls(0),
+poll_sleeps(0) {
+}
+
+void SocketStats::merge(const SocketStats& other) {
+
+    bytes_in += other.bytes_in;
+    bytes_out += other.bytes_out;
+    messages_in += other.messages_in;
+    messages_out += other.messages_out;
+    messages_dropped += other.messages_dropped;
+
+    read_queue_high_water = std::max(read_queue_high_water, other.read_queue_high_water);
+    write_queue_high_water = std::max(write_queue_high_water, other.write_queue_high_water);
+
+    connects += other.connects;
+    connect_time_ns = std::max(connect_time_ns, other.connect_time_ns);
+    reconnects += other.reconnects;
+    timeouts += other.timeouts;
+    heartbeats += other.heartbeats;
+    sequence_gaps += other.sequence_gaps;
+    out_of_order += other.out_of_order;
+
+    read_calls += other.read_calls;
+    write_calls += other.write_calls;
+
+    run_mode = std::max(run_mode, other.run_mode);
+    run_cpu = std::max(run_cpu, other.run_cpu);
+    run_priority = std::max(run_priority, other.run_priority);
+    polls += other.polls;
+    idle_polls += other.idle_polls;
+    poll_sleeps += other.poll_sleeps;
+
+    write_latency.merge(other.write_latency);
+    read_latency.merge(other.read_latency);
+
+}
+
+SocketMetrics::SocketMetrics()
+: bytes_in(0),
+bytes_out(0),
+messages_in(0),
+messages_out(0),
+messages_dropped(0),
+read_queue_high_water(0),
+write_queue_high_water(0),
+connects(0),
+connect_time_ns(0),
+reconnects(0),
+timeouts(0),
+heartbeats(0),
+sequence_gaps(0),
+out_of_order(0),
+read_calls(0),
+write_calls(0) {
+}
+
+void SocketMetrics::snapshot(SocketStats& out) const {
+
+    out.bytes_in = bytes_in.load(boost::memory_order_relaxed);
+    out.bytes_out = bytes_out.load(boost::memory_order_relaxed);
+    out.messages_in = messages_in.load(boost::memory_order_relaxed);
+    out.messages_out = messages_out.load(boost::memory_order_relaxed);
+    out.messages_dropped = messages_dropped.load(boost::memory_order_relaxed);
+    out.read_queue_high_water = read_queue_high_water.load(boost::memory_order_relaxed);
+    out.write_queue_high_water = write_queue_high_water.load(boost::memory_order_relaxed);
+    out.connects = connects.load(boost::memory_order_relaxed);
+    out.connect_time_ns = connect_time_ns.load(boost::memory_order_relaxed);
+    out.reconnects = reconnects.load(boost::memory_order_relaxed);
+    out.timeouts = timeouts.load(boost::memory_order_relaxed);
+    out.heartbeats = heartbeats.load(boost::memory_order_relaxed);
+    out.sequence_gaps = sequence_gaps.load(boost::memory_order_relaxed);
+    out.out_of_order = out_of_order.load(boost::memory_order_relaxed);
+    out.read_calls = read_calls.load(boost::memory_order_relaxed);
+    out.write_calls = write_calls.load(boost::memory_order_relaxed);
+
+    write_latency.snapshot(out.write_latency);
+    read_latency.snapshot(out.read_latency);
+
+}
@@ -0,0 +1,186 @@
+/*
+ * File:   SocketStats.h
+ * Author: mihiranad
+ *
+ * Per connection performance counters. SocketMetrics is the live set the
+ * actors update, made of relaxed atomics only so the io_service thread and
+ * the threads queueing requests never take a lock for it. SocketStats is a
+ * plain snapshot of it, as returned by SocketHandler::GetStats(), and can be
+ * merged with the snapshots of other handlers to get totals.
+ */
+
+#ifndef SOCKETSTATS_H
+#define	SOCKETSTATS_H
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace modt_socket {
+
+    // monotonic time in nanoseconds, used for all the latencies below
+    inline boost::uint64_t stats_now() {
+
+        return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+                boost::chrono::steady_clock::now().time_since_epoch()).count();
+
+    }
+
+    inline void stats_add(boost::atomic<boost::uint64_t>& counter, boost::uint64_t value) {
+
+        counter.fetch_add(value, boost::memory_order_relaxed);
+
+    }
+
+    inline void stats_high_water(boost::atomic<boost::uint64_t>& mark, boost::uint64_t value) {
+
+        boost::uint64_t current = mark.load(boost::memory_order_relaxed);
+        while (value > current && !mark.compare_exchange_weak(current, value, boost::memory_order_relaxed));
+
+    }
+
+    // log linear buckets in the style of an HDR histogram: every power of two is split
+    // into HISTOGRAM_SUB_BUCKETS linear buckets, values are kept within 1/16 (6.25%)
+    enum {
+        HISTOGRAM_SUB_BITS = 4,
+        HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BITS,
+        HISTOGRAM_MAX_MAGNITUDE = 47, // values from 2^48 ns (about 3 days) up land in the last bucket
+        HISTOGRAM_BUCKETS = HISTOGRAM_SUB_BUCKETS * (HISTOGRAM_MAX_MAGNITUDE - HISTOGRAM_SUB_BITS + 2)
+    };
+
+    size_t histogram_bucket(boost::uint64_t value);
+    boost::uint64_t histogram_bucket_upper(size_t bucket); // largest value falling into the bucket
+
+    struct HistogramSnapshot {
+
+        boost::uint64_t counts[HISTOGRAM_BUCKETS];
+        boost::uint64_t count;
+        boost::uint64_t sum;
+        boost::uint64_t min;
+        boost::uint64_t max;
+
+        HistogramSnapshot();
+
+        void merge(const HistogramSnapshot& other);
+
+        // the value at or below which the given fraction (0.0 - 1.0) of the samples are, 0 if there are none
+        boost::uint64_t percentile(double fraction) const;
+
+        double mean() const {
+            return count ? static_cast<double> (sum) / count : 0.0;
+        }
+
+    };
+
+    class LatencyHistogram : private boost::noncopyable {
+    public:
+
+        LatencyHistogram();
+
+        void record(boost::uint64_t value) {
+
+            counts_[histogram_bucket(value)].fetch_add(1, boost::memory_order_relaxed);
+            count_.fetch_add(1, boost::memory_order_relaxed);
+            sum_.fetch_add(value, boost::memory_order_relaxed);
+
+            boost::uint64_t current = min_.load(boost::memory_order_relaxed);
+            while (value < current && !min_.compare_exchange_weak(current, value, boost::memory_order_relaxed));
+
+            current = max_.load(boost::memory_order_relaxed);
+            while (value > current && !max_.compare_exchange_weak(current, value, boost::memory_order_relaxed));
+
+        }
+
+        // the buckets are read one by one while samples may still come in, so
+        // the snapshot is consistent per bucket rather than as a whole
+        void snapshot(HistogramSnapshot& out) const;
+
+    private:
+
+        boost::atomic<boost::uint64_t> counts_[HISTOGRAM_BUCKETS];
+        boost::atomic<boost::uint64_t> count_;
+        boost::atomic<boost::uint64_t> sum_;
+        boost::atomic<boost::uint64_t> min_;
+        boost::atomic<boost::uint64_t> max_;
+
+    };
+
+    struct SocketStats {
+
+        boost::uint64_t bytes_in; // received from the socket
+        boost::uint64_t bytes_out; // written to the socket, async and blocking
+        boost::uint64_t messages_in; // read callbacks made, i.e. requests served, chunks streamed or frames delivered
+        boost::uint64_t messages_out; // messages written, async and blocking
+        boost::uint64_t messages_dropped; // discarded by the write overflow policy, or datagrams truncated or not sent
+
+        boost::uint64_t read_queue_high_water; // deepest the read request queue has been
+        boost::uint64_t write_queue_high_water; // deepest the write queue has been
+
+        boost::uint64_t connects; // successful connections
+        boost::uint64_t connect_time_ns; // time taken by the last successful connect
+        boost::uint64_t reconnects; // attempts scheduled by the reconnect policy
+        boost::uint64_t timeouts; // connect, read idle and write stall timeouts
+        boost::uint64_t heartbeats; // heartbeat messages queued on an idle connection
+
+        // datagram sockets with gap detection: sequence numbers skipped, and datagrams that came
+        // in late or twice. A datagram that turns up late was counted as a gap first
+        boost::uint64_t sequence_gaps;
+        boost::uint64_t out_of_order;
+
+        // socket operations issued. A gathered async_write the kernel takes in several
+        // goes counts once, so these are a lower bound on the actual system calls
+        boost::uint64_t read_calls;
+        boost::uint64_t write_calls;
+
+        // how the io thread of the connection runs, see IoRunner.h. The poll counts are the
+        // thread's, every connection on a pool thread reports the same ones
+        int run_mode; // a RunMode
+        int run_cpu; // -1 if the thread is not pinned
+        int run_priority; // SCHED_FIFO priority, 0 if none
+        boost::uint64_t polls; // poll() calls of a busy polling thread
+        boost::uint64_t idle_polls; // of those, the ones that ran nothing
+        boost::uint64_t poll_sleeps; // times the thread went to sleep after spinning idle
+
+        HistogramSnapshot write_latency; // enqueued by AsyncWrite until the write completed
+        HistogramSnapshot read_latency; // received from the socket until handed to the read callback
+
+        SocketStats();
+
+        // adds up the counters, the high water marks, connect time and run fields take the larger of the two
+        void merge(const SocketStats& other);
+
+    };
+
+    class SocketMetrics : private boost::noncopyable {
+    public:
+
+        SocketMetrics();
+
+        void snapshot(SocketStats& out) const;
+
+        boost::atomic<boost::uint64_t> bytes_in;
+        boost::atomic<boost::uint64_t> bytes_out;
+        boost::atomic<boost::uint64_t> messages_in;
+        boost::atomic<boost::uint64_t> messages_out;
+        boost::atomic<boost::uint64_t> messages_dropped;
+        boost::atomic<boost::uint64_t> read_queue_high_water;
+        boost::atomic<boost::uint64_t> write_queue_high_water;
+        boost::atomic<boost::uint64_t> connects;
+        boost::atomic<boost::uint64_t> connect_time_ns;
+        boost::atomic<boost::uint64_t> reconnects;
+        boost::atomic<boost::uint64_t> timeouts;
+        boost::atomic<boost::uint64_t> heartbeats;
+        boost::atomic<boost::uint64_t> sequence_gaps;
+        boost::atomic<boost::uint64_t> out_of_order;
+        boost::atomic<boost::uint64_t> read_calls;
+        boost::atomic<boost::uint64_t> write_calls;
+
+        LatencyHistogram write_latency;
+        LatencyHistogram read_latency;
+
+    };
+
+}
+
+#endif	/* SOCKETSTATS_H */
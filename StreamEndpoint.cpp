@@ -0,0 +1,65 @@
+/*
+ * File:   StreamEndpoint.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "StreamEndpoint.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <boost/lexical_cast.hpp>
+
+using namespace modt_socket;
+
+StreamEndpoint modt_socket::make_tcp_endpoint(const char* ip, const char* port) {
+
+    return boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(ip), atoi(port)); // atoi?
+
+}
+
+StreamEndpoint modt_socket::make_local_endpoint(const char* path) {
+
+    return boost::asio::local::stream_protocol::endpoint(path);
+
+}
+
+bool modt_socket::is_local(const StreamEndpoint& ep) {
+
+    return ep.protocol().family() == AF_UNIX;
+
+}
+
+std::string modt_socket::endpoint_name(const StreamEndpoint& ep) {
+
+    if (is_local(ep)) {
+
+        const struct sockaddr_un* address = reinterpret_cast<const struct sockaddr_un*> (ep.data());
+        size_t length = ep.size() > offsetof(struct sockaddr_un, sun_path) ? ep.size() - offsetof(struct sockaddr_un, sun_path) : 0;
+        return "unix:" + std::string(address->sun_path, strnlen(address->sun_path, length));
+
+    }
+
+    boost::asio::ip::tcp::endpoint tcp_ep;
+    if (ep.size() <= tcp_ep.capacity()) {
+        std::memcpy(tcp_ep.data(), ep.data(), ep.size());
+        tcp_ep.resize(ep.size());
+    }
+    return tcp_ep.address().to_string() + ":" + boost::lexical_cast<std::string>(tcp_ep.port());
+
+}
+
+unsigned short modt_socket::endpoint_port(const StreamEndpoint& ep) {
+
+    if (ep.protocol().family() == AF_INET)
+        return ntohs(reinterpret_cast<const struct sockaddr_in*> (ep.data())->sin_port);
+    if (ep.protocol().family() == AF_INET6)
+        return ntohs(reinterpret_cast<const struct sockaddr_in6*> (ep.data())->sin6_port);
+    return 0;
+
+}
@@ -0,0 +1,40 @@
+/*
+ * File:   StreamEndpoint.h
+ * Author: mihiranad
+ *
+ * The stream transports a connection can run over. Sockets, acceptors and
+ * endpoints are asio's generic stream protocol ones, so the same AsioSocket
+ * serves TCP and Unix-domain stream sockets; a tcp::endpoint converts to a
+ * StreamEndpoint implicitly.
+ */
+
+#ifndef STREAMENDPOINT_H
+#define	STREAMENDPOINT_H
+
+#include <string>
+
+#include <boost/asio/basic_socket_acceptor.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+namespace modt_socket {
+
+    typedef boost::asio::generic::stream_protocol::socket StreamSocket;
+    typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> StreamAcceptor;
+    typedef boost::asio::generic::stream_protocol::endpoint StreamEndpoint;
+
+    StreamEndpoint make_tcp_endpoint(const char* ip, const char* port);
+    StreamEndpoint make_local_endpoint(const char* path); // a Unix-domain socket
+
+    bool is_local(const StreamEndpoint& ep);
+
+    // ip:port, or the path of a Unix-domain socket
+    std::string endpoint_name(const StreamEndpoint& ep);
+
+    // 0 for a Unix-domain socket
+    unsigned short endpoint_port(const StreamEndpoint& ep);
+
+}
+
+#endif	/* STREAMENDPOINT_H */
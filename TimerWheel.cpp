@@ -0,0 +1,267 @@
+/*
+ * File:   TimerWheel.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "TimerWheel.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include "SocketStats.h"
+#include "SocketLog.h"
+
+using namespace modt_socket;
+
+boost::asio::io_service::id TimerWheel::id;
+
+namespace {
+
+    const boost::uint64_t TICK_NS = WHEEL_TICK_MS * 1000000ULL;
+
+    inline size_t level_shift(size_t level) { // level 1 and up
+        return WHEEL_ROOT_BITS + (level - 1) * WHEEL_LEVEL_BITS;
+    }
+
+}
+
+TimerWheel::TimerWheel(boost::asio::io_service& io_service)
+: boost::asio::io_service::service(io_service),
+ticker_(io_service),
+ticking_(false),
+shutdown_(false),
+current_(now_ticks()),
+size_(0) {
+
+    for (size_t i = 0; i < (1 << WHEEL_ROOT_BITS); ++i)
+        clear(root_[i].head);
+    for (size_t level = 0; level < WHEEL_LEVELS - 1; ++level)
+        for (size_t i = 0; i < (1 << WHEEL_LEVEL_BITS); ++i)
+            clear(levels_[level][i].head);
+
+    MODT_SOCKET_LOG_DEBUG(g_Logger, "TimerWheel::TimerWheel()", "Created timer wheel [" << this << "]");
+
+}
+
+TimerWheel::~TimerWheel() {
+
+    MODT_SOCKET_LOG_DEBUG(g_Logger, "TimerWheel::~TimerWheel()", "Destroyed timer wheel [" << this << "] with " << size_ << " timers");
+
+}
+
+void TimerWheel::shutdown() {
+
+    shutdown_ = true;
+    boost::system::error_code ignored;
+    ticker_.cancel(ignored);
+
+    // unlinked first, releasing an owner may destroy other timers still in the wheel
+    std::vector<boost::shared_ptr<void> > owners;
+    owners.reserve(size_);
+    drain(root_, 1 << WHEEL_ROOT_BITS, owners);
+    for (size_t level = 0; level < WHEEL_LEVELS - 1; ++level)
+        drain(levels_[level], 1 << WHEEL_LEVEL_BITS, owners);
+    size_ = 0;
+
+}
+
+boost::uint64_t TimerWheel::now_ticks() {
+
+    return stats_now() / TICK_NS;
+
+}
+
+void TimerWheel::drain(Slot* slots, size_t count, std::vector<boost::shared_ptr<void> >& owners) {
+
+    for (size_t i = 0; i < count; ++i) {
+
+        Timer& head = slots[i].head;
+        while (head.next_ != &head) {
+            Timer& timer = *head.next_;
+            unlink(timer);
+            owners.push_back(boost::shared_ptr<void>());
+            owners.back().swap(timer.owner_);
+        }
+
+    }
+
+}
+
+void TimerWheel::schedule(Timer& timer, boost::uint64_t due, Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    if (shutdown_)
+        return;
+
+    if (timer.scheduled())
+        unlink(timer);
+    else
+        ++size_;
+
+    if (!ticking_) {
+
+        // nothing was scheduled, the wheel was not turning and catches up at once
+        current_ = now_ticks();
+
+    }
+
+    timer.expiry_ = (due + TICK_NS - 1) / TICK_NS;
+    timer.callback_ = callback;
+    timer.context_ = context;
+    timer.owner_ = owner;
+    link(timer);
+
+    if (!ticking_) {
+        ticking_ = true;
+        start_ticker();
+    }
+
+}
+
+void TimerWheel::cancel(Timer& timer) {
+
+    if (!timer.scheduled())
+        return;
+
+    unlink(timer);
+    --size_;
+    timer.owner_.reset();
+
+}
+
+size_t TimerWheel::size() const {
+
+    return size_;
+
+}
+
+void TimerWheel::link(Timer& timer) {
+
+    // a timer already due goes into the next slot to be processed
+    boost::uint64_t expiry = timer.expiry_ > current_ ? timer.expiry_ : current_ + 1;
+    boost::uint64_t delta = expiry - current_;
+
+    Timer* head = NULL;
+    if (delta < (1ULL << WHEEL_ROOT_BITS)) {
+
+        head = &root_[expiry & ((1 << WHEEL_ROOT_BITS) - 1)].head;
+
+    } else {
+
+        size_t level = 1;
+        while (level < WHEEL_LEVELS - 1 && delta >= (1ULL << level_shift(level + 1)))
+            ++level;
+
+        // beyond the last level it waits in the last slot and is cascaded down again
+        if (delta >= (1ULL << level_shift(WHEEL_LEVELS)))
+            expiry = current_ + (1ULL << level_shift(WHEEL_LEVELS)) - 1;
+
+        head = &levels_[level - 1][(expiry >> level_shift(level)) & ((1 << WHEEL_LEVEL_BITS) - 1)].head;
+
+    }
+
+    timer.next_ = head;
+    timer.prev_ = head->prev_;
+    head->prev_->next_ = &timer;
+    head->prev_ = &timer;
+
+}
+
+void TimerWheel::unlink(Timer& timer) {
+
+    timer.prev_->next_ = timer.next_;
+    timer.next_->prev_ = timer.prev_;
+    timer.next_ = timer.prev_ = NULL; // not scheduled()
+
+}
+
+void TimerWheel::clear(Timer& head) {
+
+    head.next_ = head.prev_ = &head;
+
+}
+
+void TimerWheel::handle_tick(const boost::system::error_code& ec) {
+
+    if (shutdown_ || ec == boost::asio::error::operation_aborted)
+        return;
+
+    boost::uint64_t now = now_ticks();
+    while (current_ < now && size_ > 0)
+        advance();
+
+    if (size_ == 0) {
+        ticking_ = false; // sleeps until the next schedule
+        return;
+    }
+
+    start_ticker();
+
+}
+
+void TimerWheel::start_ticker() {
+
+    // waits for the start of the next tick rather than a tick from now, the time taken by the
+    // callbacks does not add up
+    boost::uint64_t now = stats_now();
+    boost::uint64_t next = (current_ + 1) * TICK_NS;
+    boost::uint64_t wait = next > now ? (next - now) / 1000 + 1 : 0;
+
+    ticker_.expires_from_now(boost::posix_time::microseconds(static_cast<boost::int64_t> (wait)));
+    ticker_.async_wait(boost::bind(&TimerWheel::handle_tick, this, _1));
+
+}
+
+void TimerWheel::advance() {
+
+    ++current_;
+
+    // every time a level wraps the next slot of the level above is spread over the ones below
+    for (size_t level = 1; level < WHEEL_LEVELS; ++level) {
+        if ((current_ & ((1ULL << level_shift(level)) - 1)) != 0)
+            break;
+        cascade(level);
+    }
+
+    Timer& head = root_[current_ & ((1 << WHEEL_ROOT_BITS) - 1)].head;
+    while (head.next_ != &head) {
+
+        Timer& timer = *head.next_;
+        unlink(timer);
+        --size_;
+
+        // the owner may only be held by the wheel, it has to outlive the callback
+        boost::shared_ptr<void> owner;
+        owner.swap(timer.owner_);
+        timer.callback_(timer.context_);
+
+    }
+
+}
+
+void TimerWheel::cascade(size_t level) {
+
+    Timer& head = levels_[level - 1][(current_ >> level_shift(level)) & ((1 << WHEEL_LEVEL_BITS) - 1)].head;
+
+    if (head.next_ == &head)
+        return;
+
+    // taken off as a whole first, a timer may land in the very same slot again
+    Timer list;
+    list.next_ = head.next_;
+    list.prev_ = head.prev_;
+    list.next_->prev_ = &list;
+    list.prev_->next_ = &list;
+    clear(head);
+
+    while (list.next_ != &list) {
+
+        Timer& timer = *list.next_;
+        list.next_ = timer.next_;
+        timer.next_->prev_ = &list;
+        link(timer);
+
+    }
+
+}
@@ -0,0 +1,122 @@
+/*
+ * File:   TimerWheel.h
+ * Author: mihiranad
+ *
+ * A hierarchical timer wheel shared by all the connections of an io_service,
+ * for the connect, read idle and write stall timeouts. It is an io_service
+ * service, so there is exactly one per io_service and it goes away with it:
+ *
+ *   TimerWheel& wheel = boost::asio::use_service<TimerWheel>(io_service);
+ *
+ * Scheduling, rescheduling and cancelling are O(1) list operations on an
+ * intrusive Timer, there is no heap and no asio operation per timer. One
+ * deadline_timer ticks the wheel every WHEEL_TICK_MS while any timer is
+ * scheduled. Timers never fire early and normally within a tick late. Everything,
+ * including the callbacks, runs on the io_service thread.
+ */
+
+#ifndef TIMERWHEEL_H
+#define	TIMERWHEEL_H
+
+#include <vector>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace modt_socket {
+
+    enum {
+        WHEEL_TICK_MS = 10,
+        WHEEL_LEVELS = 4,
+        WHEEL_ROOT_BITS = 8, // 256 ticks on the first level, 2.56 seconds
+        WHEEL_LEVEL_BITS = 6 // 64 slots on each level above, up to about 2.9 hours for the last one
+    };
+
+    class TimerWheel : public boost::asio::io_service::service {
+    public:
+
+        typedef void (*Callback)(void* context);
+
+        // a timer is embedded in its owner and linked into the wheel while scheduled
+        class Timer : private boost::noncopyable {
+        public:
+
+            Timer()
+            : next_(NULL),
+            prev_(NULL),
+            expiry_(0),
+            callback_(NULL),
+            context_(NULL) {
+            }
+
+            bool scheduled() const {
+                return prev_ != NULL;
+            }
+
+        private:
+
+            friend class TimerWheel;
+
+            Timer* next_;
+            Timer* prev_;
+            boost::uint64_t expiry_; // in ticks
+            Callback callback_;
+            void* context_;
+            boost::shared_ptr<void> owner_;
+
+        };
+
+        static boost::asio::io_service::id id;
+
+        explicit TimerWheel(boost::asio::io_service& io_service);
+        virtual ~TimerWheel();
+
+        // due is a stats_now() time, a scheduled timer is moved. The callback is called once,
+        // after the timer is unlinked, so it may schedule the timer again. The owner is kept
+        // alive while the timer is scheduled, as an async_wait on a deadline_timer would
+        void schedule(Timer& timer, boost::uint64_t due, Callback callback, void* context, const boost::shared_ptr<void>& owner);
+        void cancel(Timer& timer);
+
+        size_t size() const; // timers scheduled
+
+    private:
+
+        // drops the timers and their owners, the io_service is going away
+        virtual void shutdown();
+
+        // a slot is the head of a circular list, an empty slot points at itself
+        struct Slot {
+            Timer head;
+        };
+
+        static boost::uint64_t now_ticks();
+
+        void drain(Slot* slots, size_t count, std::vector<boost::shared_ptr<void> >& owners);
+
+        void link(Timer& timer);
+        static void unlink(Timer& timer);
+        static void clear(Timer& head); // an empty slot
+
+        void start_ticker();
+        void handle_tick(const boost::system::error_code& ec);
+        void advance(); // one tick, cascading the upper levels as the first one wraps
+        void cascade(size_t level);
+
+        boost::asio::deadline_timer ticker_;
+        bool ticking_;
+        bool shutdown_;
+
+        boost::uint64_t current_; // the tick being processed
+        size_t size_;
+
+        Slot root_[1 << WHEEL_ROOT_BITS];
+        Slot levels_[WHEEL_LEVELS - 1][1 << WHEEL_LEVEL_BITS];
+
+    };
+
+}
+
+#endif	/* TIMERWHEEL_H */
@@ -0,0 +1,574 @@
+/*
+ * File:   UringService.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "UringService.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <boost/bind.hpp>
+
+#include "SocketLog.h"
+
+#ifdef MODT_SOCKET_HAS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace modt_socket;
+
+boost::asio::io_service::id UringService::id;
+
+#ifdef MODT_SOCKET_HAS_IO_URING
+
+namespace {
+
+    // there is no liburing here, the three system calls are all it takes
+
+    int uring_setup(unsigned entries, struct io_uring_params* params) {
+        return static_cast<int> (::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int> (::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0));
+    }
+
+    int uring_register(int fd, unsigned opcode, const void* arg, unsigned count) {
+        return static_cast<int> (::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+
+    // the ops the connections use, all there since 5.6
+    bool supports_ops(int fd) {
+
+        const size_t ops = 64;
+        char storage[sizeof (struct io_uring_probe) + ops * sizeof (struct io_uring_probe_op)];
+        std::memset(storage, 0, sizeof (storage));
+        struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*> (storage);
+
+        if (uring_register(fd, IORING_REGISTER_PROBE, probe, ops) < 0)
+            return false;
+
+        const int needed[] = {IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_READ_FIXED, IORING_OP_ASYNC_CANCEL};
+        for (size_t i = 0; i < sizeof (needed) / sizeof (needed[0]); ++i)
+            if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED))
+                return false;
+        return true;
+
+    }
+
+}
+
+UringService::UringService(boost::asio::io_service& io_service)
+: boost::asio::io_service::service(io_service),
+io_service_(io_service),
+ring_fd_(-1),
+shutdown_(false),
+submit_scheduled_(false),
+waiting_(false),
+sq_ring_(NULL),
+sq_ring_size_(0),
+cq_ring_(NULL),
+cq_ring_size_(0),
+sqes_(NULL),
+sqes_size_(0),
+sq_head_(NULL),
+sq_tail_(NULL),
+sq_mask_(NULL),
+sq_flags_(NULL),
+sq_array_(NULL),
+cq_head_(NULL),
+cq_tail_(NULL),
+cq_mask_(NULL),
+cqes_(NULL),
+sq_local_tail_(0),
+sq_submitted_(0),
+sq_entries_(0),
+wake_(io_service),
+wake_count_(0),
+fixed_buffers_(false) {
+
+    pending_.next_ = pending_.prev_ = &pending_;
+
+    if (setup())
+        MODT_SOCKET_LOG_INFO(g_Logger, "UringService::UringService()", "io_uring set up with " << sq_entries_ << " entries, fixed buffers " << (fixed_buffers_ ? "on" : "off"));
+    else
+        MODT_SOCKET_LOG_WARN(g_Logger, "UringService::UringService()", "io_uring is not available, connections stay on the reactor");
+
+}
+
+UringService::~UringService() {
+
+    close_ring();
+
+}
+
+bool UringService::setup() {
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof (params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = URING_ENTRIES * 4;
+
+    ring_fd_ = uring_setup(URING_ENTRIES, &params);
+    if (ring_fd_ < 0) {
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "UringService::setup()", "io_uring_setup failed : " << strerror(errno));
+        ring_fd_ = -1;
+        return false;
+    }
+
+    // older kernels drop completions once the queue overflows, or lack an op
+    if (!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_SINGLE_MMAP) || !supports_ops(ring_fd_)) {
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "UringService::setup()", "io_uring lacks the features needed : " << params.features);
+        close_ring();
+        return false;
+    }
+
+    // one mapping holds both rings
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+    if (cq_ring_size_ > sq_ring_size_)
+        sq_ring_size_ = cq_ring_size_;
+
+    void* ring = ::mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        close_ring();
+        return false;
+    }
+    sq_ring_ = cq_ring_ = ring;
+    cq_ring_size_ = 0; // not mapped on its own
+
+    sqes_size_ = params.sq_entries * sizeof (struct io_uring_sqe);
+    void* sqes = ::mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        close_ring();
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*> (sqes);
+
+    char* sq = static_cast<char*> (sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*> (sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*> (sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*> (sq + params.sq_off.ring_mask);
+    sq_flags_ = reinterpret_cast<unsigned*> (sq + params.sq_off.flags);
+    sq_array_ = reinterpret_cast<unsigned*> (sq + params.sq_off.array);
+    sq_entries_ = params.sq_entries;
+    sq_local_tail_ = sq_submitted_ = *sq_tail_;
+
+    char* cq = static_cast<char*> (cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*> (cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*> (cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*> (cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*> (cq + params.cq_off.cqes);
+
+    // the kernel writes the eventfd on every completion, also on those reaped right after the submit
+    int wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    boost::system::error_code error;
+    if (wake >= 0)
+        wake_.assign(wake, error);
+    if (wake < 0 || error || uring_register(ring_fd_, IORING_REGISTER_EVENTFD, &wake, 1) < 0) {
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "UringService::setup()", "Could not register the completion eventfd : " << strerror(errno));
+        if (wake >= 0 && !wake_.is_open())
+            ::close(wake);
+        wake_.close(error);
+        close_ring();
+        return false;
+    }
+
+    // an empty table of receive buffers, a connection's block is put in its slot on its first receive
+    struct io_uring_rsrc_register buffers;
+    std::memset(&buffers, 0, sizeof (buffers));
+    buffers.nr = URING_FIXED_BUFFERS;
+    buffers.flags = IORING_RSRC_REGISTER_SPARSE;
+    fixed_buffers_ = uring_register(ring_fd_, IORING_REGISTER_BUFFERS2, &buffers, sizeof (buffers)) >= 0;
+
+    if (fixed_buffers_) {
+        slots_.resize(URING_FIXED_BUFFERS);
+        for (int slot = URING_FIXED_BUFFERS - 1; slot >= 0; --slot)
+            free_slots_.push_back(slot);
+    }
+
+    return true;
+
+}
+
+void UringService::close_ring() {
+
+    if (sqes_)
+        ::munmap(sqes_, sqes_size_);
+    if (sq_ring_)
+        ::munmap(sq_ring_, sq_ring_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_)
+        ::munmap(cq_ring_, cq_ring_size_);
+    if (ring_fd_ >= 0)
+        ::close(ring_fd_); // the kernel cancels whatever is still in flight
+
+    sqes_ = NULL;
+    sq_ring_ = cq_ring_ = NULL;
+    ring_fd_ = -1;
+
+}
+
+void UringService::shutdown() {
+
+    shutdown_ = true;
+
+    boost::system::error_code ignored;
+    wake_.close(ignored);
+    close_ring();
+
+    // unlinked first, releasing an owner may release other operations
+    std::vector<boost::shared_ptr<void> > owners;
+    while (pending_.next_ != &pending_) {
+
+        Operation* op = pending_.next_;
+        unlink(*op);
+        op->pending_ = false;
+        op->block_.reset();
+        owners.push_back(boost::shared_ptr<void>());
+        owners.back().swap(op->owner_);
+
+    }
+    slots_.clear();
+
+}
+
+int UringService::acquire_slot() {
+
+    if (free_slots_.empty())
+        return -1;
+
+    int slot = free_slots_.back();
+    free_slots_.pop_back();
+    return slot;
+
+}
+
+void UringService::release_slot(int slot) {
+
+    if (slot < 0 || shutdown_)
+        return;
+
+    // the kernel lets go of the pages once the receives still using them complete
+    if (slots_[slot]) {
+
+        struct iovec none = {NULL, 0};
+        struct io_uring_rsrc_update2 update;
+        std::memset(&update, 0, sizeof (update));
+        update.offset = slot;
+        update.data = reinterpret_cast<boost::uint64_t> (&none);
+        update.nr = 1;
+        uring_register(ring_fd_, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof (update));
+        slots_[slot].reset();
+
+    }
+    free_slots_.push_back(slot);
+
+}
+
+bool UringService::register_block(int slot, const BufferBlockPtr& block) {
+
+    struct iovec memory = {block->data(), block->capacity()};
+    struct io_uring_rsrc_update2 update;
+    std::memset(&update, 0, sizeof (update));
+    update.offset = slot;
+    update.data = reinterpret_cast<boost::uint64_t> (&memory);
+    update.nr = 1;
+
+    // fails once the locked memory limit is reached, the receive then goes into plain memory
+    if (uring_register(ring_fd_, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof (update)) != 1) {
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "UringService::register_block()", "Could not register a receive buffer : " << strerror(errno));
+        return false;
+    }
+
+    slots_[slot] = block;
+    return true;
+
+}
+
+bool UringService::receive(Operation& op, int fd, const BufferBlockPtr& block, char* data, size_t size, int slot,
+        Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    struct io_uring_sqe* sqe = next_sqe();
+    if (!sqe)
+        return false;
+
+    bool fixed = fixed_buffers_ && slot >= 0 && (slots_[slot] == block || register_block(slot, block));
+
+    sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<boost::uint64_t> (data);
+    sqe->len = static_cast<unsigned> (size);
+    if (fixed)
+        sqe->buf_index = static_cast<boost::uint16_t> (slot);
+    sqe->user_data = reinterpret_cast<boost::uint64_t> (&op);
+
+    op.block_ = block;
+    start(op, callback, context, owner);
+    return true;
+
+}
+
+bool UringService::write(Operation& op, int fd, struct iovec* buffers, size_t count,
+        Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    struct io_uring_sqe* sqe = next_sqe();
+    if (!sqe)
+        return false;
+
+    std::memset(&op.message_, 0, sizeof (op.message_));
+    op.message_.msg_iov = buffers;
+    op.message_.msg_iovlen = count;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<boost::uint64_t> (&op.message_);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<boost::uint64_t> (&op);
+
+    start(op, callback, context, owner);
+    return true;
+
+}
+
+bool UringService::cancel(Operation& op) {
+
+    if (!op.pending_ || ring_fd_ < 0)
+        return true;
+
+    struct io_uring_sqe* sqe = next_sqe();
+    if (!sqe)
+        return false;
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<boost::uint64_t> (&op);
+    sqe->user_data = 0; // its own completion is of no interest
+
+    submit(0);
+    return true;
+
+}
+
+struct io_uring_sqe* UringService::next_sqe() {
+
+    // without SQPOLL the kernel takes every entry on io_uring_enter, so a submit makes room.
+    // Unless it refuses them for now, then every entry still belongs to the kernel
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        submit(0);
+        if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            MODT_SOCKET_LOG_DEBUG(g_Logger, "UringService::next_sqe()", "Submission queue full");
+            return NULL;
+        }
+    }
+
+    unsigned index = sq_local_tail_ & *sq_mask_;
+    sq_array_[index] = index;
+    ++sq_local_tail_;
+
+    struct io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof (*sqe));
+
+    schedule_submit();
+    return sqe;
+
+}
+
+void UringService::start(Operation& op, Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    op.callback_ = callback;
+    op.context_ = context;
+    op.owner_ = owner;
+    op.pending_ = true;
+
+    // linked at the back of the list of operations in flight
+    op.next_ = &pending_;
+    op.prev_ = pending_.prev_;
+    pending_.prev_->next_ = &op;
+    pending_.prev_ = &op;
+
+    if (!waiting_)
+        start_wait();
+
+}
+
+void UringService::unlink(Operation& op) {
+
+    op.prev_->next_ = op.next_;
+    op.next_->prev_ = op.prev_;
+    op.next_ = op.prev_ = NULL;
+
+}
+
+void UringService::schedule_submit() {
+
+    // the handlers ready to run now may queue more, they all go in one io_uring_enter
+    if (submit_scheduled_)
+        return;
+
+    submit_scheduled_ = true;
+    io_service_.post(boost::bind(&UringService::handle_submit, this));
+
+}
+
+void UringService::handle_submit() {
+
+    submit_scheduled_ = false;
+    if (shutdown_ || ring_fd_ < 0)
+        return;
+
+    submit(0);
+    reap(); // what completed on submission, e.g. a receive with the data already there
+
+}
+
+void UringService::submit(unsigned wait) {
+
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+
+    while (sq_submitted_ != sq_local_tail_) {
+
+        int taken = uring_enter(ring_fd_, sq_local_tail_ - sq_submitted_, wait, wait ? IORING_ENTER_GETEVENTS : 0);
+        if (taken > 0) {
+            sq_submitted_ += taken;
+            continue;
+        }
+
+        if (taken < 0 && errno == EINTR)
+            continue;
+
+        // EAGAIN or EBUSY, the kernel is short of memory or the completions have backed up;
+        // the entries stay queued and go with the next submit
+        MODT_SOCKET_LOG_DEBUG(g_Logger, "UringService::submit()", "io_uring_enter took nothing : " << strerror(errno));
+        schedule_submit();
+        return;
+
+    }
+
+}
+
+void UringService::start_wait() {
+
+    waiting_ = true;
+    wake_.async_read_some(boost::asio::buffer(&wake_count_, sizeof (wake_count_)),
+            boost::bind(&UringService::handle_wake, this, _1));
+
+}
+
+void UringService::handle_wake(const boost::system::error_code& ec) {
+
+    waiting_ = false;
+
+    if (shutdown_ || ec == boost::asio::error::operation_aborted)
+        return;
+
+    if (ec)
+        MODT_SOCKET_LOG_ERROR(g_Logger, "UringService::handle_wake()", "Completion eventfd error : " << ec.message());
+
+    reap();
+
+    // with nothing in flight the io_service is left free to run out of work
+    if (!waiting_ && pending_.next_ != &pending_)
+        start_wait();
+
+}
+
+void UringService::reap() {
+
+    while (ring_fd_ >= 0) {
+
+        unsigned head = *cq_head_;
+        if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+
+            // completions that did not fit are held by the kernel until asked for
+            if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW) {
+                uring_enter(ring_fd_, 0, 0, IORING_ENTER_GETEVENTS);
+                continue;
+            }
+            return;
+
+        }
+
+        struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+        Operation* op = reinterpret_cast<Operation*> (cqe->user_data);
+        int result = cqe->res;
+        __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+
+        if (!op)
+            continue;
+
+        unlink(*op);
+        op->pending_ = false;
+        op->block_.reset();
+
+        // the callback may start the operation again, or let go of the last reference to its owner
+        boost::shared_ptr<void> owner;
+        owner.swap(op->owner_);
+        op->callback_(op->context_, result);
+
+    }
+
+}
+
+#else
+
+UringService::UringService(boost::asio::io_service& io_service)
+: boost::asio::io_service::service(io_service),
+io_service_(io_service),
+ring_fd_(-1),
+shutdown_(false),
+submit_scheduled_(false),
+waiting_(false),
+wake_(io_service),
+wake_count_(0),
+fixed_buffers_(false) {
+
+    pending_.next_ = pending_.prev_ = &pending_;
+
+}
+
+UringService::~UringService() {
+}
+
+void UringService::shutdown() {
+
+    shutdown_ = true;
+
+}
+
+int UringService::acquire_slot() {
+
+    return -1;
+
+}
+
+void UringService::release_slot(int slot) {
+}
+
+bool UringService::receive(Operation& op, int fd, const BufferBlockPtr& block, char* data, size_t size, int slot,
+        Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    return false; // never started, available() is false
+
+}
+
+bool UringService::write(Operation& op, int fd, struct iovec* buffers, size_t count,
+        Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    return false;
+
+}
+
+bool UringService::cancel(Operation& op) {
+
+    return true;
+
+}
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * File:   UringService.h
+ * Author: mihiranad
+ *
+ * An io_uring ring shared by all the connections of an io_service that ask
+ * for the IO_BACKEND_URING backend. Like TimerWheel it is an io_service
+ * service, one per io_service and only set up once a connection uses it:
+ *
+ *   UringService& uring = boost::asio::use_service<UringService>(io_service);
+ *
+ * A receive or a write is queued as a submission and completes through a
+ * callback, there is no readiness wait in between. Everything queued while
+ * the io_service runs its ready handlers goes to the kernel in a single
+ * io_uring_enter, so the writes of many connections cost one system call.
+ * Receives go into the connection's read block, registered with the ring
+ * while the connection holds a fixed buffer slot, so the kernel does not
+ * have to map the user memory on every receive.
+ *
+ * Completions signal an eventfd the io_service waits on, those finished on
+ * submission are also picked up straight after it.
+ * Everything, including the callbacks, runs on the io_service thread.
+ *
+ * On a kernel without io_uring, or with it disabled, available() is false
+ * and the connections stay on the reactor. Defining MODT_SOCKET_NO_IO_URING
+ * leaves it out of the build altogether.
+ */
+
+#ifndef URINGSERVICE_H
+#define	URINGSERVICE_H
+
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "BufferPool.h"
+
+#if defined(__linux__) && !defined(MODT_SOCKET_NO_IO_URING)
+#define MODT_SOCKET_HAS_IO_URING // otherwise available() is always false
+#endif
+
+struct io_uring_sqe; // linux/io_uring.h, only included by UringService.cpp
+struct io_uring_cqe;
+
+namespace modt_socket {
+
+    enum IoBackend {
+        IO_BACKEND_REACTOR, // asio's reactor, epoll on Linux: a readiness wait, then the read or write
+        IO_BACKEND_URING // io_uring where the kernel has it, the reactor where it does not
+    };
+
+    enum {
+        URING_ENTRIES = 256, // submission queue entries, the completion queue is four times that
+        URING_FIXED_BUFFERS = 256 // registered receive buffer slots, connections beyond that receive into plain memory
+    };
+
+    class UringService : public boost::asio::io_service::service {
+    public:
+
+        typedef void (*Callback)(void* context, int result); // result is the bytes done or -errno
+
+        // one receive or write in flight, embedded in its owner. It must not be started again
+        // before its callback has run
+        class Operation : private boost::noncopyable {
+        public:
+
+            Operation()
+            : callback_(NULL),
+            context_(NULL),
+            pending_(false),
+            next_(NULL),
+            prev_(NULL) {
+            }
+
+            bool pending() const {
+                return pending_;
+            }
+
+        private:
+
+            friend class UringService;
+
+            Callback callback_;
+            void* context_;
+            boost::shared_ptr<void> owner_;
+            BufferBlockPtr block_; // the receive memory stays allocated until the kernel is done with it
+            struct msghdr message_;
+            bool pending_;
+
+            Operation* next_; // in the list of operations in flight
+            Operation* prev_;
+
+        };
+
+        static boost::asio::io_service::id id;
+
+        explicit UringService(boost::asio::io_service& io_service);
+        virtual ~UringService();
+
+        // whether the ring could be set up, the kernel may lack io_uring or have it disabled
+        bool available() const {
+            return ring_fd_ >= 0;
+        }
+
+        // a fixed buffer slot for a connection's receives, -1 if none is left
+        int acquire_slot();
+        void release_slot(int slot);
+
+        // receives up to size bytes at data, which lies in block. With a slot, the block is
+        // registered in it first if it is not already. The owner is kept alive until the callback.
+        // False if the submission queue is full and the kernel takes nothing off it, the
+        // operation is not started then and the caller goes to the reactor for it
+        bool receive(Operation& op, int fd, const BufferBlockPtr& block, char* data, size_t size, int slot,
+                Callback callback, void* context, const boost::shared_ptr<void>& owner);
+
+        // a gathered send of buffers, which have to stay valid until the callback. Like a
+        // single sendmsg it may write only part of them. False as for receive
+        bool write(Operation& op, int fd, struct iovec* buffers, size_t count,
+                Callback callback, void* context, const boost::shared_ptr<void>& owner);
+
+        // the operation completes soon with -ECANCELED, or with its result if that was quicker.
+        // Goes to the kernel at once, the socket may be closed right after. False if there was no
+        // room for the cancel, shutting the socket down then ends the operation instead
+        bool cancel(Operation& op);
+
+    private:
+
+        // closes the ring and drops the owners of the operations still in flight
+        virtual void shutdown();
+
+        bool setup();
+        void close_ring();
+
+        struct io_uring_sqe* next_sqe(); // NULL while the submission queue is full
+        void start(Operation& op, Callback callback, void* context, const boost::shared_ptr<void>& owner);
+        static void unlink(Operation& op);
+
+        // hands the queued submissions to the kernel, once per run of ready handlers
+        void schedule_submit();
+        void handle_submit();
+        void submit(unsigned wait);
+
+        void start_wait();
+        void handle_wake(const boost::system::error_code& ec);
+
+        void reap();
+
+        bool register_block(int slot, const BufferBlockPtr& block);
+
+        boost::asio::io_service& io_service_;
+
+        int ring_fd_;
+        bool shutdown_;
+        bool submit_scheduled_;
+        bool waiting_; // a read of wake_ is outstanding, only while operations are in flight
+
+        // the rings as mapped from the kernel
+        void* sq_ring_;
+        size_t sq_ring_size_;
+        void* cq_ring_;
+        size_t cq_ring_size_;
+        struct io_uring_sqe* sqes_;
+        size_t sqes_size_;
+
+        unsigned* sq_head_;
+        unsigned* sq_tail_;
+        unsigned* sq_mask_;
+        unsigned* sq_flags_;
+        unsigned* sq_array_;
+        unsigned* cq_head_;
+        unsigned* cq_tail_;
+        unsigned* cq_mask_;
+        struct io_uring_cqe* cqes_;
+
+        unsigned sq_local_tail_; // one past the last submission queued
+        unsigned sq_submitted_; // one past the last submission the kernel has taken
+        unsigned sq_entries_;
+
+        boost::asio::posix::stream_descriptor wake_; // eventfd written by the kernel on completions
+        boost::uint64_t wake_count_;
+
+        // the block each fixed buffer slot has registered, empty if none, and the free slots
+        bool fixed_buffers_;
+        std::vector<BufferBlockPtr> slots_;
+        std::vector<int> free_slots_;
+
+        Operation pending_; // head of the circular list of operations in flight
+
+    };
+
+}
+
+#endif	/* URINGSERVICE_H */
@@ -0,0 +1,115 @@
+/*
+ * File:   UringStream.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "UringStream.h"
+
+#include <cerrno>
+
+#include <boost/asio/error.hpp>
+
+#include "SocketLog.h"
+
+extern modt_log::LogSink g_Logger;
+
+using namespace modt_socket;
+
+namespace {
+
+    boost::system::error_code completion_error(int result, const boost::system::error_code& closed) {
+
+        if (result > 0)
+            return boost::system::error_code();
+        if (result == 0)
+            return closed;
+        if (result == -ECANCELED)
+            return boost::asio::error::operation_aborted;
+        return boost::system::error_code(-result, boost::system::system_category());
+
+    }
+
+}
+
+UringStream::UringStream()
+: service_(NULL),
+slot_(-1) {
+}
+
+bool UringStream::open(boost::asio::io_service& io_service) {
+
+    if (service_)
+        return true;
+
+    UringService& service = boost::asio::use_service<UringService>(io_service);
+    if (!service.available())
+        return false; // logged by the service
+
+    service_ = &service;
+    slot_ = service.acquire_slot();
+    MODT_SOCKET_LOG_DEBUG(g_Logger, "UringStream::open()", "Reading and writing through io_uring, fixed buffer slot " << slot_);
+    return true;
+
+}
+
+bool UringStream::receive(int fd, const BufferBlockPtr& block, char* data, size_t size,
+        UringService::Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    return service_->receive(read_, fd, block, data, size, slot_, callback, context, owner);
+
+}
+
+bool UringStream::write(int fd, const std::vector<boost::asio::const_buffer>& buffers, size_t skip,
+        UringService::Callback callback, void* context, const boost::shared_ptr<void>& owner) {
+
+    buffers_.clear();
+    for (size_t i = 0; i < buffers.size(); ++i) {
+
+        size_t size = boost::asio::buffer_size(buffers[i]);
+        if (skip >= size) {
+            skip -= size;
+            continue;
+        }
+
+        struct iovec buffer;
+        buffer.iov_base = const_cast<char*> (boost::asio::buffer_cast<const char*> (buffers[i]) + skip);
+        buffer.iov_len = size - skip;
+        buffers_.push_back(buffer);
+        skip = 0;
+
+    }
+
+    return service_->write(write_, fd, &buffers_[0], buffers_.size(), callback, context, owner);
+
+}
+
+bool UringStream::cancel() {
+
+    if (!service_)
+        return true;
+
+    bool cancelled = service_->cancel(read_);
+    return service_->cancel(write_) && cancelled;
+
+}
+
+void UringStream::release_slot() {
+
+    if (service_)
+        service_->release_slot(slot_);
+    slot_ = -1;
+
+}
+
+boost::system::error_code UringStream::read_error(int result) {
+
+    return completion_error(result, boost::asio::error::eof);
+
+}
+
+boost::system::error_code UringStream::write_error(int result) {
+
+    return completion_error(result, boost::asio::error::broken_pipe);
+
+}
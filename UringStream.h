@@ -0,0 +1,74 @@
+/*
+ * File:   UringStream.h
+ * Author: mihiranad
+ *
+ * The io_uring side of a stream connection on the IO_BACKEND_URING backend:
+ * the io_service's UringService, the fixed buffer slot the connection
+ * receives into, and the one receive and one write it may have in flight.
+ * The connection decides what to read and write, this turns it into
+ * submissions and their results back into error codes.
+ */
+
+#ifndef URINGSTREAM_H
+#define	URINGSTREAM_H
+
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+
+#include "BufferPool.h"
+#include "UringService.h"
+
+namespace modt_socket {
+
+    class UringStream : private boost::noncopyable {
+    public:
+
+        UringStream();
+
+        // picks up the ring of io_service, false if the kernel has none and the connection stays
+        // on the reactor. Once open it stays open, later connections reuse it
+        bool open(boost::asio::io_service& io_service);
+
+        bool is_open() const {
+            return service_ != NULL;
+        }
+
+        // as UringService::receive, into the fixed buffer slot if there is one
+        bool receive(int fd, const BufferBlockPtr& block, char* data, size_t size,
+                UringService::Callback callback, void* context, const boost::shared_ptr<void>& owner);
+
+        // sends what is left of buffers after the first skip bytes, which stay valid until the callback
+        bool write(int fd, const std::vector<boost::asio::const_buffer>& buffers, size_t skip,
+                UringService::Callback callback, void* context, const boost::shared_ptr<void>& owner);
+
+        // the receive and the write in flight complete with -ECANCELED. False if the ring had no
+        // room for a cancel, shutting the socket down ends them instead
+        bool cancel();
+
+        // the connection is done with its read block, the slot goes back to the ring
+        void release_slot();
+
+        // the result of a completion as asio reports it, a 0 byte receive is the end of the stream
+        static boost::system::error_code read_error(int result);
+        static boost::system::error_code write_error(int result);
+
+    private:
+
+        UringService* service_;
+        UringService::Operation read_;
+        UringService::Operation write_;
+        int slot_; // the fixed buffer slot the read buffer is registered in, -1 if none
+        std::vector<struct iovec> buffers_; // what is left of the gather list
+
+    };
+
+}
+
+#endif	/* URINGSTREAM_H */
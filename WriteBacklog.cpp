@@ -0,0 +1,117 @@
+/*
+ * File:   WriteBacklog.cpp
+ * Author: mihiranad
+ *
+ */
+
+#include "WriteBacklog.h"
+
+#include <algorithm>
+
+#include <boost/move/utility_core.hpp>
+
+using namespace modt_socket;
+
+void modt_socket::consume_buffers(std::vector<boost::asio::const_buffer>& buffers, size_t bytes) {
+
+    size_t done = 0;
+    while (done < buffers.size() && bytes >= boost::asio::buffer_size(buffers[done]))
+        bytes -= boost::asio::buffer_size(buffers[done++]);
+
+    buffers.erase(buffers.begin(), buffers.begin() + done);
+    if (bytes && !buffers.empty())
+        buffers.front() = buffers.front() + bytes;
+
+}
+
+void WriteOverflow::push_front(WriteMsg& message) {
+
+    messages_.push_front(boost::move(message));
+
+}
+
+void WriteOverflow::push_back(WriteMsg& message) {
+
+    messages_.push_back(boost::move(message));
+
+}
+
+bool WriteOverflow::next(BoundedQueue<WriteMsg>& queue, WriteMsg& message) {
+
+    if (messages_.empty())
+        return queue.try_Dequeue(message);
+
+    message = boost::move(messages_.front());
+    messages_.pop_front();
+    return true;
+
+}
+
+size_t WriteOverflow::apply(const SocketSettings& settings, BoundedQueue<WriteMsg>& queue, WriteBacklog& backlog, size_t& dropped_bytes) {
+
+    size_t dropped = 0;
+    dropped_bytes = 0;
+
+    if (settings.write_overflow == OVERFLOW_DROP_OLDEST) {
+
+        // a write in flight can not be taken back, it still counts towards the backlog
+        WriteMsg message;
+        while (backlog.above_high(settings, 0) && next(queue, message)) {
+            dropped_bytes += message.size();
+            ++dropped;
+            backlog.remove(message.size(), 1);
+        }
+
+    } else if (settings.write_overflow == OVERFLOW_CONFLATE) {
+
+        dropped = conflate(queue, dropped_bytes);
+        backlog.remove(dropped_bytes, dropped);
+
+    }
+
+    return dropped;
+
+}
+
+size_t WriteOverflow::conflate(BoundedQueue<WriteMsg>& queue, size_t& dropped_bytes) {
+
+    // pull in what has been queued, as much again as the queue holds at most so the
+    // producers still run into WRITE_QUEUE_FULL
+    WriteMsg message;
+    while (messages_.size() < queue.Capacity() && queue.try_Dequeue(message))
+        messages_.push_back(boost::move(message));
+
+    // sorted by key and then position, every entry but the last of a key is superseded
+    keys_.clear();
+    for (size_t i = 0; i < messages_.size(); ++i) {
+        if (messages_[i].key)
+            keys_.push_back(std::make_pair(messages_[i].key, i));
+    }
+    std::sort(keys_.begin(), keys_.end());
+
+    superseded_.assign(messages_.size(), 0);
+    for (size_t i = 1; i < keys_.size(); ++i) {
+        if (keys_[i - 1].first == keys_[i].first)
+            superseded_[keys_[i - 1].second] = 1;
+    }
+
+    // compacted in place, the order of what is kept stays as it was
+    size_t dropped = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < messages_.size(); ++i) {
+
+        if (superseded_[i]) {
+            dropped_bytes += messages_[i].size();
+            ++dropped;
+            continue;
+        }
+        if (kept != i)
+            messages_[kept] = boost::move(messages_[i]);
+        ++kept;
+
+    }
+    messages_.erase(messages_.begin() + kept, messages_.end());
+
+    return dropped;
+
+}
@@ -0,0 +1,172 @@
+/*
+ * File:   WriteBacklog.h
+ * Author: mihiranad
+ *
+ * The write side of a connection apart from the socket: the messages queued
+ * for writing, the backlog the watermarks are kept against, and the messages
+ * the write actor holds back from the queue, which is where the overflow
+ * policies thin out what is waiting.
+ */
+
+#ifndef WRITEBACKLOG_H
+#define	WRITEBACKLOG_H
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#include "BufferPool.h"
+#include "LockFreeQueue.h"
+#include "SocketSettings.h"
+
+namespace modt_socket {
+
+    // the write backlog of a connection, updated by the threads calling AsyncWrite and by the write actor
+    struct WriteBacklog {
+
+        boost::atomic<size_t> bytes;
+        boost::atomic<size_t> messages;
+        boost::atomic<bool> blocked; // a high watermark was hit, OnWritable is due once below the low ones
+
+        WriteBacklog()
+        : bytes(0),
+        messages(0),
+        blocked(false) {
+        }
+
+        void reset() {
+            bytes.store(0, boost::memory_order_relaxed);
+            messages.store(0, boost::memory_order_relaxed);
+            blocked.store(false, boost::memory_order_relaxed);
+        }
+
+        void add(size_t size) {
+            bytes.fetch_add(size, boost::memory_order_relaxed);
+            messages.fetch_add(1, boost::memory_order_relaxed);
+        }
+
+        void remove(size_t size, size_t count) {
+            bytes.fetch_sub(size, boost::memory_order_relaxed);
+            messages.fetch_sub(count, boost::memory_order_relaxed);
+        }
+
+        // whether adding size bytes would cross a high watermark, an empty backlog always takes a message
+        bool above_high(const SocketSettings& settings, size_t size) const {
+
+            size_t count = messages.load(boost::memory_order_relaxed);
+            if (count == 0)
+                return false;
+
+            return (settings.write_high_watermark_messages && count + 1 > settings.write_high_watermark_messages)
+                    || (settings.write_high_watermark_bytes && bytes.load(boost::memory_order_relaxed) + size > settings.write_high_watermark_bytes);
+
+        }
+
+        bool below_low(const SocketSettings& settings) const {
+
+            return below(messages.load(boost::memory_order_relaxed), settings.write_low_watermark_messages, settings.write_high_watermark_messages)
+                    && below(bytes.load(boost::memory_order_relaxed), settings.write_low_watermark_bytes, settings.write_high_watermark_bytes);
+
+        }
+
+    private:
+
+        static bool below(size_t value, size_t low, size_t high) {
+            if (high == 0)
+                return true;
+            return value <= (low ? low : high / 2);
+        }
+
+    };
+
+    struct WriteMsg { // this is used in the write queue for convenience 
+
+        std::string msg;
+        BufferView buffer; // pooled or shared payload, sent instead of msg when set
+        boost::uint64_t enqueued; // stats_now() when queued, for the write latency
+        boost::uint64_t key; // messages with the same non zero key supersede each other under OVERFLOW_CONFLATE
+
+        WriteMsg()
+        : enqueued(0),
+        key(0) {
+        }
+
+        const char* data() const {
+            return buffer.empty() ? msg.data() : buffer.data();
+        }
+
+        size_t size() const {
+            return buffer.empty() ? msg.size() : buffer.size();
+        }
+
+    };
+
+    // a gather list that refers to the write actor's buffers instead of copying them,
+    // asio copies the buffer sequence into every write operation
+    class GatherBuffers {
+    public:
+
+        typedef boost::asio::const_buffer value_type;
+        typedef std::vector<boost::asio::const_buffer>::const_iterator const_iterator;
+
+        explicit GatherBuffers(const std::vector<boost::asio::const_buffer>& buffers)
+        : buffers_(&buffers) {
+        }
+
+        const_iterator begin() const {
+            return buffers_->begin();
+        }
+
+        const_iterator end() const {
+            return buffers_->end();
+        }
+
+    private:
+
+        const std::vector<boost::asio::const_buffer>* buffers_;
+
+    };
+
+    // drops the first bytes of a gather list, e.g. what a partial write took
+    void consume_buffers(std::vector<boost::asio::const_buffer>& buffers, size_t bytes);
+
+    // messages the write actor has taken off the write queue ahead of their turn, those the
+    // overflow policy thins out and those given back by a dropped connection for replay.
+    // They are written before anything still in the queue. io_service thread only
+    class WriteOverflow {
+    public:
+
+        bool empty() const {
+            return messages_.empty();
+        }
+
+        // the message is moved in
+        void push_front(WriteMsg& message);
+        void push_back(WriteMsg& message);
+
+        // the next message to write, from here and then from the queue
+        bool next(BoundedQueue<WriteMsg>& queue, WriteMsg& message);
+
+        // OVERFLOW_DROP_OLDEST discards from the front until the backlog is below the high
+        // watermark, OVERFLOW_CONFLATE takes in the queue and keeps the latest message for
+        // each key. The messages discarded are taken off the backlog and returned
+        size_t apply(const SocketSettings& settings, BoundedQueue<WriteMsg>& queue, WriteBacklog& backlog, size_t& dropped_bytes);
+
+    private:
+
+        size_t conflate(BoundedQueue<WriteMsg>& queue, size_t& dropped_bytes);
+
+        std::deque<WriteMsg> messages_;
+        std::vector<std::pair<boost::uint64_t, size_t> > keys_; // key and position in messages_, kept for reuse
+        std::vector<char> superseded_; // the positions in messages_ superseded by a later message
+
+    };
+
+}
+
+#endif	/* WRITEBACKLOG_H */
@@ -0,0 +1,467 @@
+/*
+ * File:   SessionReplay.cpp
+ * Author: mihiranad
+ *
+ * Replays a session recorded by SessionCapture. A loopback peer on 127.0.0.1
+ * sends what the session received, chunk by chunk, to a SocketHandler that
+ * checks every byte against the capture and measures how long each chunk
+ * took from the peer's send to OnReceive. Results are printed as a single
+ * JSON object, as SocketBench does.
+ *
+ * A session runs from a connect to the next close of the same connection.
+ * --list prints one JSON line per session of the capture instead.
+ *
+ * Options (--name=value)
+ *   capture      the capture file, required
+ *   list         1 to list the sessions rather than replay one, default 0
+ *   session      index of the session to replay, default the first one that received anything
+ *   timing       original, keeping the gaps between the chunks as captured, or fast, default original
+ *   speed        original timing only, the gaps are divided by this, default 1
+ *   port         peer port, 0 for any free one, default 0
+ *   backend      the handler's reads, reactor or uring, default reactor
+ *   read_notify  message, or batch for OnReceiveBatch, default message
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/thread.hpp>
+
+#include "SessionCapture.h"
+#include "SocketHandler.h"
+
+modt_log::LogSink g_Logger;
+
+using namespace modt_socket;
+
+namespace {
+
+    typedef boost::chrono::steady_clock bench_clock;
+
+    inline boost::uint64_t now_ns() {
+        return boost::chrono::duration_cast<boost::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+    }
+
+    struct Options {
+
+        std::string capture;
+        bool list;
+        long session;
+        std::string timing;
+        double speed;
+        unsigned short port;
+        std::string backend;
+        std::string read_notify;
+
+        Options()
+        : list(false),
+        session(-1),
+        timing("original"),
+        speed(1.0),
+        port(0),
+        backend("reactor"),
+        read_notify("message") {
+        }
+
+    };
+
+    // ------------------------------------------------------------------ capture
+
+    struct Chunk {
+
+        boost::uint64_t timestamp;
+        const char* data; // in the mapped capture
+        size_t size;
+
+    };
+
+    struct Session {
+
+        Session(boost::uint64_t connection, boost::uint64_t started)
+        : connection(connection),
+        started(started),
+        ended(started),
+        in_bytes(0),
+        out_chunks(0),
+        out_bytes(0),
+        closed(false) {
+        }
+
+        boost::uint64_t connection;
+        boost::uint64_t started;
+        boost::uint64_t ended;
+        std::vector<Chunk> in;
+        size_t in_bytes;
+        size_t out_chunks;
+        size_t out_bytes;
+        bool closed;
+
+    };
+
+    // splits the capture into sessions, the chunks point into the reader's mapping
+    void load_sessions(CaptureReader& reader, std::vector<Session>& sessions) {
+        std::map<boost::uint64_t, size_t> open; // connection to the index of its session
+        CaptureRecord record;
+        const char* payload;
+        while (reader.next(record, payload)) {
+            std::map<boost::uint64_t, size_t>::iterator it = open.find(record.connection);
+            if (record.kind == CAPTURE_CONNECT || it == open.end()) {
+                if (record.kind == CAPTURE_CLOSE)
+                    continue; // closed again, or before the capture was set
+                sessions.push_back(Session(record.connection, record.timestamp));
+                it = open.insert(std::make_pair(record.connection, sessions.size() - 1)).first;
+                it->second = sessions.size() - 1;
+            }
+            Session& session = sessions[it->second];
+            session.ended = record.timestamp;
+            if (record.kind == CAPTURE_IN) {
+                Chunk chunk = {record.timestamp, payload, record.size};
+                session.in.push_back(chunk);
+                session.in_bytes += record.size;
+            } else if (record.kind == CAPTURE_OUT) {
+                ++session.out_chunks;
+                session.out_bytes += record.size;
+            } else if (record.kind == CAPTURE_CLOSE) {
+                session.closed = true;
+                open.erase(it);
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------ peer
+
+    // sends the chunks of a session to the one connection it accepts, on a thread of its own
+    class Peer {
+    public:
+
+        Peer(const Session& session, const Options& options)
+        : session_(session),
+        options_(options),
+        acceptor_(io_service_, tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), options.port)),
+        socket_(io_service_),
+        sent_(new boost::atomic<boost::uint64_t>[session.in.size()]),
+        done_(false),
+        failed_(false) {
+            for (size_t i = 0; i < session.in.size(); ++i)
+                sent_[i] = 0;
+            thread_.reset(new boost::thread(boost::bind(&Peer::run, this)));
+        }
+
+        ~Peer() {
+            finish();
+        }
+
+        unsigned short port() const {
+            return acceptor_.local_endpoint().port();
+        }
+
+        // when chunk was handed to the socket, 0 if it has not been yet
+        boost::uint64_t sent(size_t chunk) const {
+            return sent_[chunk].load(boost::memory_order_acquire);
+        }
+
+        void finish() {
+            done_ = true;
+            if (thread_) {
+                thread_->join();
+                thread_.reset();
+            }
+        }
+
+        // the accept or a send failed
+        bool failed() const {
+            return failed_;
+        }
+
+    private:
+
+        void run() {
+            boost::system::error_code ec;
+            acceptor_.accept(socket_, ec);
+            if (ec) {
+                failed_ = true;
+                return;
+            }
+            socket_.set_option(tcp::no_delay(true));
+
+            bool original = options_.timing == "original";
+            boost::uint64_t start = now_ns();
+            boost::uint64_t first = session_.in.empty() ? 0 : session_.in[0].timestamp;
+
+            for (size_t i = 0; i < session_.in.size() && !done_; ++i) {
+                const Chunk& chunk = session_.in[i];
+                if (original) {
+                    boost::uint64_t due = start + static_cast<boost::uint64_t> ((chunk.timestamp - first) / options_.speed);
+                    // sleeps for the bulk of a gap and spins through the last bit, a sleep overshoots
+                    for (boost::uint64_t now = now_ns(); now < due && !done_; now = now_ns()) {
+                        if (due - now > 200000)
+                            boost::this_thread::sleep_for(boost::chrono::nanoseconds(due - now - 100000));
+                    }
+                }
+                sent_[i].store(now_ns(), boost::memory_order_release);
+                boost::asio::write(socket_, boost::asio::buffer(chunk.data, chunk.size), ec);
+                if (ec) {
+                    failed_ = true;
+                    return;
+                }
+            }
+
+            // stays connected until everything has arrived, so nothing is cut off by EOF
+            while (!done_)
+                boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+            socket_.close(ec);
+        }
+
+        const Session& session_;
+        const Options& options_;
+        boost::asio::io_service io_service_;
+        tcp::acceptor acceptor_;
+        tcp::socket socket_;
+        boost::scoped_array<boost::atomic<boost::uint64_t> > sent_;
+        boost::atomic<bool> done_;
+        boost::atomic<bool> failed_;
+        boost::scoped_ptr<boost::thread> thread_;
+
+    };
+
+    // ------------------------------------------------------------------ handler
+
+    class ReplayHandler : public SocketHandler {
+    public:
+
+        ReplayHandler(const Session& session, const Peer& peer)
+        : connected_(0),
+        received_(0),
+        mismatch_(false),
+        finished_(0),
+        session_(session),
+        peer_(peer),
+        chunk_(0),
+        offset_(0) {
+            latencies_.reserve(session.in.size());
+        }
+
+        virtual void OnConnectionStatus(bool *isConnected, boost::system::error_code* ec) {
+            connected_ = *isConnected ? 1 : -1;
+        }
+
+        virtual void OnRead(const char *s, const size_t *bytes, const size_t *bytes_requested, boost::system::error_code *ec) {
+        }
+
+        // the bytes have to come in as captured, a chunk is done when its last byte arrives
+        virtual void OnReceive(const BufferView& data, const boost::system::error_code& ec) {
+            boost::uint64_t now = now_ns();
+            const char* p = data.data();
+            size_t left = data.size();
+            while (left && chunk_ < session_.in.size()) {
+                const Chunk& chunk = session_.in[chunk_];
+                size_t take = std::min(left, chunk.size - offset_);
+                if (memcmp(p, chunk.data + offset_, take) != 0)
+                    mismatch_ = true;
+                p += take;
+                left -= take;
+                offset_ += take;
+                if (offset_ == chunk.size) {
+                    latencies_.push_back(now - peer_.sent(chunk_));
+                    ++chunk_;
+                    offset_ = 0;
+                    if (chunk_ == session_.in.size())
+                        finished_ = now;
+                }
+            }
+            if (left)
+                mismatch_ = true; // more than was captured
+            received_ += data.size();
+        }
+
+        virtual void OnAsyncWrite(const size_t *bytes, boost::system::error_code* ec) {
+        }
+
+        virtual void OnDisconnect() {
+        }
+
+        boost::atomic<int> connected_;
+        boost::atomic<size_t> received_;
+        boost::atomic<bool> mismatch_;
+        boost::atomic<boost::uint64_t> finished_; // when the last chunk was complete
+        std::vector<boost::uint64_t> latencies_; // written on the io thread, read once the replay is over
+
+    private:
+
+        const Session& session_;
+        const Peer& peer_;
+        size_t chunk_;
+        size_t offset_;
+
+    };
+
+    // ------------------------------------------------------------------ main
+
+    boost::uint64_t percentile(const std::vector<boost::uint64_t>& sorted, double p) {
+        if (sorted.empty())
+            return 0;
+        size_t index = static_cast<size_t> (p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    bool parse(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            size_t eq = arg.find('=');
+            if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+                fprintf(stderr, "bad argument %s, expected --name=value\n", argv[i]);
+                return false;
+            }
+            std::string name = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
+            try {
+                if (name == "capture") options.capture = value;
+                else if (name == "list") options.list = boost::lexical_cast<int>(value) != 0;
+                else if (name == "session") options.session = boost::lexical_cast<long>(value);
+                else if (name == "timing") options.timing = value;
+                else if (name == "speed") options.speed = boost::lexical_cast<double>(value);
+                else if (name == "port") options.port = boost::lexical_cast<unsigned short>(value);
+                else if (name == "backend") options.backend = value;
+                else if (name == "read_notify") options.read_notify = value;
+                else {
+                    fprintf(stderr, "unknown option %s\n", name.c_str());
+                    return false;
+                }
+            } catch (boost::bad_lexical_cast&) {
+                fprintf(stderr, "bad value for %s: %s\n", name.c_str(), value.c_str());
+                return false;
+            }
+        }
+        if (options.capture.empty()) {
+            fprintf(stderr, "--capture is required\n");
+            return false;
+        }
+        if (options.timing != "original" && options.timing != "fast") {
+            fprintf(stderr, "unknown timing %s\n", options.timing.c_str());
+            return false;
+        }
+        if (options.speed <= 0) {
+            fprintf(stderr, "speed must be above 0\n");
+            return false;
+        }
+        if (options.backend != "reactor" && options.backend != "uring") {
+            fprintf(stderr, "unknown backend %s\n", options.backend.c_str());
+            return false;
+        }
+        if (options.read_notify != "message" && options.read_notify != "batch") {
+            fprintf(stderr, "unknown read_notify %s\n", options.read_notify.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void list(const std::vector<Session>& sessions, const CaptureFileHeader& header) {
+        for (size_t i = 0; i < sessions.size(); ++i) {
+            const Session& session = sessions[i];
+            printf("{\"session\":%lu,\"connection\":\"0x%llx\",\"start_sec\":%.6f,\"duration_sec\":%.6f,\"closed\":%s,"
+                    "\"in_chunks\":%lu,\"in_bytes\":%lu,\"out_chunks\":%lu,\"out_bytes\":%lu}\n",
+                    static_cast<unsigned long> (i), static_cast<unsigned long long> (session.connection),
+                    (session.started - header.started) / 1e9, (session.ended - session.started) / 1e9, session.closed ? "true" : "false",
+                    static_cast<unsigned long> (session.in.size()), static_cast<unsigned long> (session.in_bytes),
+                    static_cast<unsigned long> (session.out_chunks), static_cast<unsigned long> (session.out_bytes));
+        }
+    }
+
+}
+
+int main(int argc, char** argv) {
+
+    Options options;
+    if (!parse(argc, argv, options))
+        return 2;
+
+    CaptureReader reader;
+    boost::system::error_code ec = reader.open(options.capture);
+    if (ec) {
+        fprintf(stderr, "cannot read %s: %s\n", options.capture.c_str(), ec.message().c_str());
+        return 2;
+    }
+
+    std::vector<Session> sessions;
+    load_sessions(reader, sessions);
+
+    if (options.list) {
+        list(sessions, reader.header());
+        return 0;
+    }
+
+    if (options.session < 0) {
+        for (size_t i = 0; i < sessions.size() && options.session < 0; ++i) {
+            if (!sessions[i].in.empty())
+                options.session = i;
+        }
+    }
+    if (options.session < 0 || static_cast<size_t> (options.session) >= sessions.size() || sessions[options.session].in.empty()) {
+        fprintf(stderr, "no session to replay in %s\n", options.capture.c_str());
+        return 2;
+    }
+    const Session& session = sessions[options.session];
+
+    Peer peer(session, options);
+
+    SocketSettings settings;
+    settings.read_mode = READ_STREAMING;
+    settings.read_notify = options.read_notify == "batch" ? READ_PER_BATCH : READ_PER_MESSAGE;
+    settings.io_backend = options.backend == "uring" ? IO_BACKEND_URING : IO_BACKEND_REACTOR;
+
+    ReplayHandler handler(session, peer);
+    handler.Configure(settings);
+    handler.AsyncConnect("127.0.0.1", boost::lexical_cast<std::string>(peer.port()).c_str());
+
+    // in original timing the replay takes as long as the capture did, it gets ten seconds on top of that
+    boost::uint64_t captured = session.in.back().timestamp - session.in.front().timestamp;
+    boost::uint64_t limit = 10000000000ULL;
+    if (options.timing == "original")
+        limit += static_cast<boost::uint64_t> (captured / options.speed);
+
+    boost::uint64_t start = now_ns();
+    bool ok = true;
+    while (handler.received_ < session.in_bytes && !handler.mismatch_) {
+        if (handler.connected_ < 0 || now_ns() - start > limit || peer.failed()) {
+            ok = false;
+            break;
+        }
+        boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+    }
+
+    handler.Disconnect();
+    peer.finish();
+
+    // from the first send to the last chunk in, connecting is not part of it
+    boost::uint64_t elapsed = handler.finished_ ? handler.finished_ - peer.sent(0) : now_ns() - start;
+    ok = ok && !handler.mismatch_ && handler.received_ == session.in_bytes;
+
+    std::vector<boost::uint64_t> latencies(handler.latencies_);
+    std::sort(latencies.begin(), latencies.end());
+    double seconds = elapsed / 1e9;
+
+    printf("{\"capture\":\"%s\",\"session\":%ld,\"connection\":\"0x%llx\",\"timing\":\"%s\",\"speed\":%.3f,\"backend\":\"%s\",\"read_notify\":\"%s\","
+            "\"ok\":%s,\"mismatch\":%s,\"chunks\":%lu,\"bytes\":%lu,\"received\":%lu,\"captured_sec\":%.6f,\"elapsed_sec\":%.6f,"
+            "\"chunks_per_sec\":%.1f,\"mb_per_sec\":%.3f,\"latency_ns\":{\"p50\":%llu,\"p99\":%llu,\"p99_9\":%llu,\"max\":%llu}}\n",
+            options.capture.c_str(), options.session, static_cast<unsigned long long> (session.connection), options.timing.c_str(), options.speed,
+            options.backend.c_str(), options.read_notify.c_str(), ok ? "true" : "false", handler.mismatch_ ? "true" : "false",
+            static_cast<unsigned long> (session.in.size()), static_cast<unsigned long> (session.in_bytes),
+            static_cast<unsigned long> (handler.received_.load()), captured / 1e9, seconds,
+            latencies.size() / seconds, handler.received_ / seconds / (1024 * 1024),
+            static_cast<unsigned long long> (percentile(latencies, 50)),
+            static_cast<unsigned long long> (percentile(latencies, 99)),
+            static_cast<unsigned long long> (percentile(latencies, 99.9)),
+            static_cast<unsigned long long> (latencies.empty() ? 0 : latencies.back()));
+
+    return ok ? 0 : 1;
+
+}
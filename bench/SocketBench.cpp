@@ -0,0 +1,748 @@
+/*
+ * File:   SocketBench.cpp
+ * Author: mihiranad
+ *
+ * Loopback benchmark for the SocketHandler operations. A built in server on
+ * 127.0.0.1 echoes, sinks or pushes fixed size messages; every message
+ * carries the time it was created in its first 8 bytes so latency is
+ * measured on arrival. Results are printed as a single JSON object.
+ *
+ * Transports
+ *   tcp          TCP over the loopback interface
+ *   unix         a Unix-domain stream socket, /tmp/socket_bench.<port>.sock
+ *   shm          the Unix-domain socket upgraded to shared memory rings. The server
+ *                side is a ServerHandler session rather than a plain asio one, it
+ *                has to speak the shared memory handshake
+ *
+ * Scenarios
+ *   async_write  AsyncWrite to an echo server, latency is the round trip
+ *   write        Write (sent inline when the connection is idle) to an echo server, latency is the round trip
+ *   read         the server pushes messages, the client asks for each with Read(size),
+ *                latency is server send to OnRead
+ *   connect      AsyncConnect/Disconnect cycles, latency is AsyncConnect to OnConnectionStatus
+ *
+ * Options (--name=value)
+ *   scenario     one of the above, default async_write
+ *   size         message size in bytes, at least 8, default 64
+ *   connections  concurrent connections, default 1
+ *   messages     messages (or connect cycles) per connection, default 100000
+ *   rate         messages per second per connection, 0 for as fast as possible, default 0
+ *   pool         io threads shared by the connections, 0 for a thread per connection, default 0
+ *   port         server port, default 47000
+ *   profile      socket options of the connections: default, low_latency or bulk
+ *   transport    tcp, unix or shm, default tcp
+ *   spin         shm only, microseconds the reader polls an empty ring, default 0
+ *   backend      the client connections' reads and writes, reactor or uring, default reactor
+ *   run          how the client io threads run, blocking or busy_poll, default blocking
+ *   cpu          first CPU to pin the client io threads to, -1 for none, default -1
+ *   rt_priority  SCHED_FIFO priority of the client io threads, 0 for none, default 0
+ *   capture      file to record the client connections' traffic to, for SessionReplay. Default none
+ */
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "ServerHandler.h"
+#include "SocketHandler.h"
+
+modt_log::LogSink g_Logger;
+
+using namespace modt_socket;
+
+namespace {
+
+    typedef boost::chrono::steady_clock bench_clock;
+
+    inline boost::uint64_t now_ns() {
+        return boost::chrono::duration_cast<boost::chrono::nanoseconds>(bench_clock::now().time_since_epoch()).count();
+    }
+
+    inline void stamp(char* message) {
+        boost::uint64_t now = now_ns();
+        memcpy(message, &now, sizeof (now));
+    }
+
+    inline boost::uint64_t stamp_of(const char* message) {
+        boost::uint64_t sent;
+        memcpy(&sent, message, sizeof (sent));
+        return sent;
+    }
+
+    double cpu_seconds() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    struct Options {
+
+        std::string scenario;
+        size_t size;
+        size_t connections;
+        size_t messages;
+        double rate;
+        size_t pool;
+        unsigned short port;
+        std::string profile;
+        std::string transport;
+        size_t spin;
+        std::string backend;
+        std::string run;
+        int cpu;
+        int rt_priority;
+        std::string capture;
+        SocketOptions socket_options;
+
+        Options()
+        : scenario("async_write"),
+        size(64),
+        connections(1),
+        messages(100000),
+        rate(0),
+        pool(0),
+        port(47000),
+        profile("default"),
+        transport("tcp"),
+        spin(0),
+        backend("reactor"),
+        run("blocking"),
+        cpu(-1),
+        rt_priority(0) {
+        }
+
+        bool local() const {
+            return transport != "tcp";
+        }
+
+        std::string path() const {
+            return "/tmp/socket_bench." + boost::lexical_cast<std::string>(port) + ".sock";
+        }
+
+    };
+
+    // ------------------------------------------------------------------ server
+
+    enum ServerMode {
+        SERVER_ECHO,
+        SERVER_SINK,
+        SERVER_PUSH
+    };
+
+    class ServerSession : public boost::enable_shared_from_this<ServerSession> {
+    public:
+
+        ServerSession(boost::asio::io_service& io_service, ServerMode mode, size_t size, size_t messages)
+        : socket_(io_service),
+        mode_(mode),
+        size_(size),
+        remaining_(messages),
+        buffer_(64 * 1024) {
+        }
+
+        StreamSocket& socket() {
+            return socket_;
+        }
+
+        void start(bool tcp) {
+            if (tcp) {
+                SocketOptions options;
+                options.no_delay = 1;
+                apply_socket_options(socket_, options);
+            }
+            if (mode_ == SERVER_PUSH)
+                push();
+            else
+                read();
+        }
+
+    private:
+
+        void read() {
+            socket_.async_read_some(boost::asio::buffer(buffer_),
+                    boost::bind(&ServerSession::handle_read, shared_from_this(), _1, _2));
+        }
+
+        void handle_read(const boost::system::error_code& ec, size_t bytes) {
+            if (ec)
+                return;
+            if (mode_ == SERVER_SINK) {
+                read();
+                return;
+            }
+            boost::asio::async_write(socket_, boost::asio::buffer(&buffer_[0], bytes),
+                    boost::bind(&ServerSession::handle_echo, shared_from_this(), _1));
+        }
+
+        void handle_echo(const boost::system::error_code& ec) {
+            if (!ec)
+                read();
+        }
+
+        // keeps up to 64 messages in flight, each stamped when it is handed to the socket
+        void push() {
+            // once everything is out the session stays open until the client
+            // hangs up, so nothing still buffered on its side is cut off by EOF
+            if (remaining_ == 0) {
+                mode_ = SERVER_SINK;
+                read();
+                return;
+            }
+            size_t count = std::min<size_t>(remaining_, 64);
+            remaining_ -= count;
+            push_buffer_.assign(count * size_, 0);
+            for (size_t i = 0; i < count; ++i)
+                stamp(&push_buffer_[i * size_]);
+            boost::asio::async_write(socket_, boost::asio::buffer(push_buffer_),
+                    boost::bind(&ServerSession::handle_push, shared_from_this(), _1));
+        }
+
+        void handle_push(const boost::system::error_code& ec) {
+            if (!ec)
+                push();
+        }
+
+        StreamSocket socket_;
+        ServerMode mode_;
+        size_t size_;
+        size_t remaining_;
+        std::vector<char> buffer_;
+        std::vector<char> push_buffer_;
+
+    };
+
+    class Server {
+    public:
+
+        Server(const StreamEndpoint& ep, ServerMode mode, size_t size, size_t messages)
+        : acceptor_(io_service_),
+        local_(is_local(ep)),
+        mode_(mode),
+        size_(size),
+        messages_(messages) {
+            acceptor_.open(ep.protocol());
+            if (!local_)
+                acceptor_.set_option(StreamAcceptor::reuse_address(true));
+            acceptor_.bind(ep);
+            acceptor_.listen();
+            accept();
+            thread_.reset(new boost::thread(boost::bind(&boost::asio::io_service::run, &io_service_)));
+        }
+
+        ~Server() {
+            io_service_.stop();
+            thread_->join();
+        }
+
+    private:
+
+        void accept() {
+            boost::shared_ptr<ServerSession> session(new ServerSession(io_service_, mode_, size_, messages_));
+            acceptor_.async_accept(session->socket(), boost::bind(&Server::handle_accept, this, session, _1));
+        }
+
+        void handle_accept(boost::shared_ptr<ServerSession> session, const boost::system::error_code& ec) {
+            if (!ec)
+                session->start(!local_);
+            accept();
+        }
+
+        boost::asio::io_service io_service_;
+        StreamAcceptor acceptor_;
+        bool local_;
+        ServerMode mode_;
+        size_t size_;
+        size_t messages_;
+        boost::scoped_ptr<boost::thread> thread_;
+
+    };
+
+    // the server side of the shm transport, the same modes as ServerSession over the library
+    class ShmServer;
+
+    class ShmSession : public BasicSocketHandler<ShmSession> {
+    public:
+
+        // ServerHandler needs a default constructor, ShmServer always passes the lot
+        explicit ShmSession(ShmServer* server = NULL, ServerMode mode = SERVER_ECHO, size_t size = 8, size_t messages = 0)
+        : server_(server),
+        mode_(mode),
+        size_(size),
+        remaining_(messages),
+        message_(size, 'x') {
+        }
+
+        ~ShmSession() {
+            Disconnect();
+        }
+
+        void OnConnect(bool connected, const boost::system::error_code& ec) {
+            if (connected && mode_ == SERVER_PUSH)
+                for (size_t i = 0; i < 64; ++i)
+                    push();
+        }
+
+        void OnReceive(const BufferView& data, const boost::system::error_code& ec) {
+            if (mode_ == SERVER_ECHO)
+                AsyncWrite(data);
+        }
+
+        // keeps up to 64 messages in flight, each stamped when it is queued
+        void OnWriteComplete(size_t bytes, const boost::system::error_code& ec) {
+            if (mode_ == SERVER_PUSH)
+                push();
+        }
+
+        void OnClose(const boost::system::error_code& ec);
+
+    private:
+
+        void push() {
+            if (remaining_ == 0)
+                return;
+            --remaining_;
+            stamp(&message_[0]);
+            AsyncWrite(message_);
+        }
+
+        ShmServer* server_;
+        ServerMode mode_;
+        size_t size_;
+        size_t remaining_;
+        std::string message_;
+
+    };
+
+    class ShmServer : public ServerHandler<ShmSession> {
+    public:
+
+        ShmServer(const std::string& path, ServerMode mode, size_t size, size_t messages)
+        : mode_(mode),
+        size_(size),
+        messages_(messages) {
+            ListenLocal(path.c_str());
+        }
+
+        ~ShmServer() {
+            Stop(); // the acceptors call CreateConnection until they are stopped
+        }
+
+        virtual ShmSession* CreateConnection() {
+            ShmSession* session = new ShmSession(this, mode_, size_, messages_);
+            SocketSettings settings;
+            settings.read_mode = READ_STREAMING;
+            settings.shared_memory.enabled = true;
+            session->Configure(settings);
+            return session;
+        }
+
+    private:
+
+        ServerMode mode_;
+        size_t size_;
+        size_t messages_;
+
+    };
+
+    void ShmSession::OnClose(const boost::system::error_code& ec) {
+        server_->Close(this);
+    }
+
+    // ------------------------------------------------------------------ client
+
+    class BenchHandler : public SocketHandler {
+    public:
+
+        BenchHandler(size_t size, size_t expected)
+        : connected_(0),
+        received_(0),
+        size_(size),
+        partial_(0),
+        connect_started_(0) {
+            latencies_.reserve(expected);
+            message_.resize(size);
+        }
+
+        virtual void OnConnectionStatus(bool *isConnected, boost::system::error_code* ec) {
+            if (connect_started_)
+                latencies_.push_back(now_ns() - connect_started_);
+            connected_ = *isConnected ? 1 : -1;
+        }
+
+        virtual void OnRead(const char *s, const size_t *bytes, const size_t *bytes_requested, boost::system::error_code *ec) {
+        }
+
+        // messages may be split across reads in streaming mode, the partial one is kept in message_
+        virtual void OnReceive(const BufferView& data, const boost::system::error_code& ec) {
+            boost::uint64_t now = now_ns();
+            const char* p = data.data();
+            size_t left = data.size();
+            while (left) {
+                if (partial_ == 0 && left >= size_) {
+                    latencies_.push_back(now - stamp_of(p));
+                    p += size_;
+                    left -= size_;
+                } else {
+                    size_t take = std::min(left, size_ - partial_);
+                    memcpy(&message_[partial_], p, take);
+                    partial_ += take;
+                    p += take;
+                    left -= take;
+                    if (partial_ < size_)
+                        break;
+                    latencies_.push_back(now - stamp_of(&message_[0]));
+                    partial_ = 0;
+                }
+                ++received_;
+            }
+        }
+
+        virtual void OnAsyncWrite(const size_t *bytes, boost::system::error_code* ec) {
+        }
+
+        virtual void OnDisconnect() {
+        }
+
+        void reset_connect(boost::uint64_t started) {
+            connected_ = 0;
+            connect_started_ = started;
+        }
+
+        boost::atomic<int> connected_;
+        boost::atomic<size_t> received_;
+        std::vector<boost::uint64_t> latencies_; // written on the io thread, read once the run is over
+
+    private:
+
+        size_t size_;
+        size_t partial_;
+        std::vector<char> message_;
+        boost::uint64_t connect_started_;
+
+    };
+
+    typedef boost::shared_ptr<BenchHandler> BenchHandlerPtr;
+
+    bool wait_until(const boost::atomic<int>& flag, int value, int timeout_ms) {
+        bench_clock::time_point deadline = bench_clock::now() + boost::chrono::milliseconds(timeout_ms);
+        while (flag != value) {
+            if (bench_clock::now() > deadline)
+                return false;
+            boost::this_thread::yield();
+        }
+        return true;
+    }
+
+    void connect(BenchHandler& handler, const Options& options) {
+        if (options.local())
+            handler.AsyncConnectLocal(options.path().c_str(), options.socket_options);
+        else
+            handler.AsyncConnect("127.0.0.1", boost::lexical_cast<std::string>(options.port).c_str(), options.socket_options);
+    }
+
+    bool connect_all(std::vector<BenchHandlerPtr>& handlers, const Options& options) {
+        for (size_t i = 0; i < handlers.size(); ++i)
+            connect(*handlers[i], options);
+        for (size_t i = 0; i < handlers.size(); ++i) {
+            if (!wait_until(handlers[i]->connected_, 1, 10000)) {
+                fprintf(stderr, "connection %lu failed\n", static_cast<unsigned long> (i));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // paces the sends of every connection at the configured rate, or sends as fast as the queues accept
+    void send_all(std::vector<BenchHandlerPtr>& handlers, const Options& options, bool blocking) {
+        std::vector<size_t> sent(handlers.size(), 0);
+        std::string message(options.size, 'x');
+        boost::uint64_t start = now_ns();
+        double interval = options.rate > 0 ? 1e9 / options.rate : 0;
+        size_t done = 0;
+
+        while (done < handlers.size()) {
+            done = 0;
+            boost::uint64_t now = now_ns();
+            for (size_t i = 0; i < handlers.size(); ++i) {
+                if (sent[i] == options.messages) {
+                    ++done;
+                    continue;
+                }
+                if (interval > 0 && now < start + static_cast<boost::uint64_t> (sent[i] * interval))
+                    continue;
+                stamp(&message[0]);
+                if (blocking) {
+                    if (handlers[i]->Write(message) == message.size())
+                        ++sent[i];
+                } else {
+                    BufferBlockPtr block = handlers[i]->AllocateBuffer();
+                    memcpy(block->data(), message.data(), message.size());
+                    if (handlers[i]->AsyncWrite(BufferView(block, message.size())) == WRITE_QUEUED)
+                        ++sent[i];
+                }
+            }
+        }
+    }
+
+    bool wait_received(std::vector<BenchHandlerPtr>& handlers, size_t expected) {
+        bench_clock::time_point deadline = bench_clock::now() + boost::chrono::seconds(60);
+        for (size_t i = 0; i < handlers.size(); ++i) {
+            while (handlers[i]->received_ < expected) {
+                if (bench_clock::now() > deadline) {
+                    fprintf(stderr, "connection %lu received %lu of %lu messages\n", static_cast<unsigned long> (i),
+                            static_cast<unsigned long> (handlers[i]->received_.load()), static_cast<unsigned long> (expected));
+                    return false;
+                }
+                boost::this_thread::sleep(boost::posix_time::microsec(50));
+            }
+        }
+        return true;
+    }
+
+    // Read() requests are kept a window ahead of the data received
+    void request_all(std::vector<BenchHandlerPtr>& handlers, const Options& options) {
+        std::vector<size_t> requested(handlers.size(), 0);
+        size_t window = std::max<size_t>(1, std::min<size_t>(512, handlers[0]->ReadQueueCapacity() / 2));
+        size_t done = 0;
+
+        while (done < handlers.size()) {
+            done = 0;
+            for (size_t i = 0; i < handlers.size(); ++i) {
+                if (requested[i] == options.messages) {
+                    ++done;
+                    continue;
+                }
+                while (requested[i] < options.messages && requested[i] < handlers[i]->received_ + window) {
+                    if (!handlers[i]->Read(options.size))
+                        break;
+                    ++requested[i];
+                }
+            }
+            boost::this_thread::yield();
+        }
+    }
+
+    bool run_connect(std::vector<BenchHandlerPtr>& handlers, const Options& options) {
+        for (size_t cycle = 0; cycle < options.messages; ++cycle) {
+            for (size_t i = 0; i < handlers.size(); ++i) {
+                handlers[i]->reset_connect(now_ns());
+                connect(*handlers[i], options);
+            }
+            for (size_t i = 0; i < handlers.size(); ++i) {
+                if (!wait_until(handlers[i]->connected_, 1, 10000))
+                    return false;
+                handlers[i]->Disconnect();
+                ++handlers[i]->received_;
+            }
+        }
+        return true;
+    }
+
+    boost::uint64_t percentile(const std::vector<boost::uint64_t>& sorted, double p) {
+        if (sorted.empty())
+            return 0;
+        size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    bool parse(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg(argv[i]);
+            size_t eq = arg.find('=');
+            if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+                fprintf(stderr, "bad argument %s, expected --name=value\n", argv[i]);
+                return false;
+            }
+            std::string name = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
+            try {
+                if (name == "scenario") options.scenario = value;
+                else if (name == "size") options.size = boost::lexical_cast<size_t>(value);
+                else if (name == "connections") options.connections = boost::lexical_cast<size_t>(value);
+                else if (name == "messages") options.messages = boost::lexical_cast<size_t>(value);
+                else if (name == "rate") options.rate = boost::lexical_cast<double>(value);
+                else if (name == "pool") options.pool = boost::lexical_cast<size_t>(value);
+                else if (name == "port") options.port = boost::lexical_cast<unsigned short>(value);
+                else if (name == "profile") options.profile = value;
+                else if (name == "transport") options.transport = value;
+                else if (name == "spin") options.spin = boost::lexical_cast<size_t>(value);
+                else if (name == "backend") options.backend = value;
+                else if (name == "run") options.run = value;
+                else if (name == "cpu") options.cpu = boost::lexical_cast<int>(value);
+                else if (name == "rt_priority") options.rt_priority = boost::lexical_cast<int>(value);
+                else if (name == "capture") options.capture = value;
+                else {
+                    fprintf(stderr, "unknown option %s\n", name.c_str());
+                    return false;
+                }
+            } catch (boost::bad_lexical_cast&) {
+                fprintf(stderr, "bad value for %s: %s\n", name.c_str(), value.c_str());
+                return false;
+            }
+        }
+        if (options.size < sizeof (boost::uint64_t)) {
+            fprintf(stderr, "size must be at least %lu bytes\n", static_cast<unsigned long> (sizeof (boost::uint64_t)));
+            return false;
+        }
+        if (options.connections == 0)
+            options.connections = 1;
+        if (options.profile == "low_latency")
+            options.socket_options = SocketOptions::LowLatency();
+        else if (options.profile == "bulk")
+            options.socket_options = SocketOptions::BulkThroughput();
+        else if (options.profile != "default") {
+            fprintf(stderr, "unknown profile %s\n", options.profile.c_str());
+            return false;
+        }
+        if (options.transport != "tcp" && options.transport != "unix" && options.transport != "shm") {
+            fprintf(stderr, "unknown transport %s\n", options.transport.c_str());
+            return false;
+        }
+        if (options.backend != "reactor" && options.backend != "uring") {
+            fprintf(stderr, "unknown backend %s\n", options.backend.c_str());
+            return false;
+        }
+        if (options.run != "blocking" && options.run != "busy_poll") {
+            fprintf(stderr, "unknown run mode %s\n", options.run.c_str());
+            return false;
+        }
+        return true;
+    }
+
+}
+
+int main(int argc, char** argv) {
+
+    Options options;
+    if (!parse(argc, argv, options))
+        return 2;
+
+    ServerMode mode = SERVER_ECHO;
+    if (options.scenario == "read")
+        mode = SERVER_PUSH;
+    else if (options.scenario == "connect")
+        mode = SERVER_SINK;
+    else if (options.scenario != "async_write" && options.scenario != "write") {
+        fprintf(stderr, "unknown scenario %s\n", options.scenario.c_str());
+        return 2;
+    }
+
+    boost::scoped_ptr<Server> server;
+    boost::scoped_ptr<ShmServer> shm_server;
+    if (options.transport == "shm") {
+        shm_server.reset(new ShmServer(options.path(), mode, options.size, options.messages));
+    } else {
+        if (options.local())
+            unlink(options.path().c_str());
+        server.reset(new Server(options.local() ? make_local_endpoint(options.path().c_str())
+                : StreamEndpoint(tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), options.port)),
+                mode, options.size, options.messages));
+    }
+
+    RunSettings run;
+    run.mode = options.run == "busy_poll" ? RUN_BUSY_POLL : RUN_BLOCKING;
+    run.cpu = options.cpu;
+    run.rt_priority = options.rt_priority;
+
+    boost::scoped_ptr<IoServicePool> pool;
+    if (options.pool)
+        pool.reset(new IoServicePool(options.pool, POOL_ROUND_ROBIN, run));
+
+    SocketSettings settings;
+    settings.run = run;
+
+    if (!options.capture.empty()) {
+        settings.capture.reset(new SessionCapture);
+        boost::system::error_code ec = settings.capture->open(options.capture);
+        if (ec) {
+            fprintf(stderr, "cannot capture to %s: %s\n", options.capture.c_str(), ec.message().c_str());
+            return 2;
+        }
+    }
+    settings.read_mode = (mode == SERVER_PUSH) ? READ_REQUESTED : READ_STREAMING;
+    settings.write_buffer_size = options.size;
+    settings.shared_memory.enabled = options.transport == "shm";
+    settings.shared_memory.spin_us = options.spin;
+    settings.io_backend = options.backend == "uring" ? IO_BACKEND_URING : IO_BACKEND_REACTOR;
+
+    std::vector<BenchHandlerPtr> handlers;
+    for (size_t i = 0; i < options.connections; ++i) {
+        BenchHandlerPtr handler(new BenchHandler(options.size, options.messages));
+        handler->Configure(settings);
+        handler->SetIoServicePool(pool.get());
+        handlers.push_back(handler);
+    }
+
+    bool ok = true;
+    double cpu_start = 0;
+    boost::uint64_t start = 0;
+
+    if (options.scenario == "connect") {
+
+        cpu_start = cpu_seconds();
+        start = now_ns();
+        ok = run_connect(handlers, options);
+
+    } else {
+
+        ok = connect_all(handlers, options);
+        cpu_start = cpu_seconds();
+        start = now_ns();
+
+        if (ok) {
+            if (mode == SERVER_PUSH)
+                request_all(handlers, options);
+            else
+                send_all(handlers, options, options.scenario == "write");
+            ok = wait_received(handlers, options.messages);
+        }
+
+    }
+
+    boost::uint64_t elapsed = now_ns() - start;
+    double cpu = cpu_seconds() - cpu_start;
+
+    std::vector<boost::uint64_t> latencies;
+    size_t total = 0;
+    for (size_t i = 0; i < handlers.size(); ++i) {
+        handlers[i]->Disconnect();
+        total += handlers[i]->received_;
+        latencies.insert(latencies.end(), handlers[i]->latencies_.begin(), handlers[i]->latencies_.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    double seconds = elapsed / 1e9;
+    double bytes = static_cast<double> (total) * (options.scenario == "connect" ? 0 : options.size);
+
+    if (options.transport == "unix")
+        unlink(options.path().c_str());
+
+    printf("{\"scenario\":\"%s\",\"transport\":\"%s\",\"backend\":\"%s\",\"run\":\"%s\",\"profile\":\"%s\",\"ok\":%s,\"message_size\":%lu,\"connections\":%lu,\"messages_per_connection\":%lu,"
+            "\"rate\":%.0f,\"pool_threads\":%lu,\"messages\":%lu,\"elapsed_sec\":%.6f,\"msgs_per_sec\":%.1f,\"mb_per_sec\":%.3f,"
+            "\"latency_ns\":{\"p50\":%llu,\"p99\":%llu,\"p99_9\":%llu,\"max\":%llu},\"cpu_ns_per_msg\":%.1f}\n",
+            options.scenario.c_str(), options.transport.c_str(), options.backend.c_str(), options.run.c_str(), options.profile.c_str(), ok ? "true" : "false",
+            static_cast<unsigned long> (options.size), static_cast<unsigned long> (options.connections),
+            static_cast<unsigned long> (options.messages), options.rate, static_cast<unsigned long> (options.pool),
+            static_cast<unsigned long> (total), seconds, total / seconds, bytes / seconds / (1024 * 1024),
+            static_cast<unsigned long long> (percentile(latencies, 50)),
+            static_cast<unsigned long long> (percentile(latencies, 99)),
+            static_cast<unsigned long long> (percentile(latencies, 99.9)),
+            static_cast<unsigned long long> (latencies.empty() ? 0 : latencies.back()),
+            total ? cpu * 1e9 / total : 0.0);
+
+    return ok ? 0 : 1;
+
+}